@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <iostream>
 #include "CFormat.h"
 #include "COut.h"
+#include "CDeviceIndex.h"
 
 using namespace std;
 using namespace boost::filesystem;
@@ -35,79 +36,30 @@ CAVRDevice::CAVRDevice(string deviceFile) {
 }
 
 CAVRDevice::CAVRDevice(uint32_t deviceSignature) {
-	bool found = false;
 	string deviceFile;
-	string homeConfigDir;
 
-	homeConfigDir = getHomeDir() + HOME_CONFIG_DIR;
+	// description files are only parsed if a config directory changed
+	if (index().find(deviceSignature, &deviceFile) == false) {
+		throw DeviceNotFoundException("No device description file found for device signature 0x" + CFormat::intToHexString(deviceSignature) + ".");
+	}
+	openDevicefile(deviceFile);
+}
 
-	try {
-		// search all *.xml files in CONFIG_DIR
-		if (is_directory(CONFIG_DIR)) {
-			directory_iterator endIter;
-			for (directory_iterator dirIter(CONFIG_DIR); dirIter != endIter; dirIter++) {
-				if (is_regular_file(dirIter->status())) {
-#if BOOST_FILESYSTEM_VERSION == 3
-					if (dirIter->path().extension().string().compare(".xml") == 0) {
-						deviceFile = dirIter->path().stem().string();
-#else
-					if (dirIter->path().extension().compare(".xml") == 0) {
-						deviceFile = dirIter->path().stem();
-#endif
-						if (hasDeviceSignature(deviceSignature, deviceFile) == true) {
-							found = true;
-							break;
-						}
-					}
-				}
-			}
-		}
+CAVRDevice::CAVRDevice() {
 
-		if (found == false) {
-			// search all *.xml files in HOME_CONFIG_DIR
-			if (is_directory(homeConfigDir)) {
-				directory_iterator endIter;
-				for (directory_iterator dirIter(homeConfigDir); dirIter != endIter; dirIter++) {
-					if (is_regular_file(dirIter->status())) {
-#if BOOST_FILESYSTEM_VERSION == 3
-						if (dirIter->path().extension().string().compare(".xml") == 0) {
-							deviceFile = dirIter->path().stem().string();
-#else
-						if (dirIter->path().extension().compare(".xml") == 0) {
-							deviceFile = dirIter->path().stem();
-#endif
-							if (hasDeviceSignature(deviceSignature, deviceFile) == true) {
-								found = true;
-								break;
-							}
-						}
-					}
-				}
-			}
-		}
+}
 
-		if (found == false) {
-			throw DeviceNotFoundException("No device description file found for device signature 0x" + CFormat::intToHexString(deviceSignature) + ".");
-		}
-	}
-	catch (const std::exception &e) {
-		throw DeviceException((string)"Error while searching for device descriptions files.\n" + e.what());
-	}
+uint32_t CAVRDevice::readSignature(string path) {
+	CAVRDevice device;
+
+	device.readDevicefile(path);
+	return device.deviceSignature();
 }
 
-bool CAVRDevice::hasDeviceSignature(uint32_t deviceSignature, string deviceFile) {
-	try {
-		openDevicefile(deviceFile);
-		if (this->deviceSignature() == deviceSignature) {
-			return true;
-		}
-		else {
-			return false;
-		}
-	}
-	catch (DeviceException &e) {
-		return false;
-	}
+CDeviceIndex &CAVRDevice::index() {
+	static CDeviceIndex deviceIndex;
+
+	return deviceIndex;
 }
 
 int CAVRDevice::flashSize() {
@@ -147,56 +99,31 @@ string CAVRDevice::getHomeDir() {
 
 void CAVRDevice::listDevices() {
 	bool configDirFound = false;
-	string homeConfigDir;
-
-	homeConfigDir = getHomeDir() + HOME_CONFIG_DIR;
-
-	try {
-		cout << "List of supported mcu types:" << endl;
-		// list all *.xml files in CONFIG_DIR
-		if (is_directory(CONFIG_DIR)) {
-			configDirFound = true;
-			cout << "system wide:" << endl;
-			directory_iterator endIter;
-			for (directory_iterator dirIter(CONFIG_DIR); dirIter != endIter; dirIter++) {
-				if (is_regular_file(dirIter->status())) {
-#if BOOST_FILESYSTEM_VERSION == 3
-					if (dirIter->path().extension().string().compare(".xml") == 0) {
-						cout << "\t" << dirIter->path().stem().string() << endl;
-#else
-					if (dirIter->path().extension().compare(".xml") == 0) {
-						cout << "\t" << dirIter->path().stem() << endl;
-#endif
-					}
-				}
-			}
-		}
-
-		// list all *.xml files in HOME_CONFIG_DIR
-		if (is_directory(homeConfigDir)) {
-			configDirFound = true;
-			cout << "user defined:" << endl;
-			directory_iterator endIter;
-			for (directory_iterator dirIter(homeConfigDir); dirIter != endIter; dirIter++) {
-				if (is_regular_file(dirIter->status())) {
-#if BOOST_FILESYSTEM_VERSION == 3
-					if (dirIter->path().extension().string().compare(".xml") == 0) {
-						cout << "\t" << dirIter->path().stem().string() << endl;
-#else
-					if (dirIter->path().extension().compare(".xml") == 0) {
-						cout << "\t" << dirIter->path().stem() << endl;
-#endif
-					}
-				}
-			}
+	vector<string> names;
+
+	cout << "List of supported mcu types:" << endl;
+	// all *.xml files in CONFIG_DIR
+	if (index().exists(CDeviceIndex::SYSTEM_DIR)) {
+		configDirFound = true;
+		cout << "system wide:" << endl;
+		names = index().names(CDeviceIndex::SYSTEM_DIR);
+		for (unsigned int i=0; i<names.size(); i++) {
+			cout << "\t" << names[i] << endl;
 		}
+	}
 
-		if (configDirFound == false) {
-			throw DeviceException("Configuration directory '" + (string)CONFIG_DIR + "' does not exist.");
+	// all *.xml files in HOME_CONFIG_DIR
+	if (index().exists(CDeviceIndex::USER_DIR)) {
+		configDirFound = true;
+		cout << "user defined:" << endl;
+		names = index().names(CDeviceIndex::USER_DIR);
+		for (unsigned int i=0; i<names.size(); i++) {
+			cout << "\t" << names[i] << endl;
 		}
 	}
-	catch (const std::exception &e) {
-		throw DeviceException((string)"Error while searching for device descriptions files.\n" + e.what());
+
+	if (configDirFound == false) {
+		throw DeviceException("Configuration directory '" + (string)CONFIG_DIR + "' does not exist.");
 	}
 }
 
@@ -204,9 +131,6 @@ void CAVRDevice::openDevicefile(string deviceFile) {
 	string deviceFilePath;		// path from which the file is opened
 	string configPath;			// path to device description file in CONFIG_DIR
 	string homeConfigPath;		// path to device description file in HOME_CONFIG_DIR
-	ptree propetries;			// property map to read xml device description file
-	string deviceSignature;
-	string socket;
 
 	//if (deviceFile.size() == 0) {
 	//	throw DeviceNotFoundException("Device description file '" + deviceFile + "' not found.");
@@ -241,41 +165,56 @@ void CAVRDevice::openDevicefile(string deviceFile) {
 		throw DeviceNotFoundException("Device description file '" + deviceFile + "' not found.");
 	}
 
+	readDevicefile(deviceFilePath);
+
+	COut::d("Infos from device description file '" + deviceFilePath + "':");
+	COut::d("\tDevice name: " + _name);
+	COut::d("\tSize of flash memory: " + CFormat::intToString(_flashSize) + " bytes");
+	COut::d("\tSize of flash page: " + CFormat::intToString(_flashPageSize) + " bytes");
+	COut::d("\tSize of eeprom memory: " + CFormat::intToString(_eepromSize) + " bytes");
+	COut::d("\tNumber of fuse bytes: " + CFormat::intToString(_fusesSize));
+	COut::d("\tDevice signature: 0x" + CFormat::intToHexString(_deviceSignature));
+	COut::d("\tSocket: " + (_socket == AUTO_DETECT ? (string)"auto" : CFormat::intToString(_socket)));
+	COut::d("");
+}
+
+/*
+ * parse and check a device description file without any output
+ */
+void CAVRDevice::readDevicefile(string deviceFilePath) {
+	ptree propetries;			// property map to read xml device description file
+	string deviceSignature;
+	string socket;
+
 	try {
-		COut::d("Infos from device description file '" + deviceFilePath + "':");
 		read_xml(deviceFilePath, propetries);
 
 		// read device name
 		_name = propetries.get<string>("device.name");
-		COut::d("\tDevice name: " + _name);
 
 		// read flash size
 		_flashSize = propetries.get<int>("device.flashSize");
 		if (_flashSize <= 0) {
 			throw DeviceException("Invalid flash size in device description file.");
 		}
-		COut::d("\tSize of flash memory: " + CFormat::intToString(_flashSize) + " bytes");
 
 		// read flash page size
 		_flashPageSize = propetries.get<int>("device.flashPageSize");
 		if (_flashPageSize <= 0) {
 			throw DeviceException("Invalid flash page size in device description file.");
 		}
-		COut::d("\tSize of flash page: " + CFormat::intToString(_flashPageSize) + " bytes");
 
 		// read eeprom size
 		_eepromSize = propetries.get<int>("device.eepromSize");
 		if (_eepromSize <= 0) {
 			throw DeviceException("Invalid eeprom size in device description file.");
 		}
-		COut::d("\tSize of eeprom memory: " + CFormat::intToString(_eepromSize) + " bytes");
 
 		// read number of fuse bytes
 		_fusesSize = propetries.get<int>("device.numOfFuses");
 		if (_fusesSize <= 0 || _fusesSize > 3) {
 			throw DeviceException("Invalid number of fuses in device description file.");
 		}
-		COut::d("\tNumber of fuse bytes: " + CFormat::intToString(_fusesSize));
 
 		// read device signature
 		deviceSignature = propetries.get<string>("device.signature");
@@ -283,40 +222,37 @@ void CAVRDevice::openDevicefile(string deviceFile) {
 		if (_deviceSignature <= 0) {
 			throw DeviceException("Invalid device signature in device description file.");
 		}
-		COut::d("\tDevice signature: 0x" + CFormat::intToHexString(_deviceSignature));
 
 		// read socket
 		socket = propetries.get("device.socket", "auto");
-		if (socket.compare("TQFP64") == 0) {
-			_socket = 2;
-		}
-		else if (socket.compare("TQFP100") == 0) {
-			_socket = 1;
-		}
-		else if (socket.compare("DIP40B") == 0) {
-			_socket = 4;
-		}
-		else {
-			int s;
-
-			s = CFormat::stringToInt(socket);
-
-			if (s > 0 && s < 0xff) {	// valid byte value ?
-				_socket = s;
-			}
-			else {
-				_socket = AUTO_DETECT;
-			}
-		}
-
-		COut::d("\tSocket: " + socket);
-		COut::d("");
+		_socket = parseSocket(socket);
 	}
 	catch (std::exception &e) {
 		throw DeviceException("Error while reading device file.\n" + (string)e.what());
 	}
 }
 
+int CAVRDevice::parseSocket(string socket) {
+	int s;
+
+	if (socket.compare("TQFP64") == 0) {
+		return 2;
+	}
+	else if (socket.compare("TQFP100") == 0) {
+		return 1;
+	}
+	else if (socket.compare("DIP40B") == 0) {
+		return 4;
+	}
+
+	s = CFormat::stringToInt(socket);
+
+	if (s > 0 && s < 0xff) {	// valid byte value ?
+		return s;
+	}
+	return AUTO_DETECT;
+}
+
 CAVRDevice::~CAVRDevice() {
 
 }
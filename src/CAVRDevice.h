@@ -25,6 +25,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "avrprog.h"
 #include "ExceptionBase.h"
 
+class CDeviceIndex;
+
 using namespace std;
 
 /**
@@ -58,7 +60,7 @@ public:
 	CAVRDevice(string deviceFile);
 
 	/**
-	 * @param	deviceSignature	signature of a device in the CONFIG_DIR.
+	 * @param	deviceSignature	signature of a device in the CONFIG_DIR or HOME_CONFIG_DIR, it is looked up in a CDeviceIndex.
 	 * @throw	DeviceNotFoundException if the specified device description file does not exists.
 	 */
 	CAVRDevice(uint32_t deviceSignature);
@@ -106,10 +108,29 @@ public:
 	int socket();
 
 	/**
-	 * @brief	Displays a list of all device description files in the CONFIG_DIR directory.
+	 * @brief	Displays a list of all device description files in the CONFIG_DIR and HOME_CONFIG_DIR directories (see CDeviceIndex).
 	 */
 	static void listDevices();
 
+	/**
+	 * @brief	Read the device signature of a device description file, the whole file is checked.
+	 *
+	 * @param	path	Path to a *.xml file.
+	 * @return	Device signature.
+	 * @throw	DeviceException if the file is not a valid device description.
+	 */
+	static uint32_t readSignature(string path);
+
+	/**
+	 * @brief	Converts a socket name to the socket number of the programmer.
+	 *
+	 * Allowed names are TQFP64, TQFP100, DIP40B or any integer number.
+	 *
+	 * @param	socket	Name or number of a socket.
+	 * @return	Socket number, or AUTO_DETECT if \a socket is unknown.
+	 */
+	static int parseSocket(string socket);
+
 protected:
 	int _flashSize;
 	int _flashPageSize;
@@ -125,8 +146,10 @@ protected:
 	static string getHomeDir();
 
 private:
+	CAVRDevice();
 	void openDevicefile(string deviceFile);
-	bool hasDeviceSignature(uint32_t deviceSignature, string deviceFile);
+	void readDevicefile(string deviceFilePath);
+	static CDeviceIndex &index();
 };
 
 /**
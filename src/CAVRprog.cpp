@@ -18,38 +18,49 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "CAVRprog.h"
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include "CFormat.h"
+#include "CMemoryKernels.h"
 #include "COut.h"
 
 using namespace std;
 
 const int frequencies[] = {128000, 1000000, 4000000, 8000000, 16000000};	///< frequencies for speed autodetection
 
-CAVRprog::CAVRprog(string device) : CAvrProgCommands(device), device(NULL) {
+CAVRprog::CAVRprog(string device, libusb_context *context) : CAvrProgCommands(device, context), device(NULL), frequency(FREQUENCY_AUTODETECT) {
 
 }
 
-void CAVRprog::connect(string deviceFile, int frequency) {
+void CAVRprog::connect(string deviceFile, int frequency, int socket) {
 	uint32_t deviceSignature;
 
+	if (device != NULL) {						// connected to another target before
+		delete device;
+		device = NULL;
+	}
+
 	if (frequency < 0) {						// autodetect programming frequency
 		setProgrammingSpeed(frequencies[0]);	// set low frequency and increase it later
 	}
 	else {
 		setProgrammingSpeed(frequency);
 	}
+	this->frequency = frequency;
 
 	if (deviceFile.size() == 0) {				// autodetect device
-		CAvrProgCommands::connect(AUTO_DETECT);
+		CAvrProgCommands::connect(socket);
 		cout << "Autodetect target device..." << endl;
 		uint32_t signature = getDeviceSignature();
 		device = new CAVRDevice(signature);
 	}
 	else {
 		device = new CAVRDevice(deviceFile);
-		CAvrProgCommands::connect(device->socket());
+		if (socket == AUTO_DETECT) {
+			socket = device->socket();
+		}
+		CAvrProgCommands::connect(socket);
 	}
 
 	deviceSignature = getDeviceSignature();
@@ -98,23 +109,63 @@ void CAVRprog::connect(string deviceFile, int frequency) {
 		}
 
 		cout << "Set frequency for " << (double)(frequencies[f-1]/1000000.0) << "MHz." << endl;
+		this->frequency = frequencies[f-1];
 	}
 }
 
-void CAVRprog::writeFlash(uint8_t *buffer, int size) {
-	if (size > device->flashSize()) {
+void CAVRprog::connect(string deviceFile, int frequency, int socket, int knownFrequency) {
+	if (frequency == FREQUENCY_AUTODETECT && knownFrequency != FREQUENCY_AUTODETECT) {
+		try {
+			connect(deviceFile, knownFrequency, socket);
+			return;
+		}
+		catch (USBCommunicationException &e) {
+			throw;
+		}
+		catch (ExceptionBase &e) {
+			COut::d("Known frequency does not work: " + e.what());
+		}
+	}
+
+	connect(deviceFile, frequency, socket);
+}
+
+int CAVRprog::findTarget(int socket) {
+	setProgrammingSpeed(frequencies[0]);
+	return probe(socket);
+}
+
+CAVRDevice *CAVRprog::getDevice() {
+	return device;
+}
+
+int CAVRprog::getFrequency() {
+	return frequency;
+}
+
+void CAVRprog::writeFlash(CMemoryImage *image) {
+	if ((int)image->size() > device->flashSize()) {
 		throw ProgrammerException("Not enough flash memory.");
 	}
 
-	CAvrProgCommands::writeFlash(buffer, size, device->flashPageSize());
+	CAvrProgCommands::writeFlash(image, device->flashPageSize());
 }
 
-void CAVRprog::writeEEPROM(uint8_t *buffer, int size) {
-	if (size > device->eepromSize()) {
+void CAVRprog::writeFlash(CChunkStream *stream) {
+	CAvrProgCommands::writeFlash(stream, device->flashPageSize(), device->flashSize());
+}
+
+void CAVRprog::writeFlash(CFlashBundle *bundle) {
+	checkBundle(bundle);
+	CAvrProgCommands::writeFlash(bundle, device->flashPageSize());
+}
+
+void CAVRprog::writeEEPROM(CMemoryImage *image) {
+	if ((int)image->size() > device->eepromSize()) {
 		throw ProgrammerException("Not enough eeprom memory.");
 	}
 
-	CAvrProgCommands::writeEEPROM(buffer, size);
+	CAvrProgCommands::writeEEPROM(image);
 }
 
 void CAVRprog::writeFuses(uint8_t lfuse, uint8_t hfuse, uint8_t efuse, int numOfFuses) {
@@ -125,32 +176,12 @@ void CAVRprog::writeFuses(uint8_t lfuse, uint8_t hfuse, uint8_t efuse, int numOf
 	CAvrProgCommands::writeFuses(lfuse, hfuse, efuse, numOfFuses);
 }
 
-int CAVRprog::readFlash(uint8_t **buffer) {
-	int lastData = -1;
-	*buffer = CAvrProgCommands::readFlash(device->flashSize());
-
-	// cut off empty flash memory
-	for (int i=0; i<device->flashSize(); i++) {
-		if ((*buffer)[i] != EMPTY_FLASH_BYTE) {
-			lastData = i;
-		}
-	}
-
-	return lastData + 1;
+void CAVRprog::readFlash(CMemorySink *sink) {
+	CAvrProgCommands::readFlash(device->flashSize(), sink);
 }
 
-int CAVRprog::readEEPROM(uint8_t **buffer) {
-	int lastData = -1;
-	*buffer = CAvrProgCommands::readEEPROM(device->eepromSize());
-
-	// cut off empty eeprom memory
-	for (int i=0; i<device->eepromSize(); i++) {
-		if ((*buffer)[i] != EMPTY_EEPROM_BYTE) {
-			lastData = i;
-		}
-	}
-
-	return lastData + 1;
+void CAVRprog::readEEPROM(CMemorySink *sink) {
+	CAvrProgCommands::readEEPROM(device->eepromSize(), sink);
 }
 
 int CAVRprog::readFuses(uint8_t **buffer) {
@@ -166,14 +197,13 @@ bool CAVRprog::verifyFlash(uint8_t *buffer, int size) {
 		return false;
 	}
 
-	uint8_t flashFile[device->flashSize()];
 	uint8_t *flashContent = CAvrProgCommands::readFlash(device->flashSize());
 
-	// extend buffer to flash size
-	memcpy(flashFile, buffer, size);
-	memset(flashFile+size, EMPTY_FLASH_BYTE, device->flashSize()-size);
-
-	if (memcmp(flashFile, flashContent, device->flashSize()) != 0) {
+	// the buffer is extended with EMPTY_FLASH_BYTE to flash size
+	if (CMemoryKernels::compare(buffer, flashContent, size) >= 0) {
+		equal = false;
+	}
+	else if (CMemoryKernels::isEmpty(flashContent+size, device->flashSize()-size, EMPTY_FLASH_BYTE) == false) {
 		equal = false;
 	}
 
@@ -191,7 +221,75 @@ bool CAVRprog::fastVerifyFlash(uint8_t *buffer, int size) {
 
 	uint8_t *flashContent = CAvrProgCommands::readFlash(size);
 
-	if (memcmp(buffer, flashContent, size) != 0) {
+	if (CMemoryKernels::compare(buffer, flashContent, size) >= 0) {
+		equal = false;
+	}
+
+	delete[] flashContent;
+
+	return equal;
+}
+
+bool CAVRprog::fastVerifyFlash(CChunkStream *stream) {
+	const vector<uint64_t> &hashes = stream->getHashes();
+	int chunkSize = CChunkRing::CHUNK_SIZE;
+	bool equal = true;
+
+	uint8_t *flashContent = CAvrProgCommands::readFlash(hashes.size() * chunkSize);
+
+	for (unsigned int i=0; i<hashes.size(); i++) {
+		if (CJournal::hash(flashContent + i * chunkSize, chunkSize) != hashes[i]) {
+			equal = false;
+			break;
+		}
+	}
+
+	delete[] flashContent;
+
+	return equal;
+}
+
+bool CAVRprog::verifyFlash(CFlashBundle *bundle) {
+	checkBundle(bundle);
+	return compareFlash(bundle, device->flashSize());
+}
+
+bool CAVRprog::fastVerifyFlash(CFlashBundle *bundle) {
+	checkBundle(bundle);
+	return compareFlash(bundle, bundle->size());
+}
+
+/*
+ * a bundle can only be used for the target it was prepared for
+ */
+void CAVRprog::checkBundle(CFlashBundle *bundle) {
+	if (bundle->signature() != device->deviceSignature()) {
+		throw ProgrammerException("The bundle was prepared for '" + bundle->mcu() + "' (0x" + CFormat::intToHexString(bundle->signature()) +
+				") but the target is '" + device->name() + "' (0x" + CFormat::intToHexString(device->deviceSignature()) + ").");
+	}
+	if (bundle->size() > device->flashSize()) {
+		throw ProgrammerException("Not enough flash memory.");
+	}
+}
+
+/*
+ * read 'size' bytes of flash memory and compare them chunk by chunk with the bundle,
+ * memory behind the bundle has to be empty
+ */
+bool CAVRprog::compareFlash(CFlashBundle *bundle, int size) {
+	int chunkSize = CFlashBundle::CHUNK_SIZE;
+	bool equal = true;
+
+	uint8_t *flashContent = CAvrProgCommands::readFlash(size);
+
+	for (int chunk=0; chunk<bundle->numOfChunks() && equal; chunk++) {
+		int len = min(chunkSize, bundle->size() - chunk * chunkSize);
+
+		if (CMemoryKernels::compare(bundle->content(chunk), flashContent + chunk * chunkSize, len) >= 0) {
+			equal = false;
+		}
+	}
+	if (equal && CMemoryKernels::isEmpty(flashContent + bundle->size(), size - bundle->size(), EMPTY_FLASH_BYTE) == false) {
 		equal = false;
 	}
 
@@ -207,14 +305,13 @@ bool CAVRprog::verifyEEPROM(uint8_t *buffer, int size) {
 		return false;
 	}
 
-	uint8_t eepromFile[device->eepromSize()];
 	uint8_t *eepromContent = CAvrProgCommands::readEEPROM(device->eepromSize());
 
-	// extend buffer to flash size
-	memcpy(eepromFile, buffer, size);
-	memset(eepromFile+size, EMPTY_FLASH_BYTE, device->eepromSize()-size);
-
-	if (memcmp(eepromFile, eepromContent, device->eepromSize()) != 0) {
+	// the buffer is extended with EMPTY_EEPROM_BYTE to eeprom size
+	if (CMemoryKernels::compare(buffer, eepromContent, size) >= 0) {
+		equal = false;
+	}
+	else if (CMemoryKernels::isEmpty(eepromContent+size, device->eepromSize()-size, EMPTY_EEPROM_BYTE) == false) {
 		equal = false;
 	}
 
@@ -232,7 +329,7 @@ bool CAVRprog::fastVerifyEEPROM(uint8_t *buffer, int size) {
 
 	uint8_t *eepromContent = CAvrProgCommands::readEEPROM(size);
 
-	if (memcmp(buffer, eepromContent, size) != 0) {
+	if (CMemoryKernels::compare(buffer, eepromContent, size) >= 0) {
 		equal = false;
 	}
 
@@ -43,8 +43,9 @@ class CAVRprog : public CAvrProgCommands {
 public:
 	/**
 	 * @param	device		see CUSBCommunication::CUSBCommunication
+	 * @param	context		see CUSBCommunication::CUSBCommunication
 	 */
-	CAVRprog(string device);
+	CAVRprog(string device, libusb_context *context = NULL);
 	virtual ~CAVRprog();
 
 	/**
@@ -52,24 +53,71 @@ public:
 	*
 	* Must be called before any operations on the target can be performed.
 	*
+	* Can be called again to connect to another target, e.g. in another socket.
+	*
 	* @param	deviceFile	name of the target mcu
 	* @param	frequency	device frequency in Hz
+	* @param	socket		programming pins, AUTO_DETECT to use the socket of the device description file
 	*/
-	void connect(string deviceFile, int frequency);
+	void connect(string deviceFile, int frequency, int socket);
+
+	/**
+	 * @brief	Connect to target mcu, try a known frequency first.
+	 *
+	 * Like connect(), but if \a frequency is FREQUENCY_AUTODETECT, \a knownFrequency (e.g. the frequency which was
+	 * detected for a target of the same kind before) is tried first. The frequency is only detected if the target
+	 * does not work with it.
+	 *
+	 * @param	deviceFile		name of the target mcu
+	 * @param	frequency		device frequency in Hz
+	 * @param	socket			programming pins, AUTO_DETECT to use the socket of the device description file
+	 * @param	knownFrequency	frequency to try first, FREQUENCY_AUTODETECT if unknown
+	 */
+	void connect(string deviceFile, int frequency, int socket, int knownFrequency);
+
+	/**
+	 * @brief	Look for a target without connecting to it.
+	 *
+	 * The lowest programming frequency is used, hence targets with any clock are found.
+	 *
+	 * @param	socket		Socket of the target, AUTO_DETECT to try all sockets.
+	 * @return	Socket of the found target, -1 if no target is present.
+	 */
+	int findTarget(int socket);
+
+	/**
+	 * @return	Description of the connected target device, NULL if connect() was not called yet.
+	 */
+	CAVRDevice *getDevice();
+
+	/**
+	 * @return	Programming frequency set by the last connect(), either the given or the detected one.
+	 */
+	int getFrequency();
 
 	/**
 	 * @brief	Writes to flash memory.
-	 * @param	buffer	A buffer array.
-	 * @param	size	Length of the buffer array.
+	 * @param	image	Content to write.
+	 */
+	void writeFlash(CMemoryImage *image);
+
+	/**
+	 * @brief	Writes to flash memory while the input file is parsed.
+	 * @param	stream	Started stream of the content to write, its limit must be the flash size.
+	 */
+	void writeFlash(CChunkStream *stream);
+
+	/**
+	 * @brief	Writes a prepared bundle to flash memory.
+	 * @param	bundle	Content to write, it must be prepared for the connected target.
 	 */
-	void writeFlash(uint8_t *buffer, int size);
+	void writeFlash(CFlashBundle *bundle);
 
 	/**
 	 * @brief	Writes to eeprom memory.
-	 * @param	buffer	A buffer array.
-	 * @param	size	Length of the buffer array.
+	 * @param	image	Content to write.
 	 */
-	void writeEEPROM(uint8_t *buffer, int size);
+	void writeEEPROM(CMemoryImage *image);
 
 	/**
 	 * @brief	Writes fuses, for controllers with 3 fuse bytes.
@@ -81,28 +129,21 @@ public:
 	void writeFuses(uint8_t lfuse, uint8_t hfuse, uint8_t efuse, int numOfFuses);
 
 	/**
-	 * @brief	Reads the content of flash memory.
+	 * @brief	Reads the content of the whole flash memory.
 	 *
-	 * This method allocates enough memory to store the read content and sets buffer to the first element.
-	 * The caller is responsible for freeing (\c delete[]) the buffer memory.
+	 * Each chunk is passed to \a sink as soon as it is read, no buffer for the whole memory is
+	 * allocated. Empty bytes at the end are cut off by CReadoutStream.
 	 *
-	 * @param	buffer	Pointer to a buffer array.
-	 * @return	Number of bytes read.
-	 * @return	Filled buffer.
+	 * @param	sink	Receives the read content in the order of the memory.
 	 */
-	int readFlash(uint8_t **buffer);
+	void readFlash(CMemorySink *sink);
 
 	/**
-	 * @brief	Reads the content of eeprom memory.
-	 *
-	 * This method allocates enough memory to store the read content and sets buffer to the first element.
-	 * The caller is responsible for freeing (\c delete[]) the buffer memory.
+	 * @brief	Reads the content of the whole eeprom memory.
 	 *
-	 * @param	buffer	Pointer to a buffer array.
-	 * @return	Number of bytes read.
-	 * @return	Filled buffer.
+	 * @param	sink	Receives the read content in the order of the memory.
 	 */
-	int readEEPROM(uint8_t **buffer);
+	void readEEPROM(CMemorySink *sink);
 
 	/**
 	 * @brief	Reads the content of flash memory.
@@ -147,6 +188,38 @@ public:
 	 */
 	bool fastVerifyFlash(uint8_t *buffer, int size);
 
+	/**
+	 * @brief	Verifies the content of flash memory against a completed stream.
+	 *
+	 * Reads the streamed area of flash memory and compares the hash of each chunk with
+	 * the hashes recorded by the stream.
+	 *
+	 * @param	stream	Stream, which was written with writeFlash().
+	 * @return	true if the hashes are equal.
+	 * @return	false otherwise.
+	 */
+	bool fastVerifyFlash(CChunkStream *stream);
+
+	/**
+	 * @brief	Verifies the content of the whole flash memory against a bundle.
+	 *
+	 * Chunks with content are compared with the bundle, all other chunks have to be empty.
+	 *
+	 * @param	bundle	Bundle for the connected target.
+	 * @return	true if bundle and flash are equal.
+	 * @return	false otherwise.
+	 */
+	bool verifyFlash(CFlashBundle *bundle);
+
+	/**
+	 * @brief	Verifies the content of flash memory against a bundle, only the area of the bundle is read.
+	 *
+	 * @param	bundle	Bundle for the connected target.
+	 * @return	true if bundle and flash are equal.
+	 * @return	false otherwise.
+	 */
+	bool fastVerifyFlash(CFlashBundle *bundle);
+
 	/**
 	 * @brief	Verifies the content of eeprom memory against the given buffer.
 	 *
@@ -191,6 +264,11 @@ public:
 
 protected:
 	CAVRDevice *device;		///< target device description
+	int frequency;			///< programming frequency of the connected target
+
+private:
+	void checkBundle(CFlashBundle *bundle);
+	bool compareFlash(CFlashBundle *bundle, int size);
 };
 
 /**
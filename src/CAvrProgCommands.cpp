@@ -21,6 +21,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <iostream>
 #include "CFormat.h"
+#include "CIspCommand.h"
+#include "CMemoryKernels.h"
 #include <cstring>
 #include <cmath>
 #include "avrprog.h"
@@ -59,7 +61,35 @@ using namespace std;
  * - A chunk contains on or more pages and is a unit which is sent to the programming hardware in one usb transfer
  */
 
-CAvrProgCommands::CAvrProgCommands(string device) : CUSBCommunication(device), continuedWrite(false) {
+/*
+ * ISP instructions executed with executeCommands()
+ *
+ * The setup command describes the number of bytes sent and read per instruction and a delay,
+ * see CIspCommand for details.
+ */
+// chip erase
+typedef CIspCommand<4, 0, 0,	0xac, 0x80, 0x00, 0x00> ChipErase;
+// write low, high and extended fuse byte, the values (zero here) are set at runtime
+typedef CIspCommand<4, 0, 9,	0xac, 0xa0, 0x00, 0x00,
+								0xac, 0xa8, 0x00, 0x00,
+								0xac, 0xa4, 0x00, 0x00> WriteFuses;
+// read lock bits, low, high and extended fuse byte
+typedef CIspCommand<3, 1, 0,	0x58, 0x00, 0x00,
+								0x50, 0x00, 0x00,
+								0x58, 0x08, 0x00,
+								0x50, 0x08, 0x00> ReadFuses;
+// read the three signature bytes
+typedef CIspCommand<3, 1, 0,	0x30, 0x00, 0x00,
+								0x30, 0x00, 0x01,
+								0x30, 0x00, 0x02> ReadSignature;
+// programming enable, the target echoes 0x53 if present
+typedef CIspCommand<2, 2, 0,	0xac, 0x53> DetectDevice;
+
+CAvrProgCommands::CAvrProgCommands(string device, libusb_context *context) : CUSBCommunication(device, context), continuedWrite(false), journal(NULL), socket(AUTO_DETECT),
+		targetFrequency(1000000.0 * pow(0xff / 97.83, -1 / 1.52)) {
+	memset(commandData, 0x00, sizeof(commandData));
+	setTimeoutFloor(TIMEOUT_EEPROM, targetTime(EEPROM_WRITE_CHUNK_SIZE, EEPROM_WRITE_CHUNK_SIZE, TARGET_EEPROM_WRITE_US));
+
 	uint8_t *buffer;
 	uint8_t len;
 
@@ -91,109 +121,224 @@ void CAvrProgCommands::connect(int socket) {
 	}
 
 	selectSocket(socket);
+	this->socket = socket;
+	this->continuedWrite = false;	// a new target never continues the write of the previous one
 	programmer(ACTIVATE);
 	detectDevice(false);			// in the original programmer checkDevice is called in front of each action
 	// further it performs a chip erase and writes default fuses before any other action
 	// this all is omitted here
 }
 
+void CAvrProgCommands::disconnect() {
+	programmer(DEACTIVATE);
+}
+
+int CAvrProgCommands::probe(int socket) {
+	if (socket != AUTO_DETECT) {
+		return trySocket(socket) ? socket : -1;
+	}
+
+	for (uint8_t s=0; s<AUTO_DETECT; s++) {
+		if (trySocket(s) == true) {
+			return s;
+		}
+	}
+	return -1;
+}
+
+int CAvrProgCommands::getSocket() {
+	return socket;
+}
+
 void CAvrProgCommands::chipErase() {
 	// the commented functions are sent by the original programmer
 	delayMs(0x14);
 
 	//detectDevice(false);
 
-	uint8_t command[] = {0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00};
-	uint8_t data[] = {	0xac, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-	executeCommands(command, 4, data);
+	executeCommand<ChipErase>(4, TIMEOUT_ERASE);	// the original programmer announces 4 instructions, although only one is sent
 
 	delayMs(0x14);
 }
 
 /*
- * This method partitions the passed buffer into chunks and fills the last chunk
- * with EMPTY_FLASH_BYTES.
- * Then each chunk is transferred with writeFlashChunk()
+ * This method transfers each chunk of the image, which contains content, with writeFlashChunk().
+ * Bytes of a chunk which are not part of the image are filled with EMPTY_FLASH_BYTE.
  * A progressbar informs the user about the progress of this operation
+ *
+ * With a journal, all chunks before journal->nextChunk() are skipped. Since chunk 512
+ * switches the programmer to extended addressing, this is done explicitly when the
+ * write resumes behind chunk 512.
  */
-void CAvrProgCommands::writeFlash(uint8_t *buffer, int size, int pageSize) {
+void CAvrProgCommands::writeFlash(CMemoryImage *image, int pageSize) {
 	// the commented functions are sent by the original programmer
 	delayMs(0x14);
 
 	//detectDevice(false);
 
-	uint8_t lastChunk[FLASH_WRITE_CHUNK_SIZE];
-	int sizeOfLastChunk;		// size of the last chunk without empty (0xff) bytes
+	// a resumed write starts a new write sequence, even if the journal ends directly in front of it
+	this->continuedWrite = false;
+
+	uint8_t chunkBuffer[FLASH_WRITE_CHUNK_SIZE];
+	int chunk;
+	int numOfChunks;
+	int numOfWrites = 0;		// number of chunks to transfer
+	int firstChunk;
+	int previous;
+
+	numOfChunks = (image->size() + FLASH_WRITE_CHUNK_SIZE - 1) / FLASH_WRITE_CHUNK_SIZE;
+	firstChunk = resumeFlashWrite(numOfChunks);
+
+	for (chunk=nextFlashChunk(image, firstChunk, numOfChunks); chunk>=0; chunk=nextFlashChunk(image, chunk+1, numOfChunks)) {
+		numOfWrites++;
+	}
+
+	CProgressbar progressbar(numOfWrites);
+
+	previous = firstChunk - 1;
+	for (chunk=nextFlashChunk(image, firstChunk, numOfChunks); chunk>=0; chunk=nextFlashChunk(image, chunk+1, numOfChunks)) {
+		// the programmer continues a write only with the directly following chunk
+		if (chunk != previous + 1) {
+			this->continuedWrite = false;
+		}
+		previous = chunk;
+
+		image->readChunk(chunk, FLASH_WRITE_CHUNK_SIZE, EMPTY_FLASH_BYTE, chunkBuffer);
+		writeFlashChunk(chunkBuffer, chunk, pageSize);
+		if (journal != NULL) {
+			journal->acknowledge(chunk);
+		}
+		progressbar.step();
+	}
+
+	delayMs(0x14);
+
+	if (journal != NULL) {
+		journal->complete();
+	}
+}
+
+/*
+ * The same procedure as writing an image, but nothing is computed per chunk.
+ */
+void CAvrProgCommands::writeFlash(CFlashBundle *bundle, int pageSize) {
+	static_assert(CFlashBundle::CHUNK_SIZE == FLASH_WRITE_CHUNK_SIZE, "bundle chunks must match flash write chunks");
+
+	delayMs(0x14);
+
+	this->continuedWrite = false;
+
 	int chunk;
-	int numOfChunks;			// without the last chunk
+	int numOfWrites = 0;
+	int firstChunk = resumeFlashWrite(bundle->numOfChunks());
+	int previous;
 
-	numOfChunks = size / FLASH_WRITE_CHUNK_SIZE;
-	sizeOfLastChunk = size - FLASH_WRITE_CHUNK_SIZE * numOfChunks;
+	for (chunk=nextFlashChunk(bundle, firstChunk); chunk>=0; chunk=nextFlashChunk(bundle, chunk+1)) {
+		numOfWrites++;
+	}
 
-	// copy the last chunk and fill it up with 0xff
-	memcpy(lastChunk, buffer+FLASH_WRITE_CHUNK_SIZE*numOfChunks, sizeOfLastChunk);
-	memset(lastChunk+sizeOfLastChunk, EMPTY_FLASH_BYTE, FLASH_WRITE_CHUNK_SIZE-sizeOfLastChunk);
+	CProgressbar progressbar(numOfWrites);
 
-	CProgressbar progressbar(numOfChunks+1);
+	previous = firstChunk - 1;
+	for (chunk=nextFlashChunk(bundle, firstChunk); chunk>=0; chunk=nextFlashChunk(bundle, chunk+1)) {
+		// the programmer continues a write only with the directly following chunk
+		if (chunk != previous + 1) {
+			this->continuedWrite = false;
+		}
+		previous = chunk;
 
-	for (chunk=0; chunk<numOfChunks; chunk++) {
-		writeFlashChunk(&(buffer[chunk*FLASH_WRITE_CHUNK_SIZE]), chunk, pageSize);
+		writeFlashChunk((uint8_t*)bundle->content(chunk), chunk, pageSize, bundle->isEmpty(chunk), bundle->checksum(chunk));
+		if (journal != NULL) {
+			journal->acknowledge(chunk);
+		}
 		progressbar.step();
 	}
-	writeFlashChunk(lastChunk, chunk, pageSize);
-	progressbar.step();
+
+	delayMs(0x14);
+
+	if (journal != NULL) {
+		journal->complete();
+	}
+}
+
+/*
+ * The chunks arrive in ascending order. Chunk 512 is written in any case before a chunk behind it
+ * (see nextFlashChunk()). Since the number of chunks is unknown in advance, the progressbar shows
+ * the position in flash memory.
+ */
+void CAvrProgCommands::writeFlash(CChunkStream *stream, int pageSize, int flashSize) {
+	static_assert(CChunkRing::CHUNK_SIZE == FLASH_WRITE_CHUNK_SIZE, "stream chunks must match flash write chunks");
+
+	CChunkRing::slot_t *slot;
+	int numOfChunks = (flashSize + FLASH_WRITE_CHUNK_SIZE - 1) / FLASH_WRITE_CHUNK_SIZE;
+	int previous = -1;
+
+	this->continuedWrite = false;
+
+	delayMs(0x14);
+
+	CProgressbar progressbar(numOfChunks);
+
+	while ((slot = stream->next()) != NULL) {
+		int chunk = slot->chunk;
+
+		if (chunk > 512 && previous < 512) {
+			uint8_t empty[FLASH_WRITE_CHUNK_SIZE];
+
+			memset(empty, EMPTY_FLASH_BYTE, sizeof(empty));
+			if (previous != 511) {
+				this->continuedWrite = false;
+			}
+			writeFlashChunk(empty, 512, pageSize);
+			previous = 512;
+		}
+
+		// the programmer continues a write only with the directly following chunk
+		if (chunk != previous + 1) {
+			this->continuedWrite = false;
+		}
+		previous = chunk;
+
+		writeFlashChunk(slot->data, chunk, pageSize, slot->empty, slot->checksum);
+		stream->release();
+		progressbar.update(chunk + 1);
+	}
+	progressbar.update(numOfChunks);
 
 	delayMs(0x14);
 }
 
+void CAvrProgCommands::setJournal(CJournal *journal) {
+	this->journal = journal;
+}
+
 /*
- * This method partitions the passed buffer into chunks (EEPROM_WRITE_CHUNK_SIZE bytes long) and fills the last chunk
- * with EMPTY_EEPROM_BYTES.
- * Then each chunk is transferred with writeEEPROMChunk()
+ * This method transfers each chunk (EEPROM_WRITE_CHUNK_SIZE bytes long) of the image, which contains
+ * content, with writeEEPROMChunk(). Bytes of a chunk which are not part of the image are filled with
+ * EMPTY_EEPROM_BYTE.
  * A progressbar informs the user about the progress of this operation
  */
-void CAvrProgCommands::writeEEPROM(uint8_t *buffer, int size) {
+void CAvrProgCommands::writeEEPROM(CMemoryImage *image) {
 	// the commented functions are sent by the original programmer
 	delayMs(0x14);
 
 	//detectDevice(false);
 
-	uint8_t lastChunk[EEPROM_WRITE_CHUNK_SIZE];
-	int sizeOfLastChunk;			// size of the last chunk without empty (0xff) bytes
+	uint8_t chunkBuffer[EEPROM_WRITE_CHUNK_SIZE];
 	int chunk;
-	int numOfChunks;				// without the last chunk
-
-	numOfChunks = size / EEPROM_WRITE_CHUNK_SIZE;
-	sizeOfLastChunk = size - EEPROM_WRITE_CHUNK_SIZE * numOfChunks;
+	int numOfWrites = 0;
 
-	// copy the last chunk and fill it up with 0xff
-	memcpy(lastChunk, buffer+EEPROM_WRITE_CHUNK_SIZE*numOfChunks, sizeOfLastChunk);
-	memset(lastChunk+sizeOfLastChunk, EMPTY_EEPROM_BYTE, EEPROM_WRITE_CHUNK_SIZE-sizeOfLastChunk);
+	for (chunk=image->nextChunk(0, EEPROM_WRITE_CHUNK_SIZE); chunk>=0; chunk=image->nextChunk(chunk+1, EEPROM_WRITE_CHUNK_SIZE)) {
+		numOfWrites++;
+	}
 
-	CProgressbar progressbar(numOfChunks+1);
+	CProgressbar progressbar(numOfWrites);
 
-	for (chunk=0; chunk<numOfChunks; chunk++) {
-		writeEEPROMChunk(&(buffer[chunk*EEPROM_WRITE_CHUNK_SIZE]), chunk*EEPROM_WRITE_CHUNK_SIZE);
+	for (chunk=image->nextChunk(0, EEPROM_WRITE_CHUNK_SIZE); chunk>=0; chunk=image->nextChunk(chunk+1, EEPROM_WRITE_CHUNK_SIZE)) {
+		image->readChunk(chunk, EEPROM_WRITE_CHUNK_SIZE, EMPTY_EEPROM_BYTE, chunkBuffer);
+		writeEEPROMChunk(chunkBuffer, chunk*EEPROM_WRITE_CHUNK_SIZE);
 		progressbar.step();
 	}
-	writeEEPROMChunk(lastChunk, chunk*EEPROM_WRITE_CHUNK_SIZE);
-	progressbar.step();
 
 	delayMs(0x14);
 }
@@ -202,31 +347,15 @@ void CAvrProgCommands::writeFuses(uint8_t lfuse, uint8_t hfuse, uint8_t efuse, i
 	// original AVRprog does an erase before writing fuses
 	// furthermore it writes default fuses, before programming the new ones
 
-	uint8_t command[] = {0x02, 0x04, 0x00, 0x00, 0x00, 0x09, 0x00};
-	uint8_t data[] = {	0xac, 0xa0, 0x00, 0xe1, 0xac, 0xa8, 0x00, 0x99, 0xac, 0xa4, 0x00, 0xfd, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-	data[3] = lfuse;
-	data[7] = hfuse;
-	data[11] = efuse;
-
 	COut::dd("Set " + CFormat::intToString(numOfFuses) + " fuses");
 
-	executeCommands(command, numOfFuses, data);
+	// the fuse values are the only bytes which differ between two calls
+	memcpy(commandData, WriteFuses::data, WriteFuses::SIZE);
+	commandData[3] = lfuse;
+	commandData[7] = hfuse;
+	commandData[11] = efuse;
+
+	executeCommands(WriteFuses::setup, numOfFuses, WriteFuses::SIZE, WriteFuses::CHECKSUM + lfuse + hfuse + efuse, TIMEOUT_ERASE);
 }
 
 uint8_t *CAvrProgCommands::readFlash(int size) {
@@ -249,6 +378,16 @@ uint8_t *CAvrProgCommands::readEEPROM(int size) {
 	//delayMs(0x14);
 }
 
+void CAvrProgCommands::readFlash(int size, CMemorySink *sink) {
+	delayMs(0x14);
+	readMemory(size, FLASH, sink);
+}
+
+void CAvrProgCommands::readEEPROM(int size, CMemorySink *sink) {
+	delayMs(0x14);
+	readMemory(size, EEPROM, sink);
+}
+
 /*
  * Reads 'size' fuse bytes.
  *
@@ -264,25 +403,7 @@ uint8_t *CAvrProgCommands::readFuses(int size) {
 	uint8_t *buffer = NULL;
 	uint8_t *fuses;
 
-	uint8_t command[] = {0x02, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00};
-	uint8_t data[] = {	0x58, 0x00, 0x00, 0x50, 0x00, 0x00, 0x58, 0x08, 0x00, 0x50, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-	executeCommands(command, size + 1, data);
+	executeCommand<ReadFuses>(size + 1);
 
 	len = 256;
 	iso_read(3, &buffer, &len);
@@ -308,22 +429,58 @@ uint8_t *CAvrProgCommands::readFuses(int size) {
 // internal functions
 
 /*
- * helper function to check if a chunk in the buffer is empty
- * It is not necessary to transfer empty chunks. In some cases this speeds up the programming procedure.
+ * next chunk of a flash write
+ *
+ * This is the next chunk with content, except chunk 512: it switches the programmer to extended
+ * addressing (see writeFlashChunk()) and is therefore always written if the image reaches behind it.
+ * Returns -1 if no chunk is left.
  */
-bool CAvrProgCommands::isEmptyChunk(uint8_t *buffer, int size) {
-	bool empty;
-
-	// check if page is empty
-	empty = true;
-	for (int i=0; i<size; i++) {
-		if (buffer[i] != EMPTY_FLASH_BYTE) {
-			empty = false;
-			break;
+int CAvrProgCommands::nextFlashChunk(CMemoryImage *image, int chunk, int numOfChunks) {
+	int next = image->nextChunk(chunk, FLASH_WRITE_CHUNK_SIZE);
+
+	if (chunk <= 512 && numOfChunks > 512 && (next < 0 || next > 512)) {
+		return 512;
+	}
+	return next;
+}
+
+/*
+ * next chunk of a flash write from a bundle, see above
+ */
+int CAvrProgCommands::nextFlashChunk(CFlashBundle *bundle, int chunk) {
+	int next = bundle->nextChunk(chunk);
+
+	if (chunk <= 512 && bundle->numOfChunks() > 512 && (next < 0 || next > 512)) {
+		return 512;
+	}
+	return next;
+}
+
+/*
+ * first chunk of a flash write
+ *
+ * Without a journal this is chunk 0. Otherwise the write continues behind the last chunk, which is
+ * acknowledged in the journal, and the journal is started.
+ */
+int CAvrProgCommands::resumeFlashWrite(int numOfChunks) {
+	int firstChunk = 0;
+
+	if (journal != NULL) {
+		firstChunk = journal->nextChunk();
+		if (firstChunk > numOfChunks) {
+			firstChunk = numOfChunks;
 		}
+		if (firstChunk > 0) {
+			cout << "Resume at chunk " << firstChunk << " of " << numOfChunks << "." << endl;
+		}
+		journal->begin();
+	}
+
+	if (firstChunk > 512) {
+		setExtendedAddress();
 	}
 
-	return empty;
+	return firstChunk;
 }
 
 /*
@@ -336,18 +493,26 @@ bool CAvrProgCommands::isEmptyChunk(uint8_t *buffer, int size) {
  * - read the response
  */
 void CAvrProgCommands::writeFlashChunk(uint8_t *code, int chunk, int pageSize) {
-	uint8_t *buffer = NULL;
 	uint16_t checksum;
+	bool empty = CMemoryKernels::scan(code, FLASH_WRITE_CHUNK_SIZE, EMPTY_FLASH_BYTE, &checksum);
+
+	writeFlashChunk(code, chunk, pageSize, empty, checksum);
+}
+
+/*
+ * write a chunk, whose checksum and empty flag are already known (see CMemoryKernels::scan())
+ */
+void CAvrProgCommands::writeFlashChunk(uint8_t *code, int chunk, int pageSize, bool empty, uint16_t checksum) {
+	uint8_t *buffer = NULL;
 	uint8_t command[] = {0x07, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x05};
 	int len;
 
-	if (chunk != 512 && isEmptyChunk(code, FLASH_WRITE_CHUNK_SIZE) == true) {
+	// It is not necessary to transfer empty chunks. In some cases this speeds up the programming procedure.
+	if (empty == true && chunk != 512) {
 		this->continuedWrite = false;
 		return;
 	}
 
-	checksum = this->checksum(code, FLASH_WRITE_CHUNK_SIZE);
-
 	command[2] = (checksum>>8) & 0xff;	// assign checksum
 	command[1] = (checksum>>0) & 0xff;
 
@@ -373,7 +538,8 @@ void CAvrProgCommands::writeFlashChunk(uint8_t *code, int chunk, int pageSize) {
 
 	int_write(2, command, sizeof(command));
 	len = 1;
-	int_read(2, &buffer, &len);
+	setTimeoutFloor(TIMEOUT_PAGE_WRITE, targetTime(FLASH_WRITE_CHUNK_SIZE, (FLASH_WRITE_CHUNK_SIZE + pageSize - 1) / pageSize, TARGET_FLASH_WRITE_US));
+	int_read(2, &buffer, &len, TIMEOUT_PAGE_WRITE);	// waits until the pages are written
 
 	COut::dd("Write flash chunk " + CFormat::intToString(chunk) + " returned " + CFormat::hex(buffer, len));
 
@@ -417,6 +583,21 @@ uint8_t *CAvrProgCommands::readMemory(int size, memory_t mem) {
 	return buffer;
 }
 
+/*
+ * Like readMemory() above, but instead of collecting the chunks in a buffer each chunk is passed
+ * to 'sink' directly from the USB buffer.
+ */
+void CAvrProgCommands::readMemory(int size, memory_t mem, CMemorySink *sink) {
+	int numOfChunks = (size + USB_TRANSFER_SIZE - 1) / USB_TRANSFER_SIZE;
+
+	CProgressbar progressbar(numOfChunks);
+
+	for (int chunk = 0; chunk < numOfChunks; chunk++) {
+		sink->addData(chunk * USB_TRANSFER_SIZE, readMemoryChunk(chunk, mem), USB_TRANSFER_SIZE);
+		progressbar.step();
+	}
+}
+
 /*
  * search for a target mcu in socket
  */
@@ -503,6 +684,10 @@ void CAvrProgCommands::setProgrammingSpeed(int frequency) {
 	command[1] = frequency;
 	COut::d("Set programming speed to " + CFormat::intToString(frequency));
 
+	// device frequency which belongs to the value, for the worst case timing of the target
+	targetFrequency = 1000000.0 * pow(frequency / 97.83, -1 / 1.52);
+	setTimeoutFloor(TIMEOUT_EEPROM, targetTime(EEPROM_WRITE_CHUNK_SIZE, EEPROM_WRITE_CHUNK_SIZE, TARGET_EEPROM_WRITE_US));
+
 	int_write(2, command, sizeof(command));
 	len = 1;
 	int_read(2, &buffer, &len);
@@ -575,7 +760,7 @@ void CAvrProgCommands::delayMs(uint8_t ms) {
 
 	int_write(2, command, sizeof(command));
 	len = 1;
-	int_read(2, &buffer, &len);
+	int_read(2, &buffer, &len, TIMEOUT_TRANSFER);
 
 	COut::dd("Delay ms returned " + CFormat::hex(buffer, len));
 
@@ -595,33 +780,43 @@ void CAvrProgCommands::delayMs(uint8_t ms) {
  * on endpoint 2.
  * The command itself is sent as data to endpoint 3.
  *
+ * The instructions are expected in the first dataSize bytes of commandData, all other bytes
+ * of commandData are zero. After the transfer these bytes are cleared again, also if it fails.
+ *
  * @param	setupCommand	(begins always with 0x02) is a buffer of size SETUP_COMMAND_SIZE and contains information
  * 							of the following commands
  * @param	numOfCommands	number of commands in data
- * @param	data			is a buffer of lenth DATA_COMMAND_SIZE, which contains the commands
+ * @param	dataSize		number of instruction bytes in commandData
+ * @param	checksum		checksum of commandData (see CIspCommand::CHECKSUM)
+ * @param	timeoutClass	timeout class of the response, TIMEOUT_ERASE for erase and write instructions
  */
-void CAvrProgCommands::executeCommands(uint8_t *setupCommand, uint8_t numOfCommands, uint8_t *data) {
+void CAvrProgCommands::executeCommands(const uint8_t *setupCommand, uint8_t numOfCommands, int dataSize, uint16_t checksum, timeout_class_t timeoutClass) {
 	int len;
 	uint8_t *buffer = NULL;
 	uint8_t command[] = {0x03, 0x00, 0x00, 0x00};
-	uint16_t checksum;
 
 	command[1] = numOfCommands;
 
-	checksum = this->checksum(data, DATA_COMMAND_SIZE);
-
 	command[2] = (checksum >> 0) & 0xff;
 	command[3] = (checksum >> 8) & 0xff;
 
-	int_write(2, setupCommand, SETUP_COMMAND_SIZE);
+	// the buffer is cleared in any case, otherwise a failed transfer leaves instructions for the next command
+	try {
+		int_write(2, const_cast<uint8_t*>(setupCommand), SETUP_COMMAND_SIZE);
 
-	// send data
-	iso_write(3, data, DATA_COMMAND_SIZE);
+		// send data
+		iso_write(3, commandData, DATA_COMMAND_SIZE);
+	}
+	catch (...) {
+		memset(commandData, 0x00, dataSize);
+		throw;
+	}
+	memset(commandData, 0x00, dataSize);
 
 	// execute
 	int_write(2, command, sizeof(command));
 	len = 1;
-	int_read(2, &buffer, &len);
+	int_read(2, &buffer, &len, timeoutClass);
 
 	COut::dd("Execute command returned " + CFormat::hex(buffer, len));
 
@@ -637,6 +832,17 @@ void CAvrProgCommands::executeCommands(uint8_t *setupCommand, uint8_t numOfComma
 	}
 }
 
+/*
+ * execute ISP instructions which are completely known at compile time
+ */
+template<class Command>
+void CAvrProgCommands::executeCommand(uint8_t numOfCommands, timeout_class_t timeoutClass) {
+	static_assert(Command::SIZE <= DATA_COMMAND_SIZE, "ISP instructions exceed the data buffer");
+
+	memcpy(commandData, Command::data, Command::SIZE);
+	executeCommands(Command::setup, numOfCommands, Command::SIZE, Command::CHECKSUM, timeoutClass);
+}
+
 /*
  * read device signature
  */
@@ -644,27 +850,9 @@ uint32_t CAvrProgCommands::getDeviceSignature() {
 	int len;
 	uint8_t *buffer;
 
-	uint8_t command[] = {0x02, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00};
-	uint8_t data[] = {	0x30, 0x00, 0x00, 0x30, 0x00, 0x01, 0x30, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-						0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
 	COut::dd("Get device signature");
 
-	executeCommands(command, 3, data);
+	executeCommand<ReadSignature>(ReadSignature::INSTRUCTIONS);
 
 	len = 256;
 	iso_read(3, &buffer, &len);
@@ -686,25 +874,8 @@ uint32_t CAvrProgCommands::getDeviceSignature() {
 bool CAvrProgCommands::detectDevice(bool reportError) {
 	int len;
 	uint8_t *buffer = NULL;
-	uint8_t command[] = {0x02, 0x02, 0x00, 0x02, 0x00, 0x00, 0x00};
-	uint8_t data[] = {	0xac, 0x53, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-	executeCommands(command, 1, data);
+
+	executeCommand<DetectDevice>(DetectDevice::INSTRUCTIONS);
 
 	len = 256;
 	iso_read(3, &buffer, &len);
@@ -723,17 +894,6 @@ bool CAvrProgCommands::detectDevice(bool reportError) {
 	return true;
 }
 
-/*
- * calculate the checksum (16 bit sum of all bytes in buffer)
- */
-uint16_t CAvrProgCommands::checksum(uint8_t *buffer, int size) {
-	uint16_t checksum = 0;
-	for (int i=0; i<size; i++) {
-		checksum += buffer[i];
-	}
-	return checksum;
-}
-
 /*
  * low level functions to write eeprom memory
  *
@@ -752,7 +912,7 @@ void CAvrProgCommands::writeEEPROMChunk(uint8_t *code, int address) {
 	// copy chunk to buffer (extends the chunk to USB_TRANSFER_SIZE)
 	memcpy(chunk, code, EEPROM_WRITE_CHUNK_SIZE);
 
-	checksum = this->checksum(chunk, USB_TRANSFER_SIZE);
+	checksum = CMemoryKernels::checksum(chunk, USB_TRANSFER_SIZE);
 
 	command[2] = (checksum>>8) & 0xff;		// assign checksum
 	command[1] = (checksum>>0) & 0xff;
@@ -764,7 +924,7 @@ void CAvrProgCommands::writeEEPROMChunk(uint8_t *code, int address) {
 
 	int_write(2, command, sizeof(command));
 	len = 1;
-	int_read(2, &buffer, &len);
+	int_read(2, &buffer, &len, TIMEOUT_EEPROM);		// eeprom is written byte by byte
 
 	COut::dd("Write eeprom chunk returned " + CFormat::hex(buffer, len));
 
@@ -838,7 +998,7 @@ uint8_t *CAvrProgCommands::readMemoryChunk(int chunkNumber, memory_t mem) {
 
 	// Debugging output
 	if (COut::isSet(2)) {
-		if (isEmptyChunk(buffer, USB_TRANSFER_SIZE)) {
+		if (CMemoryKernels::isEmpty(buffer, USB_TRANSFER_SIZE, EMPTY_FLASH_BYTE)) {
 			COut::dd("Read chunk (" + CFormat::intToString(chunkNumber) + ") returned (after " + CFormat::intToString(MAX_READ_CYCLES - count) + " tries): empty chunk");
 		}
 		else {
@@ -849,6 +1009,17 @@ uint8_t *CAvrProgCommands::readMemoryChunk(int chunkNumber, memory_t mem) {
 	return buffer;
 }
 
+/*
+ * Worst case time (ms) of a response which waits for the target: 'bytes' bytes are loaded with the current
+ * SCK (at most a quarter of the device frequency, four instruction bytes per byte) and written with 'writes'
+ * write cycles of 'writeTime' us each. USB_TIMEOUT_STATUS_MIN is added for the USB round trip.
+ */
+unsigned int CAvrProgCommands::targetTime(int bytes, int writes, int writeTime) {
+	double us = bytes * 4 * 8 * 1000000.0 / (targetFrequency / 4) + (double)writes * writeTime;
+
+	return USB_TIMEOUT_STATUS_MIN + (unsigned int)ceil(us / 1000);
+}
+
 CAvrProgCommands::~CAvrProgCommands() {
 	programmer(DEACTIVATE);
 }
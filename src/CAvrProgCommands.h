@@ -21,6 +21,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define CAVRPROGCOMMANDS_H_
 
 #include "CUSBCommunication.h"
+#include "CJournal.h"
+#include "CMemoryImage.h"
+#include "CMemorySink.h"
+#include "CChunkStream.h"
+#include "CFlashBundle.h"
 #include "avrprog.h"
 
 /**
@@ -38,8 +43,9 @@ public:
 	 * @brief	Start a session with the hardware programmer.
 	 *
 	 * @param	device		see CUSBCommunication::CUSBCommunication
+	 * @param	context		see CUSBCommunication::CUSBCommunication
 	 */
-	CAvrProgCommands(string device);
+	CAvrProgCommands(string device, libusb_context *context = NULL);
 	virtual ~CAvrProgCommands();
 
 	/**
@@ -50,6 +56,29 @@ public:
 	 */
 	void connect(int socket);
 
+	/**
+	 * @brief	Disconnect from the target mcu
+	 *
+	 * Disables the programming pins. Afterwards connect() may be called again,
+	 * e.g. with another socket.
+	 */
+	void disconnect();
+
+	/**
+	 * @brief	Look for a target without connecting to it.
+	 *
+	 * Sends the programming enable instruction only, with the current programming speed.
+	 *
+	 * @param	socket		Socket of the target, AUTO_DETECT to try all sockets.
+	 * @return	Socket of the found target, -1 if no target answered.
+	 */
+	int probe(int socket);
+
+	/**
+	 * @return	Socket which was selected by the last connect(), e.g. the autodetected one.
+	 */
+	int getSocket();
+
 	/**
 	 * @brief	Reads the device signature
 	 *
@@ -64,10 +93,44 @@ public:
 
 	/**
 	 * @brief	Write to flash memory.
-	 * @param	buffer	Byte array with the content to write.
-	 * @param	size	Length of \a buffer.
+	 *
+	 * Only chunks which contain content of the image are transferred.
+	 *
+	 * If a journal is set, the write starts behind the last chunk which is acknowledged
+	 * in the journal, and each acknowledged chunk is recorded.
+	 *
+	 * @param	image		Content to write.
+	 * @param	pageSize	Flash page size of the target.
+	 */
+	void writeFlash(CMemoryImage *image, int pageSize);
+
+	/**
+	 * @brief	Write to flash memory while the input file is parsed.
+	 *
+	 * Each chunk is written as soon as \a stream provides it. Journaling is not supported.
+	 *
+	 * @param	stream		Started stream of the content to write.
+	 * @param	pageSize	Flash page size of the target.
+	 * @param	flashSize	Flash size of the target, only used for the progressbar.
 	 */
-	void writeFlash(uint8_t *buffer, int size, int pageSize);
+	void writeFlash(CChunkStream *stream, int pageSize, int flashSize);
+
+	/**
+	 * @brief	Write a prepared bundle to flash memory.
+	 *
+	 * Like writeFlash() with an image, but the chunks, their checksums and empty flags are taken
+	 * from the bundle. A journal is supported.
+	 *
+	 * @param	bundle		Content to write.
+	 * @param	pageSize	Flash page size of the target.
+	 */
+	void writeFlash(CFlashBundle *bundle, int pageSize);
+
+	/**
+	 * @brief	Set a journal for subsequent flash writes.
+	 * @param	journal	Journal or NULL to disable journaling. The journal is not owned by this object.
+	 */
+	void setJournal(CJournal *journal);
 
 	/**
 	 * @brief	Write fuse bytes.
@@ -80,10 +143,12 @@ public:
 
 	/**
 	 * @brief	Write to eeprom memory.
-	 * @param	buffer	Byte array with the content to write.
-	 * @param	size	Length of \a buffer.
+	 *
+	 * Only chunks which contain content of the image are transferred.
+	 *
+	 * @param	image	Content to write.
 	 */
-	void writeEEPROM(uint8_t *buffer, int size);
+	void writeEEPROM(CMemoryImage *image);
 
 	/**
 	 * @brief	Read the content of flash memory.
@@ -95,6 +160,16 @@ public:
 	 */
 	uint8_t *readFlash(int size);
 
+	/**
+	 * @brief	Read the content of flash memory and pass each chunk to \a sink as soon as it is read.
+	 *
+	 * The chunks are passed in the order of the memory.
+	 *
+	 * @param	size	Number of bytes to read.
+	 * @param	sink	Receives the read content, e.g. a CReadoutStream.
+	 */
+	void readFlash(int size, CMemorySink *sink);
+
 	/**
 	 * @brief	Read the content of eeprom memory.
 	 *
@@ -105,6 +180,14 @@ public:
 	 */
 	uint8_t *readEEPROM(int size);
 
+	/**
+	 * @brief	Read the content of eeprom memory and pass each chunk to \a sink as soon as it is read.
+	 *
+	 * @param	size	Number of bytes to read.
+	 * @param	sink	Receives the read content in the order of the memory.
+	 */
+	void readEEPROM(int size, CMemorySink *sink);
+
 	/**
 	 * @brief	Read the fuse bytes.
 	 *
@@ -152,10 +235,15 @@ private:
 	} programmer_info_t;
 
 	bool continuedWrite;
+	CJournal *journal;
+	int socket;			// selected by connect()
+	double targetFrequency;	// device frequency (Hz) of the current programming speed
+	uint8_t commandData[DATA_COMMAND_SIZE];	// data buffer for executeCommands(), zero except while a command is sent
 
 	// private functions are documented in the *.cpp file
 	void checkDevice();
 	uint8_t *readMemory(int size, memory_t mem);
+	void readMemory(int size, memory_t mem, CMemorySink *sink);
 	void selectSocket(uint8_t socket);
 	void setExtendedAddress();
 	uint8_t *readMemoryChunk(int chunkNumber, memory_t mem);
@@ -163,12 +251,16 @@ private:
 	void programmer(programmer_action_t action);
 	void delayMs(uint8_t time);
 	bool detectDevice(bool reportError);
-	void executeCommands(uint8_t *setupCommand, uint8_t numOfCommands, uint8_t *data);
-	uint16_t checksum(uint8_t *buffer, int size);
+	void executeCommands(const uint8_t *setupCommand, uint8_t numOfCommands, int dataSize, uint16_t checksum, timeout_class_t timeoutClass = TIMEOUT_STATUS);
+	template<class Command> void executeCommand(uint8_t numOfCommands, timeout_class_t timeoutClass = TIMEOUT_STATUS);
+	int nextFlashChunk(CMemoryImage *image, int chunk, int numOfChunks);
+	int nextFlashChunk(CFlashBundle *bundle, int chunk);
+	int resumeFlashWrite(int numOfChunks);
 	void writeFlashChunk(uint8_t *buffer, int page, int pageSize);
+	void writeFlashChunk(uint8_t *buffer, int page, int pageSize, bool empty, uint16_t checksum);
 	void writeEEPROMChunk(uint8_t *buffer, int address);
-	bool isEmptyChunk(uint8_t *buffer, int pageSize);
 	bool trySocket(uint8_t socket);
+	unsigned int targetTime(int bytes, int writes, int writeTime);
 };
 
 /**
@@ -0,0 +1,124 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CBinaryFile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+
+CBinaryFile::CBinaryFile(string path) : CHexFile(path) {
+
+}
+
+/*
+ * The file is mapped instead of read, hence its content is copied only once (into the sink).
+ */
+int CBinaryFile::load(uint32_t address, CMemorySink *sink) {
+	struct stat st;
+	void *mapping;
+	int fd;
+
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw FileException("Could not open file '" + path + "' (" + strerror(errno) + ").");
+	}
+
+	if (fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		throw FileException("Could not read file '" + path + "' (" + strerror(err) + ").");
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	if (st.st_size > 0x7fffffff) {
+		close(fd);
+		throw FileException("File '" + path + "' is too large.");
+	}
+
+	mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		throw FileException("Could not map file '" + path + "' (" + strerror(errno) + ").");
+	}
+
+	// the file is read sequentially once
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+	try {
+		sink->addData(address, (const uint8_t*)mapping, st.st_size);
+	}
+	catch (...) {
+		munmap(mapping, st.st_size);
+		throw;
+	}
+	munmap(mapping, st.st_size);
+
+	return st.st_size;
+}
+
+int CBinaryFile::load(CInputStream *input, uint32_t address, CMemorySink *sink) {
+	uint8_t *buffer = new uint8_t[BLOCK_SIZE];
+	int size = 0;
+	int len;
+
+	try {
+		while ((len = input->read(buffer, BLOCK_SIZE)) > 0) {
+			sink->addData(address + size, buffer, len);
+			size += len;
+		}
+	}
+	catch (...) {
+		delete[] buffer;
+		throw;
+	}
+	delete[] buffer;
+
+	return size;
+}
+
+/*
+ * the addresses of a binary file are implicit, hence nothing may be omitted
+ */
+void CBinaryFile::setGaps(uint8_t fill, int minGap) {
+
+}
+
+int CBinaryFile::maxLength(int size) {
+	return size;
+}
+
+char *CBinaryFile::dataRecords(char *out, uint32_t address, const uint8_t *data, int len) {
+	memcpy(out, data, len);
+	return out + len;
+}
+
+char *CBinaryFile::endRecords(char *out) {
+	return out;
+}
+
+CBinaryFile::~CBinaryFile() {
+
+}
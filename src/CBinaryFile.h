@@ -0,0 +1,74 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CBINARYFILE_H_
+#define CBINARYFILE_H_
+
+#include "CHexFile.h"
+#include "CInputStream.h"
+#include "CMemorySink.h"
+
+using namespace std;
+
+/**
+ * @brief	Reads and writes raw binary files.
+ * @throw	FileException on errors.
+ *
+ * A binary file has no structure, it is loaded with a single memory mapping and passed to a
+ * CMemorySink as one block. Streams (e.g. compressed files) are passed in blocks. Readouts are written without any formatting, gaps are not omitted (setGaps() has no effect).
+ */
+class CBinaryFile : public CHexFile {
+public:
+	/**
+	 * @param	path	Path to the file.
+	 */
+	CBinaryFile(string path);
+	virtual ~CBinaryFile();
+
+	/**
+	 * @brief	Pass the whole file to \a sink.
+	 *
+	 * @param	address	Address of the first byte of the file.
+	 * @param	sink	Receives the content of the file.
+	 * @return	Size of the file.
+	 */
+	int load(uint32_t address, CMemorySink *sink);
+
+	/**
+	 * @brief	Pass the content of a stream to \a sink, e.g. of a compressed binary file.
+	 *
+	 * @param	input	Stream with the content of the file. The stream is not owned by this object.
+	 * @param	address	Address of the first byte of the stream.
+	 * @param	sink	Receives the content of the stream in consecutive blocks.
+	 * @return	Number of read bytes.
+	 */
+	int load(CInputStream *input, uint32_t address, CMemorySink *sink);
+
+	virtual void setGaps(uint8_t fill, int minGap);
+
+protected:
+	virtual int maxLength(int size);
+	virtual char *dataRecords(char *out, uint32_t address, const uint8_t *data, int len);
+	virtual char *endRecords(char *out);
+
+private:
+	static const int BLOCK_SIZE = 65536;	// bytes read from a stream at once
+};
+
+#endif /* CBINARYFILE_H_ */
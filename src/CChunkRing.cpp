@@ -0,0 +1,87 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CChunkRing.h"
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+const int CChunkRing::CHUNK_SIZE;
+const int CChunkRing::WAIT_US;
+
+CChunkRing::CChunkRing(int _capacity) : capacity(_capacity), head(0), tail(0), closed(false), cancelled(false) {
+	slots = new slot_t[capacity];
+}
+
+/*
+ * head and tail count continuously, the slot of an index is index % capacity
+ * The ring is full if tail - head == capacity.
+ */
+CChunkRing::slot_t *CChunkRing::back() {
+	unsigned int t = tail.load(memory_order_relaxed);
+
+	while (t - head.load(memory_order_acquire) == capacity) {
+		if (cancelled.load(memory_order_acquire)) {
+			return NULL;
+		}
+		wait();
+	}
+	if (cancelled.load(memory_order_acquire)) {
+		return NULL;
+	}
+	return &slots[t % capacity];
+}
+
+void CChunkRing::push() {
+	tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void CChunkRing::close() {
+	closed.store(true, memory_order_release);
+}
+
+CChunkRing::slot_t *CChunkRing::front() {
+	unsigned int h = head.load(memory_order_relaxed);
+
+	while (tail.load(memory_order_acquire) == h) {
+		// the tail has to be checked again, the producer may push and close between both loads
+		if (closed.load(memory_order_acquire) && tail.load(memory_order_acquire) == h) {
+			return NULL;
+		}
+		wait();
+	}
+	return &slots[h % capacity];
+}
+
+void CChunkRing::pop() {
+	head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void CChunkRing::cancel() {
+	cancelled.store(true, memory_order_release);
+}
+
+void CChunkRing::wait() {
+	this_thread::sleep_for(chrono::microseconds(WAIT_US));
+}
+
+CChunkRing::~CChunkRing() {
+	delete[] slots;
+}
@@ -0,0 +1,103 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CCHUNKRING_H_
+#define CCHUNKRING_H_
+
+#include <inttypes.h>
+#include <atomic>
+
+using namespace std;
+
+/**
+ * @brief	Bounded lock-free ring of memory chunks for exactly one producer and one consumer thread.
+ *
+ * The producer fills the slot returned by back() and publishes it with push(), the consumer reads
+ * the slot returned by front() and releases it with pop(). Each side only writes its own index,
+ * hence no locks are needed. A side which has to wait (full or empty ring) polls the other index
+ * with a short sleep, the consumer is usually slowed down by USB transfers of some milliseconds.
+ *
+ * close() tells the consumer that no more chunks will follow, cancel() tells the producer that no
+ * more chunks will be consumed.
+ */
+class CChunkRing {
+public:
+	/// bytes per chunk, equals the size of a flash write chunk of the programmer
+	static const int CHUNK_SIZE = 256;
+
+	/// a ring entry
+	typedef struct {
+		int chunk;					///< chunk number (address / CHUNK_SIZE)
+		bool empty;					///< all bytes are empty
+		uint16_t checksum;			///< sum of all bytes
+		uint8_t data[CHUNK_SIZE];	///< chunk content
+	} slot_t;
+
+	/**
+	 * @param	capacity	Number of slots.
+	 */
+	CChunkRing(int capacity);
+	virtual ~CChunkRing();
+
+	/**
+	 * @brief	Get the next free slot (producer).
+	 * @return	The slot, or NULL if the ring was cancelled.
+	 */
+	slot_t *back();
+
+	/**
+	 * @brief	Publish the slot returned by back() (producer).
+	 */
+	void push();
+
+	/**
+	 * @brief	No more chunks will be pushed (producer).
+	 */
+	void close();
+
+	/**
+	 * @brief	Get the oldest published slot (consumer).
+	 * @return	The slot, or NULL if the ring is closed and all slots were consumed.
+	 */
+	slot_t *front();
+
+	/**
+	 * @brief	Release the slot returned by front() (consumer).
+	 */
+	void pop();
+
+	/**
+	 * @brief	No more chunks will be consumed (consumer).
+	 */
+	void cancel();
+
+private:
+	static const int WAIT_US = 50;		// sleep while waiting for the other side
+
+	slot_t *slots;
+	unsigned int capacity;
+	atomic<unsigned int> head;		// next slot to consume, written by the consumer
+	atomic<unsigned int> tail;		// next slot to fill, written by the producer
+	atomic<bool> closed;
+	atomic<bool> cancelled;
+
+	void wait();
+};
+
+#endif /* CCHUNKRING_H_ */
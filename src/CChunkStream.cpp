@@ -0,0 +1,147 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CChunkStream.h"
+#include <algorithm>
+#include <cstring>
+#include "CFormat.h"
+#include "CJournal.h"
+#include "CMemoryKernels.h"
+
+using namespace std;
+
+CChunkStream::CChunkStream(CMemoryOptions *_source, uint8_t _fill, uint32_t _limit) : source(_source), fill(_fill), limit(_limit), ring(RING_SIZE),
+		current(NULL), currentChunk(-1), end(0) {
+	uint8_t empty[CChunkRing::CHUNK_SIZE];
+
+	memset(empty, fill, sizeof(empty));
+	emptyHash = CJournal::hash(empty, sizeof(empty));
+}
+
+void CChunkStream::start() {
+	producer = thread(&CChunkStream::run, this);
+}
+
+/*
+ * producer thread
+ *
+ * All exceptions are passed to the consumer, the ring is closed in any case.
+ */
+void CChunkStream::run() {
+	try {
+		source->load(this);
+		if (current != NULL) {
+			emit();
+		}
+	}
+	catch (...) {
+		error = current_exception();
+	}
+	ring.close();
+}
+
+void CChunkStream::addData(uint32_t address, const uint8_t *data, int len) {
+	if (address + len > limit) {
+		throw ChunkStreamException("Not enough memory for content at 0x" + CFormat::intToHexString(address) + ".");
+	}
+
+	while (len > 0) {
+		int chunk = address / CChunkRing::CHUNK_SIZE;
+		int offset = address % CChunkRing::CHUNK_SIZE;
+		int n = min(len, CChunkRing::CHUNK_SIZE - offset);
+
+		if (chunk < currentChunk) {
+			throw ChunkStreamException("Streaming requires a file ordered by address, 0x" + CFormat::intToHexString(address) +
+					" follows 0x" + CFormat::intToHexString(currentChunk * CChunkRing::CHUNK_SIZE) + ".");
+		}
+
+		// the file continues behind the current chunk
+		if (chunk != currentChunk) {
+			if (current != NULL) {
+				emit();
+			}
+			current = ring.back();
+			if (current == NULL) {
+				throw ChunkStreamException("Stream cancelled.");
+			}
+			memset(current->data, fill, CChunkRing::CHUNK_SIZE);
+			current->chunk = chunk;
+			currentChunk = chunk;
+		}
+
+		memcpy(current->data + offset, data, n);
+		address += n;
+		data += n;
+		len -= n;
+	}
+
+	end = max(end, address);
+}
+
+/*
+ * complete the current chunk and pass it to the consumer
+ */
+void CChunkStream::emit() {
+	current->empty = CMemoryKernels::scan(current->data, CChunkRing::CHUNK_SIZE, fill, &current->checksum);
+
+	if ((int)hashes.size() <= currentChunk) {
+		hashes.resize(currentChunk + 1, emptyHash);
+	}
+	hashes[currentChunk] = CJournal::hash(current->data, CChunkRing::CHUNK_SIZE);
+
+	ring.push();
+	current = NULL;
+}
+
+CChunkRing::slot_t *CChunkStream::next() {
+	CChunkRing::slot_t *slot = ring.front();
+
+	if (slot == NULL) {
+		if (producer.joinable()) {
+			producer.join();
+		}
+		if (error) {
+			rethrow_exception(error);
+		}
+	}
+	return slot;
+}
+
+void CChunkStream::release() {
+	ring.pop();
+}
+
+uint32_t CChunkStream::size() {
+	return end;
+}
+
+const vector<uint64_t> &CChunkStream::getHashes() {
+	return hashes;
+}
+
+CChunkStream::~CChunkStream() {
+	ring.cancel();
+	if (producer.joinable()) {
+		producer.join();
+	}
+}
+
+ChunkStreamException::ChunkStreamException(string err) : ExceptionBase(err) {
+
+}
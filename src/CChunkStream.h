@@ -0,0 +1,126 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CCHUNKSTREAM_H_
+#define CCHUNKSTREAM_H_
+
+#include <inttypes.h>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "CChunkRing.h"
+#include "CMemoryOptions.h"
+#include "CMemorySink.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Streams the content of an input file in chunks while it is parsed.
+ * @throw	ChunkStreamException on errors.
+ *
+ * A producer thread parses the file (see CMemoryOptions::load()) and collects the decoded bytes
+ * in chunks of CChunkRing::CHUNK_SIZE bytes. A chunk is complete as soon as the file continues
+ * behind it. Its checksum and empty flag are computed in the producer thread, then the chunk is
+ * pushed to a CChunkRing. The consumer (the flash writer) takes chunks with next(), hence parsing
+ * and USB transfers overlap and at most RING_SIZE chunks are held in memory.
+ *
+ * Since written chunks cannot be changed any more, the file has to be ordered by address. Only
+ * chunks with content are streamed. For a subsequent verify a 64 bit hash of each chunk is kept
+ * (see getHashes()), chunks without content get the hash of an empty chunk.
+ *
+ * Errors of the producer (e.g. a syntax error in the file) are thrown by next().
+ */
+class CChunkStream : public CMemorySink {
+public:
+	/**
+	 * @param	source	Deferred memory options (see CMemoryOptions::load()), not owned by this object.
+	 * @param	fill	Value of bytes which are not part of the file.
+	 * @param	limit	Size of the target memory, content behind it is an error.
+	 */
+	CChunkStream(CMemoryOptions *source, uint8_t fill, uint32_t limit);
+
+	/**
+	 * @brief	Stops the producer thread if it is still running.
+	 */
+	virtual ~CChunkStream();
+
+	/**
+	 * @brief	Start the producer thread.
+	 */
+	void start();
+
+	/**
+	 * @brief	Get the next chunk (consumer).
+	 *
+	 * Waits until the producer completed a chunk.
+	 *
+	 * @return	The chunk, which is valid until release() is called, or NULL at the end of the file.
+	 * @throw	ExceptionBase	Errors of the producer are passed on.
+	 */
+	CChunkRing::slot_t *next();
+
+	/**
+	 * @brief	Release the chunk returned by next() (consumer).
+	 */
+	void release();
+
+	/**
+	 * @brief	Collect a block of the file (producer, see CMemorySink).
+	 */
+	virtual void addData(uint32_t address, const uint8_t *data, int len);
+
+	/**
+	 * @return	Address behind the last byte of the file. Valid after next() returned NULL.
+	 */
+	uint32_t size();
+
+	/**
+	 * @return	Hash of each chunk up to size() (see CJournal::hash()). Valid after next() returned NULL.
+	 */
+	const vector<uint64_t> &getHashes();
+
+private:
+	static const int RING_SIZE = 64;	// chunks between producer and consumer
+
+	CMemoryOptions *source;
+	uint8_t fill;
+	uint32_t limit;
+	CChunkRing ring;
+	thread producer;
+	exception_ptr error;			// error of the producer, set before the ring is closed
+	CChunkRing::slot_t *current;	// chunk which is filled at the moment
+	int currentChunk;				// number of the current chunk, -1 before the first block
+	uint32_t end;
+	vector<uint64_t> hashes;
+	uint64_t emptyHash;
+
+	void run();
+	void emit();
+};
+
+/**
+ * @brief	Exception thrown by CChunkStream.
+ */
+class ChunkStreamException : public ExceptionBase {
+public:
+	ChunkStreamException(string err);
+};
+
+#endif /* CCHUNKSTREAM_H_ */
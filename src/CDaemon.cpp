@@ -0,0 +1,313 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CDaemon.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <boost/algorithm/string.hpp>
+#include "CFormat.h"
+#include "CJobFile.h"
+#include "COut.h"
+
+using namespace std;
+
+CDaemon::CDaemon(CAVRprog *_prog, string _socketPath, int _frequency) : prog(_prog), socketPath(_socketPath), frequency(_frequency),
+		fill(EMPTY_FLASH_BYTE), minGap(HEX_MIN_GAP), cache(false), fd(-1), stop(false), useCounter(0) {
+	struct sockaddr_un address;
+	struct stat st;
+
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		throw DaemonException("Socket path '" + socketPath + "' is too long.");
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		throw DaemonException((string)"Could not create socket (" + strerror(errno) + ").");
+	}
+
+	// an existing socket is only removed if nobody listens on it (a previous daemon which was killed)
+	if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		int err = 0;
+
+		if (probe >= 0) {
+			if (::connect(probe, (struct sockaddr*)&address, sizeof(address)) != 0) {
+				err = errno;
+			}
+			close(probe);
+		}
+		if (probe >= 0 && err == 0) {
+			close(fd);
+			throw DaemonException("Socket '" + socketPath + "' is already in use.");
+		}
+		if (err == ECONNREFUSED) {
+			unlink(socketPath.c_str());
+		}
+	}
+	if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 8) != 0) {
+		int err = errno;
+		close(fd);
+		throw DaemonException("Could not listen on '" + socketPath + "' (" + strerror(err) + ").");
+	}
+}
+
+void CDaemon::setGaps(uint8_t fill, int minGap) {
+	this->fill = fill;
+	this->minGap = minGap;
+}
+
+void CDaemon::setCache(bool cache) {
+	this->cache = cache;
+}
+
+void CDaemon::run() {
+	cout << "Waiting for jobs on '" << socketPath << "'." << endl;
+
+	while (!stop) {
+		int client = accept(fd, NULL, NULL);
+
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			throw DaemonException((string)"Could not accept a connection (" + strerror(errno) + ").");
+		}
+
+		try {
+			serve(client);
+		}
+		catch (...) {
+			close(client);
+			throw;
+		}
+		close(client);
+	}
+}
+
+/*
+ * handle all lines of one client, the programmer serves one client at a time
+ */
+void CDaemon::serve(int client) {
+	string pending;
+	char buffer[1024];
+	ssize_t len;
+
+	while (!stop && (len = recv(client, buffer, sizeof(buffer), 0)) != 0) {
+		size_t newline;
+
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		pending.append(buffer, len);
+
+		while (!stop && (newline = pending.find('\n')) != pending.npos) {
+			string line = pending.substr(0, newline);
+			string message;
+
+			pending.erase(0, newline + 1);
+			boost::trim(line);
+			if (line.size() == 0) {
+				continue;
+			}
+
+			cout << endl << "Job: " << line << endl;
+			if (line.compare("quit") == 0) {
+				stop = true;
+				message = "ok";
+			}
+			else {
+				try {
+					message = execute(line);
+				}
+				catch (USBCommunicationException &e) {
+					// the session is lost, the daemon has to be restarted
+					reply(client, "error " + e.what());
+					throw;
+				}
+			}
+
+			cout << message << endl;
+			if (!reply(client, message)) {
+				return;
+			}
+		}
+	}
+}
+
+string CDaemon::execute(string line) {
+	entry_t *entry;
+	int result;
+
+	try {
+		entry = loadJob(line);
+	}
+	catch (ExceptionBase &e) {
+		return "error " + e.what();
+	}
+
+	try {
+		connect(entry);
+		result = entry->job->execute(prog);
+		prog->disconnect();
+	}
+	catch (USBCommunicationException &e) {
+		throw;
+	}
+	catch (ExceptionBase &e) {
+		prog->disconnect();
+		return "error " + e.what();
+	}
+
+	return (result == 0) ? "ok" : "verify-failed";
+}
+
+/*
+ * find a loaded job, or parse the line and load a new one
+ */
+CDaemon::entry_t *CDaemon::loadJob(string line) {
+	map<string, entry_t>::iterator it = jobs.find(line);
+	entry_t entry;
+
+	if (it != jobs.end()) {
+		if (stamp(it->second.files) == it->second.stamp) {
+			COut::d("Input files are already loaded.");
+			it->second.lastUse = ++useCounter;
+			return &it->second;
+		}
+		delete it->second.job;
+		jobs.erase(it);
+	}
+
+	entry.job = CJobFile::parseLine(line);
+	if (entry.job == NULL) {
+		throw DaemonException("Empty job.");
+	}
+	try {
+		entry.job->setGaps(fill, minGap);
+		entry.job->setCache(cache);
+		entry.job->load();
+		if (entry.job->usesStandardStream()) {
+			throw DaemonException("'-' cannot be used in daemon jobs.");
+		}
+	}
+	catch (...) {
+		delete entry.job;
+		throw;
+	}
+	entry.files = entry.job->getInputFiles();
+	entry.stamp = stamp(entry.files);
+	entry.frequency = FREQUENCY_AUTODETECT;
+	entry.lastUse = ++useCounter;
+
+	// drop the least recently used job
+	if (jobs.size() >= MAX_JOBS) {
+		map<string, entry_t>::iterator oldest = jobs.begin();
+
+		for (it = jobs.begin(); it != jobs.end(); it++) {
+			if (it->second.lastUse < oldest->second.lastUse) {
+				oldest = it;
+			}
+		}
+		delete oldest->second.job;
+		jobs.erase(oldest);
+	}
+
+	return &(jobs[line] = entry);
+}
+
+/*
+ * connect with the frequency which was detected for the previous target of the job, and
+ * detect it again if it does not work
+ */
+void CDaemon::connect(entry_t *entry) {
+	prog->connect(entry->job->getMcu(), frequency, entry->job->getSocket(), entry->frequency);
+	entry->frequency = prog->getFrequency();
+}
+
+/*
+ * state of the input files, a changed file gives another stamp
+ */
+string CDaemon::stamp(const vector<string> &files) {
+	string ret;
+
+	for (unsigned int i=0; i<files.size(); i++) {
+		struct stat st;
+
+		ret += files[i];
+		if (stat(files[i].c_str(), &st) == 0) {
+			ret += " " + CFormat::intToString(st.st_size) + " " + CFormat::intToString(st.st_ino) + " " + CFormat::intToString(st.st_mtim.tv_sec)
+					+ "." + CFormat::intToString(st.st_mtim.tv_nsec);
+		}
+		ret += "\n";
+	}
+	return ret;
+}
+
+/*
+ * send one reply line, error messages may contain newlines
+ */
+bool CDaemon::reply(int client, string message) {
+	const char *data;
+	size_t size;
+
+	boost::replace_all(message, "\n", " ");
+	message += "\n";
+	data = message.data();
+	size = message.size();
+
+	while (size > 0) {
+		ssize_t sent = send(client, data, size, MSG_NOSIGNAL);
+
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+CDaemon::~CDaemon() {
+	for (map<string, entry_t>::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		delete it->second.job;
+	}
+	if (fd >= 0) {
+		close(fd);
+		unlink(socketPath.c_str());
+	}
+}
+
+DaemonException::DaemonException(string err) : ExceptionBase(err) {
+
+}
@@ -0,0 +1,128 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CDAEMON_H_
+#define CDAEMON_H_
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "CAVRprog.h"
+#include "CJob.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Serves jobs from a Unix domain socket within one programmer session.
+ * @throw	DaemonException on socket errors, and USBCommunicationException if the programmer is lost.
+ *
+ * The programmer is opened once, then each request is programmed like a target of a job file.
+ * A client connects to the socket and sends one or more lines, each line is a job in the format of a
+ * job file line (see CJobFile), e.g.
+ * @code
+ * auto atmega128 flash=w:/srv/images/main.hex eeprom=w:/srv/images/main.eep verify
+ * @endcode
+ * and gets one reply line for each of them:
+ * - \a ok if all operations succeeded.
+ * - \a verify-failed if a verify operation failed.
+ * - \a error followed by the error message.
+ *
+ * The line \a quit stops the daemon. Paths are relative to the working directory of the daemon,
+ * standard input and output cannot be used.
+ *
+ * Loaded jobs are kept, hence the images of a repeated request are not loaded again unless one of the
+ * input files changed (size, modification time or inode). At most MAX_JOBS jobs are kept, the least
+ * recently used one is dropped. The programming frequency, which was detected for a job, is tried first
+ * for its next request.
+ */
+class CDaemon {
+public:
+	/**
+	 * @brief	Create the socket.
+	 *
+	 * A stale socket file of a previous daemon is replaced, a socket on which another daemon
+	 * still listens leads to a DaemonException.
+	 *
+	 * @param	prog		Opened programmer, not owned by this object.
+	 * @param	socketPath	Path of the Unix domain socket.
+	 * @param	frequency	Programming frequency, FREQUENCY_AUTODETECT for autodetection.
+	 */
+	CDaemon(CAVRprog *prog, string socketPath, int frequency);
+
+	/**
+	 * @brief	Close and remove the socket.
+	 */
+	virtual ~CDaemon();
+
+	/**
+	 * @brief	Options for the loaded jobs, see CJob::setGaps().
+	 */
+	void setGaps(uint8_t fill, int minGap);
+
+	/**
+	 * @brief	Options for the loaded jobs, see CJob::setCache().
+	 */
+	void setCache(bool cache);
+
+	/**
+	 * @brief	Serve requests until \a quit is received.
+	 */
+	void run();
+
+private:
+	static const int MAX_JOBS = 16;		// number of loaded jobs which are kept
+
+	typedef struct {
+		CJob *job;
+		vector<string> files;	// input files of the job
+		string stamp;			// state of the input files when the job was loaded
+		int frequency;			// frequency of the last connect, FREQUENCY_AUTODETECT if unknown
+		uint64_t lastUse;
+	} entry_t;
+
+	CAVRprog *prog;
+	string socketPath;
+	int frequency;
+	uint8_t fill;
+	int minGap;
+	bool cache;
+	int fd;
+	bool stop;
+	uint64_t useCounter;
+	map<string, entry_t> jobs;	// loaded jobs by their request line
+
+	void serve(int client);
+	string execute(string line);
+	entry_t *loadJob(string line);
+	void connect(entry_t *entry);
+	static string stamp(const vector<string> &files);
+	static bool reply(int client, string message);
+};
+
+/**
+ * @brief	Exception thrown by CDaemon.
+ */
+class DaemonException : public ExceptionBase {
+public:
+	DaemonException(string err);
+};
+
+#endif /* CDAEMON_H_ */
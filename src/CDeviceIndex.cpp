@@ -0,0 +1,264 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CDeviceIndex.h"
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "avrprog.h"
+#include "CAVRDevice.h"
+#include "CFormat.h"
+#include "COut.h"
+
+using namespace std;
+
+CDeviceIndex::CDeviceIndex(string _indexPath) : indexPath(_indexPath), loaded(false) {
+	char const *home = getenv("HOME");
+
+	dirs[SYSTEM_DIR].path = CONFIG_DIR;
+	dirs[USER_DIR].path = (home != NULL) ? home + (string)"/" + HOME_CONFIG_DIR : "";
+
+	// the index is not stored in a indexed directory, writing it would change the modification time
+	if (indexPath.size() == 0 && home != NULL) {
+		mkdir(dirs[USER_DIR].path.c_str(), 0755);
+		mkdir((dirs[USER_DIR].path + "cache/").c_str(), 0755);
+		indexPath = dirs[USER_DIR].path + "cache/devices.idx";
+	}
+}
+
+bool CDeviceIndex::find(uint32_t signature, string *name) {
+	lock_guard<mutex> guard(lock);
+	unordered_map<uint32_t, string>::iterator it;
+
+	update();
+	it = signatures.find(signature);
+	if (it == signatures.end()) {
+		return false;
+	}
+	*name = it->second;
+	return true;
+}
+
+bool CDeviceIndex::exists(directory_t directory) {
+	lock_guard<mutex> guard(lock);
+
+	update();
+	return dirs[directory].exists;
+}
+
+vector<string> CDeviceIndex::names(directory_t directory) {
+	lock_guard<mutex> guard(lock);
+	vector<string> ret;
+
+	update();
+	for (unsigned int i=0; i<dirs[directory].devices.size(); i++) {
+		ret.push_back(dirs[directory].devices[i].first);
+	}
+	return ret;
+}
+
+/*
+ * check the modification times of the directories, and load or rebuild the index if they changed
+ */
+void CDeviceIndex::update() {
+	dir_t current[NUM_OF_DIRS];
+	bool changed = !loaded;
+
+	for (int d=0; d<NUM_OF_DIRS; d++) {
+		struct stat st;
+
+		current[d].path = dirs[d].path;
+		current[d].exists = current[d].path.size() != 0 && stat(current[d].path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+		current[d].mtime.tv_sec = current[d].exists ? st.st_mtim.tv_sec : 0;
+		current[d].mtime.tv_nsec = current[d].exists ? st.st_mtim.tv_nsec : 0;
+		if (current[d].exists != dirs[d].exists || current[d].mtime.tv_sec != dirs[d].mtime.tv_sec || current[d].mtime.tv_nsec != dirs[d].mtime.tv_nsec) {
+			changed = true;
+		}
+	}
+	if (!changed) {
+		return;
+	}
+
+	if (!loadIndex(current)) {
+		COut::d("Rebuild the device index.");
+		for (int d=0; d<NUM_OF_DIRS; d++) {
+			scan(&current[d]);
+		}
+		for (int d=0; d<NUM_OF_DIRS; d++) {
+			dirs[d] = current[d];
+		}
+		saveIndex();
+	}
+	else {
+		for (int d=0; d<NUM_OF_DIRS; d++) {
+			dirs[d] = current[d];
+		}
+	}
+
+	// the first file of a signature is used, like a search through the directories
+	signatures.clear();
+	for (int d=0; d<NUM_OF_DIRS; d++) {
+		for (unsigned int i=0; i<dirs[d].devices.size(); i++) {
+			if (dirs[d].devices[i].second != 0) {
+				signatures.insert(make_pair(dirs[d].devices[i].second, dirs[d].devices[i].first));
+			}
+		}
+	}
+	loaded = true;
+}
+
+/*
+ * read the index file, it is only used if it was built from the current directories
+ */
+bool CDeviceIndex::loadIndex(dir_t *current) {
+	ifstream file;
+	string line;
+	int numOfDirs = 0;
+
+	if (indexPath.size() == 0) {
+		return false;
+	}
+	file.open(indexPath.c_str());
+	if (!file.is_open()) {
+		return false;
+	}
+
+	if (!getline(file, line) || line.compare((string)PACKAGE + " device index " + CFormat::intToString(FORMAT_VERSION)) != 0) {
+		return false;
+	}
+	while (getline(file, line)) {
+		istringstream fields(line);
+		string key;
+		int d;
+
+		fields >> key >> d;
+		if (fields.fail() || d < 0 || d >= NUM_OF_DIRS) {
+			return false;
+		}
+
+		if (key.compare("dir") == 0) {
+			int exists;
+			long sec, nsec;
+			string path;
+
+			fields >> exists >> sec >> nsec;
+			fields.get();
+			getline(fields, path);
+			if (fields.fail() || path.compare(current[d].path) != 0 || (exists != 0) != current[d].exists
+					|| sec != current[d].mtime.tv_sec || nsec != current[d].mtime.tv_nsec) {
+				return false;
+			}
+			numOfDirs++;
+		}
+		else if (key.compare("device") == 0) {
+			string signature;
+			string name;
+
+			fields >> signature;
+			fields.get();
+			getline(fields, name);
+			if (fields.fail() || name.size() == 0) {
+				return false;
+			}
+			current[d].devices.push_back(make_pair(name, (uint32_t)CFormat::hexStringToInt(signature)));
+		}
+		else {
+			return false;
+		}
+	}
+
+	return numOfDirs == NUM_OF_DIRS;
+}
+
+/*
+ * parse all *.xml files of a directory, in the order of the directory
+ */
+void CDeviceIndex::scan(dir_t *dir) {
+	struct dirent *entry;
+	DIR *handle;
+
+	dir->devices.clear();
+	if (!dir->exists) {
+		return;
+	}
+	handle = opendir(dir->path.c_str());
+	if (handle == NULL) {
+		return;
+	}
+	while ((entry = readdir(handle)) != NULL) {
+		string file = entry->d_name;
+		string path = dir->path + file;
+		struct stat st;
+		uint32_t signature = 0;
+
+		if (file.size() <= 4 || file.compare(file.size() - 4, 4, ".xml") != 0 || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		try {
+			signature = CAVRDevice::readSignature(path);
+		}
+		catch (ExceptionBase &e) {
+			COut::dd("'" + path + "' is not a valid device description file.");
+		}
+		dir->devices.push_back(make_pair(file.substr(0, file.size() - 4), signature));
+	}
+	closedir(handle);
+}
+
+/*
+ * write the index atomically, several processes may rebuild it at the same time
+ */
+void CDeviceIndex::saveIndex() {
+	string tmpPath = indexPath + ".tmp" + CFormat::intToString(getpid());
+	ofstream file;
+
+	if (indexPath.size() == 0) {
+		return;
+	}
+	file.open(tmpPath.c_str());
+	if (!file.is_open()) {
+		COut::d("Cannot write the device index '" + indexPath + "'.");
+		return;
+	}
+
+	file << PACKAGE << " device index " << FORMAT_VERSION << endl;
+	for (int d=0; d<NUM_OF_DIRS; d++) {
+		file << "dir " << d << " " << (dirs[d].exists ? 1 : 0) << " " << dirs[d].mtime.tv_sec << " " << dirs[d].mtime.tv_nsec << " " << dirs[d].path << endl;
+	}
+	for (int d=0; d<NUM_OF_DIRS; d++) {
+		for (unsigned int i=0; i<dirs[d].devices.size(); i++) {
+			file << "device " << d << " 0x" << CFormat::intToHexString(dirs[d].devices[i].second) << " " << dirs[d].devices[i].first << endl;
+		}
+	}
+	file.close();
+
+	if (file.fail() || rename(tmpPath.c_str(), indexPath.c_str()) != 0) {
+		COut::d("Cannot write the device index '" + indexPath + "'.");
+		unlink(tmpPath.c_str());
+	}
+}
+
+CDeviceIndex::~CDeviceIndex() {
+
+}
@@ -0,0 +1,113 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CDEVICEINDEX_H_
+#define CDEVICEINDEX_H_
+
+#include <inttypes.h>
+#include <time.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief	Index of the device description files (see CAVRDevice) by their device signature.
+ *
+ * The index lists the *.xml files of CONFIG_DIR and HOME_CONFIG_DIR with their signatures. It is
+ * kept in ~/HOME_CONFIG_DIR/cache/devices.idx, a small text file which looks like:
+ * @code
+ * avrprog2 device index 1
+ * dir <directory> <exists> <modification time (s)> <modification time (ns)> <path>
+ * device <directory> <signature> <name>
+ * ...
+ * @endcode
+ * Files which are not valid device descriptions are listed with signature 0.
+ *
+ * The index is rebuilt if the modification time of one of the directories changed, i.e. if a
+ * file was added, removed or renamed. A description file which is changed in place is only
+ * indexed again after the next change of its directory. Otherwise no description file is parsed
+ * for a lookup.
+ *
+ * All methods may be called from several threads.
+ */
+class CDeviceIndex {
+public:
+	/// directories of device description files, in search order
+	typedef enum {
+		SYSTEM_DIR,		///< CONFIG_DIR
+		USER_DIR,		///< HOME_CONFIG_DIR
+		NUM_OF_DIRS,
+	} directory_t;
+
+	/**
+	 * @param	indexPath	Path to the index file, empty for ~/HOME_CONFIG_DIR/cache/devices.idx.
+	 */
+	CDeviceIndex(string indexPath = "");
+	virtual ~CDeviceIndex();
+
+	/**
+	 * @brief	Find the description file of a device.
+	 *
+	 * If several files have the same signature, the first one in CONFIG_DIR is used.
+	 *
+	 * @param	signature	Device signature.
+	 * @param	name		Receives the name of the file without extension (see CAVRDevice::CAVRDevice(string)).
+	 * @return	true if a file was found.
+	 */
+	bool find(uint32_t signature, string *name);
+
+	/**
+	 * @param	directory	Directory of description files.
+	 * @return	true if the directory exists.
+	 */
+	bool exists(directory_t directory);
+
+	/**
+	 * @param	directory	Directory of description files.
+	 * @return	Names of all *.xml files in the directory, without extension.
+	 */
+	vector<string> names(directory_t directory);
+
+private:
+	static const int FORMAT_VERSION = 1;		// version of the index format
+
+	typedef struct {
+		string path;
+		bool exists;
+		struct timespec mtime;
+		vector<pair<string, uint32_t> > devices;	// name and signature of each file
+	} dir_t;
+
+	mutex lock;
+	string indexPath;
+	bool loaded;
+	dir_t dirs[NUM_OF_DIRS];
+	unordered_map<uint32_t, string> signatures;
+
+	void update();
+	bool loadIndex(dir_t *current);
+	void scan(dir_t *dir);
+	void saveIndex();
+};
+
+#endif /* CDEVICEINDEX_H_ */
@@ -20,10 +20,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "CEEPROMOptions.h"
 #include <vector>
 
-CEEPROMOptions::CEEPROMOptions(string options) : CMemoryOptions(options, BUFFER_OFFSET, vector<string>{".eeprom"}) {
+CEEPROMOptions::CEEPROMOptions(string options, bool cache) : CMemoryOptions(options, BUFFER_OFFSET, vector<string>{".eeprom"}, false, cache) {
 	if (operation == READ && this->type == IMMEDIATE) {
 		throw ProgramOptionsException("Cannot read from immediate value.");
 	}
+	if (this->type == BUNDLE) {
+		throw ProgramOptionsException("Bundles only contain flash memory.");
+	}
 }
 
 CEEPROMOptions::~CEEPROMOptions() {
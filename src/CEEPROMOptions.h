@@ -33,8 +33,9 @@ class CEEPROMOptions : public CMemoryOptions {
 public:
 	/**
 	 * @param	options	Command line argument.
+	 * @param	cache	Use the image cache (see CImageCache).
 	 */
-	CEEPROMOptions(string options);
+	CEEPROMOptions(string options, bool cache = false);
 	virtual ~CEEPROMOptions();
 };
 
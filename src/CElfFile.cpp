@@ -0,0 +1,192 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CElfFile.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include "CFormat.h"
+#include "COut.h"
+
+using namespace std;
+
+map<string, CElfFile*> CElfFile::files;
+
+CElfFile::CElfFile(string _path) : path(_path), references(0), data(NULL), size(0) {
+	struct stat st;
+	int fd;
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw ElfException("Could not open file '" + path + "' (" + strerror(errno) + ").");
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw ElfException("Could not read file '" + path + "'.");
+	}
+
+	size = st.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		throw ElfException("Could not map file '" + path + "' (" + strerror(errno) + ").");
+	}
+	data = (const uint8_t*)mapping;
+
+	try {
+		parse();
+	}
+	catch (...) {
+		munmap((void*)data, size);
+		throw;
+	}
+}
+
+CElfFile *CElfFile::open(string path) {
+	CElfFile *file;
+	map<string, CElfFile*>::iterator it = files.find(path);
+
+	if (it != files.end()) {
+		file = it->second;
+	}
+	else {
+		file = new CElfFile(path);
+		files[path] = file;
+	}
+
+	file->references++;
+	return file;
+}
+
+void CElfFile::release() {
+	references--;
+	if (references == 0) {
+		files.erase(path);
+		delete this;
+	}
+}
+
+/*
+ * read the section headers and compute the load address of each section with content
+ *
+ * All offsets and sizes are checked against the file size before they are used.
+ */
+void CElfFile::parse() {
+	const Elf32_Ehdr *header = (const Elf32_Ehdr*)data;
+	const Elf32_Shdr *sectionHeaders;
+	const Elf32_Phdr *programHeaders = NULL;
+	const char *names;
+
+	if (size < sizeof(Elf32_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0) {
+		throw ElfException("Incompatible file format in '" + path + "'. Expected an elf file.");
+	}
+	if (header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB) {
+		throw ElfException("Incompatible file format in '" + path + "'. Expected a 32 bit little endian elf file.");
+	}
+
+	if (header->e_shentsize != sizeof(Elf32_Shdr) || header->e_shoff + (size_t)header->e_shnum * sizeof(Elf32_Shdr) > size
+			|| header->e_shstrndx >= header->e_shnum) {
+		throw ElfException("Invalid section headers in '" + path + "'.");
+	}
+	sectionHeaders = (const Elf32_Shdr*)(data + header->e_shoff);
+
+	if (header->e_phnum > 0) {
+		if (header->e_phentsize != sizeof(Elf32_Phdr) || header->e_phoff + (size_t)header->e_phnum * sizeof(Elf32_Phdr) > size) {
+			throw ElfException("Invalid program headers in '" + path + "'.");
+		}
+		programHeaders = (const Elf32_Phdr*)(data + header->e_phoff);
+	}
+
+	const Elf32_Shdr &nameSection = sectionHeaders[header->e_shstrndx];
+	if ((size_t)nameSection.sh_offset + nameSection.sh_size > size) {
+		throw ElfException("Invalid section names in '" + path + "'.");
+	}
+	names = (const char*)(data + nameSection.sh_offset);
+
+	for (int i=0; i<header->e_shnum; i++) {
+		const Elf32_Shdr &s = sectionHeaders[i];
+		section_t section;
+
+		if (s.sh_type == SHT_NOBITS || s.sh_size == 0 || (s.sh_flags & SHF_ALLOC) == 0) {
+			continue;
+		}
+		if ((size_t)s.sh_offset + s.sh_size > size || s.sh_name >= nameSection.sh_size
+				|| memchr(names + s.sh_name, 0, nameSection.sh_size - s.sh_name) == NULL) {
+			throw ElfException("Invalid section header " + CFormat::intToString(i) + " in '" + path + "'.");
+		}
+
+		section.offset = s.sh_offset;
+		section.size = s.sh_size;
+		section.lma = s.sh_addr;
+
+		// the load address is given by the segment which contains the section
+		for (int p=0; p<header->e_phnum; p++) {
+			const Elf32_Phdr &segment = programHeaders[p];
+			if (segment.p_type == PT_LOAD && s.sh_offset >= segment.p_offset
+					&& s.sh_offset + s.sh_size <= segment.p_offset + segment.p_filesz) {
+				section.lma = segment.p_paddr + (s.sh_offset - segment.p_offset);
+				break;
+			}
+		}
+
+		sections[names + s.sh_name] = section;
+		COut::dd("\tSection '" + (string)(names + s.sh_name) + "': " + CFormat::intToString(section.size) + " bytes at 0x" + CFormat::intToHexString(section.lma));
+	}
+}
+
+const CElfFile::section_t &CElfFile::section(string name) {
+	map<string, section_t>::iterator it = sections.find(name);
+
+	if (it == sections.end()) {
+		throw ElfException("No '" + name + "' section found in '" + path + "'.");
+	}
+	return it->second;
+}
+
+bool CElfFile::hasSection(string name) {
+	return sections.find(name) != sections.end();
+}
+
+uint32_t CElfFile::sectionLma(string name) {
+	return section(name).lma;
+}
+
+uint32_t CElfFile::sectionSize(string name) {
+	return section(name).size;
+}
+
+void CElfFile::readSection(string name, uint32_t address, CMemorySink *sink) {
+	const section_t &s = section(name);
+
+	sink->addData(address, data + s.offset, s.size);
+}
+
+CElfFile::~CElfFile() {
+	munmap((void*)data, size);
+}
+
+ElfException::ElfException(string err) : ExceptionBase(err) {
+
+}
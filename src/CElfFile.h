@@ -0,0 +1,117 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CELFFILE_H_
+#define CELFFILE_H_
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include "CMemorySink.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Memory mapped 32 bit ELF file (as produced by avr-gcc).
+ * @throw	ElfException on errors.
+ *
+ * The file is mapped once and its section headers are parsed in one pass, the section
+ * contents are copied directly from the mapping into a CMemorySink. Flash, eeprom and
+ * fuse options which refer to the same file share one instance (see open()).
+ *
+ * The load address (lma) of a section is taken from the program header which contains the
+ * section, like the linker placed it. E.g. the lma of .data is behind .text, and the
+ * lma of .eeprom is 0x810000. Sections which are not part of a loadable segment use their
+ * virtual address.
+ */
+class CElfFile {
+public:
+	/**
+	 * @brief	Open a file or get the already opened instance.
+	 *
+	 * Each call must be paired with a call of release().
+	 *
+	 * @param	path	Path to the ELF file.
+	 * @return	Parsed file.
+	 */
+	static CElfFile *open(string path);
+
+	/**
+	 * @brief	Release an instance returned by open(). The file is unmapped with the last release.
+	 */
+	void release();
+
+	/**
+	 * @param	name	Section name.
+	 * @return	true if the file contains a section \a name with content.
+	 */
+	bool hasSection(string name);
+
+	/**
+	 * @param	name	Section name, must exist (see hasSection()).
+	 * @return	Load address of the section.
+	 */
+	uint32_t sectionLma(string name);
+
+	/**
+	 * @param	name	Section name, must exist (see hasSection()).
+	 * @return	Size of the section in bytes.
+	 */
+	uint32_t sectionSize(string name);
+
+	/**
+	 * @brief	Pass the content of a section to a sink.
+	 *
+	 * @param	name	Section name, must exist (see hasSection()).
+	 * @param	address	Address of the first byte in \a sink.
+	 * @param	sink	Receives the content.
+	 */
+	void readSection(string name, uint32_t address, CMemorySink *sink);
+
+private:
+	typedef struct {
+		uint32_t offset;	// position in the file
+		uint32_t size;
+		uint32_t lma;
+	} section_t;
+
+	static map<string, CElfFile*> files;	// opened files by path
+
+	string path;
+	int references;
+	const uint8_t *data;	// mapped file
+	size_t size;
+	map<string, section_t> sections;
+
+	CElfFile(string path);
+	virtual ~CElfFile();
+	void parse();
+	const section_t &section(string name);
+};
+
+/**
+ * @brief	Exception thrown by CElfFile
+ */
+class ElfException : public ExceptionBase {
+public:
+	ElfException(string err);
+};
+
+#endif /* CELFFILE_H_ */
@@ -0,0 +1,86 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CFileInputStream.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+CFileInputStream::CFileInputStream(string path) : CInputStream(path), fd(-1), owner(true), headLen(0), headPos(0) {
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw StreamException("Could not open file '" + path + "' (" + strerror(errno) + ").");
+	}
+}
+
+CFileInputStream::CFileInputStream(int _fd, string name) : CInputStream(name), fd(_fd), owner(false), headLen(0), headPos(0) {
+
+}
+
+int CFileInputStream::read(uint8_t *buffer, int size) {
+	// bytes of peek() first
+	if (headPos < headLen) {
+		int len = min(size, headLen - headPos);
+		memcpy(buffer, head + headPos, len);
+		headPos += len;
+		return len;
+	}
+
+	return readFile(buffer, size);
+}
+
+int CFileInputStream::peek(uint8_t *buffer, int size) {
+	while (headLen < size) {
+		int len = readFile(head + headLen, size - headLen);
+		if (len == 0) {
+			break;
+		}
+		headLen += len;
+	}
+
+	memcpy(buffer, head, min(size, headLen));
+	return min(size, headLen);
+}
+
+/*
+ * a single read() call, interrupted calls are repeated
+ */
+int CFileInputStream::readFile(uint8_t *buffer, int size) {
+	ssize_t len;
+
+	do {
+		len = ::read(fd, buffer, size);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0) {
+		throw StreamException("Error while reading '" + name + "' (" + strerror(errno) + ").");
+	}
+
+	return len;
+}
+
+CFileInputStream::~CFileInputStream() {
+	if (fd >= 0 && owner) {
+		close(fd);
+	}
+}
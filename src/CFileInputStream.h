@@ -0,0 +1,72 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CFILEINPUTSTREAM_H_
+#define CFILEINPUTSTREAM_H_
+
+#include "CInputStream.h"
+
+/**
+ * @brief	Reads a file with unbuffered read() calls.
+ * @throw	StreamException on errors.
+ *
+ * Callers are expected to read large blocks, hence no additional buffering is done.
+ */
+class CFileInputStream : public CInputStream {
+public:
+	/**
+	 * @brief	Open a file for reading.
+	 * @param	path	Path to the file.
+	 */
+	CFileInputStream(string path);
+
+	/**
+	 * @brief	Read from an already open file descriptor, e.g. standard input.
+	 * @param	fd		The file descriptor, it is not closed by this object.
+	 * @param	name	Name of the stream for messages.
+	 */
+	CFileInputStream(int fd, string name);
+	virtual ~CFileInputStream();
+
+	virtual int read(uint8_t *buffer, int size);
+
+	/**
+	 * @brief	Get the first bytes of the file without consuming them.
+	 *
+	 * Must be called before the first read().
+	 *
+	 * @param	buffer	The bytes are stored here.
+	 * @param	size	Number of bytes, at most MAX_PEEK.
+	 * @return	Number of bytes stored in \a buffer, less than \a size for short files.
+	 */
+	int peek(uint8_t *buffer, int size);
+
+	static const int MAX_PEEK = 4;	///< maximal number of bytes for peek()
+
+private:
+	int fd;
+	bool owner;				// fd is closed by the destructor
+	uint8_t head[MAX_PEEK];	// bytes read by peek()
+	int headLen;
+	int headPos;			// bytes of head already returned by read()
+
+	int readFile(uint8_t *buffer, int size);
+};
+
+#endif /* CFILEINPUTSTREAM_H_ */
@@ -0,0 +1,253 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CFlashBundle.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "avrprog.h"
+#include "CFormat.h"
+#include "CJournal.h"
+#include "CMemoryKernels.h"
+
+using namespace std;
+
+const uint32_t CFlashBundle::NO_DATA;
+
+static const char MAGIC[8] = {'A', 'V', 'R', 'P', 'B', 'N', 'D', 'L'};
+
+/*
+ * The tables are only checked against the size of the file, their content is trusted.
+ */
+CFlashBundle::CFlashBundle(string _path) : path(_path), mapping(NULL), mappingSize(0) {
+	struct stat st;
+	layout_t l;
+	int fd;
+
+	memset(emptyChunk, EMPTY_FLASH_BYTE, sizeof(emptyChunk));
+
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw BundleException("Could not open bundle '" + path + "' (" + strerror(errno) + ").");
+	}
+	if (fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		throw BundleException("Could not read bundle '" + path + "' (" + strerror(err) + ").");
+	}
+	if ((size_t)st.st_size < sizeof(header_t)) {
+		close(fd);
+		throw BundleException("'" + path + "' is not a bundle.");
+	}
+
+	mappingSize = st.st_size;
+	mapping = (uint8_t*)mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		mapping = NULL;
+		throw BundleException("Could not map bundle '" + path + "' (" + strerror(errno) + ").");
+	}
+
+	header = (const header_t*)mapping;
+	if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+		munmap(mapping, mappingSize);
+		throw BundleException("'" + path + "' is not a bundle.");
+	}
+	if (header->version != FORMAT_VERSION || header->chunkSize != CHUNK_SIZE) {
+		munmap(mapping, mappingSize);
+		throw BundleException("Unsupported version of bundle '" + path + "'.");
+	}
+
+	l = layout(header->numOfChunks, header->numOfDataChunks);
+	if (l.size != mappingSize || header->size > header->numOfChunks * CHUNK_SIZE) {
+		munmap(mapping, mappingSize);
+		throw BundleException("Bundle '" + path + "' is truncated or broken.");
+	}
+
+	bitmap = (const uint64_t*)(mapping + l.bitmap);
+	checksums = (const uint16_t*)(mapping + l.checksums);
+	hashes = (const uint64_t*)(mapping + l.hashes);
+	index = (const uint32_t*)(mapping + l.index);
+	data = mapping + l.data;
+}
+
+/*
+ * offsets of the tables, each table is aligned to 8 bytes and the data to CHUNK_SIZE
+ */
+CFlashBundle::layout_t CFlashBundle::layout(int numOfChunks, int numOfDataChunks) {
+	layout_t l;
+
+	l.bitmap = sizeof(header_t);
+	l.checksums = l.bitmap + (numOfChunks + 63) / 64 * sizeof(uint64_t);
+	l.hashes = (l.checksums + numOfChunks * sizeof(uint16_t) + 7) & ~(size_t)7;
+	l.index = l.hashes + numOfChunks * sizeof(uint64_t);
+	l.data = (l.index + numOfChunks * sizeof(uint32_t) + CHUNK_SIZE - 1) & ~(size_t)(CHUNK_SIZE - 1);
+	l.size = l.data + (size_t)numOfDataChunks * CHUNK_SIZE;
+
+	return l;
+}
+
+void CFlashBundle::create(string path, CMemoryImage *image, uint32_t signature, string mcu) {
+	header_t header;
+	layout_t l;
+	int numOfChunks = (image->size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	vector<uint64_t> bitmap((numOfChunks + 63) / 64, 0);
+	vector<uint16_t> checksums(numOfChunks);
+	vector<uint64_t> hashes(numOfChunks);
+	vector<uint32_t> index(numOfChunks, NO_DATA);
+	vector<uint8_t> data;
+	uint8_t buffer[CHUNK_SIZE];
+	int numOfDataChunks = 0;
+
+	for (int chunk=0; chunk<numOfChunks; chunk++) {
+		image->readChunk(chunk, CHUNK_SIZE, EMPTY_FLASH_BYTE, buffer);
+
+		hashes[chunk] = CJournal::hash(buffer, CHUNK_SIZE);
+		if (CMemoryKernels::scan(buffer, CHUNK_SIZE, EMPTY_FLASH_BYTE, &checksums[chunk]) == false) {
+			bitmap[chunk / 64] |= (uint64_t)1 << (chunk % 64);
+			index[chunk] = numOfDataChunks++;
+			data.insert(data.end(), buffer, buffer + CHUNK_SIZE);
+		}
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = FORMAT_VERSION;
+	header.chunkSize = CHUNK_SIZE;
+	header.signature = signature;
+	header.size = image->size();
+	header.numOfChunks = numOfChunks;
+	header.numOfDataChunks = numOfDataChunks;
+	header.imageHash = CJournal::hash((uint8_t*)hashes.data(), numOfChunks * sizeof(uint64_t));
+	strncpy(header.mcu, mcu.c_str(), sizeof(header.mcu) - 1);
+
+	// the tables are written at their offsets, the gaps between them stay zero
+	l = layout(numOfChunks, numOfDataChunks);
+	vector<uint8_t> file(l.data);
+	memcpy(&file[0], &header, sizeof(header));
+	memcpy(&file[l.bitmap], bitmap.data(), bitmap.size() * sizeof(uint64_t));
+	memcpy(&file[l.checksums], checksums.data(), checksums.size() * sizeof(uint16_t));
+	memcpy(&file[l.hashes], hashes.data(), hashes.size() * sizeof(uint64_t));
+	memcpy(&file[l.index], index.data(), index.size() * sizeof(uint32_t));
+
+	string tmpPath = path + ".tmp";
+	FILE *out = fopen(tmpPath.c_str(), "w");
+
+	if (out == NULL) {
+		throw BundleException("Could not write bundle '" + path + "' (" + strerror(errno) + ").");
+	}
+	if (fwrite(file.data(), 1, file.size(), out) != file.size() || fwrite(data.data(), 1, data.size(), out) != data.size() || fclose(out) != 0) {
+		int err = errno;
+		unlink(tmpPath.c_str());
+		throw BundleException("Could not write bundle '" + path + "' (" + strerror(err) + ").");
+	}
+	if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+		int err = errno;
+		unlink(tmpPath.c_str());
+		throw BundleException("Could not write bundle '" + path + "' (" + strerror(err) + ").");
+	}
+}
+
+uint32_t CFlashBundle::signature() {
+	return header->signature;
+}
+
+string CFlashBundle::mcu() {
+	return string(header->mcu, strnlen(header->mcu, sizeof(header->mcu)));
+}
+
+int CFlashBundle::size() {
+	return header->size;
+}
+
+int CFlashBundle::numOfChunks() {
+	return header->numOfChunks;
+}
+
+uint64_t CFlashBundle::imageHash() {
+	return header->imageHash;
+}
+
+/*
+ * whole words of the bitmap are skipped
+ */
+int CFlashBundle::nextChunk(int chunk) {
+	int numOfChunks = header->numOfChunks;
+
+	while (chunk < numOfChunks) {
+		uint64_t word = bitmap[chunk / 64] >> (chunk % 64);
+
+		if (word != 0) {
+			chunk += __builtin_ctzll(word);
+			return (chunk < numOfChunks) ? chunk : -1;
+		}
+		chunk = (chunk / 64 + 1) * 64;
+	}
+	return -1;
+}
+
+bool CFlashBundle::isEmpty(int chunk) {
+	check(chunk);
+	return (bitmap[chunk / 64] & ((uint64_t)1 << (chunk % 64))) == 0;
+}
+
+uint16_t CFlashBundle::checksum(int chunk) {
+	check(chunk);
+	return checksums[chunk];
+}
+
+uint64_t CFlashBundle::hash(int chunk) {
+	check(chunk);
+	return hashes[chunk];
+}
+
+const uint8_t *CFlashBundle::content(int chunk) {
+	check(chunk);
+	if (index[chunk] == NO_DATA) {
+		return emptyChunk;
+	}
+	if (index[chunk] >= header->numOfDataChunks) {
+		throw BundleException("Bundle '" + path + "' is broken.");
+	}
+	return data + (size_t)index[chunk] * CHUNK_SIZE;
+}
+
+/*
+ * chunks behind the image are an error of the caller
+ */
+void CFlashBundle::check(int chunk) {
+	if (chunk < 0 || chunk >= (int)header->numOfChunks) {
+		throw BundleException("Chunk " + CFormat::intToString(chunk) + " is not part of bundle '" + path + "'.");
+	}
+}
+
+CFlashBundle::~CFlashBundle() {
+	if (mapping != NULL) {
+		munmap(mapping, mappingSize);
+	}
+}
+
+BundleException::BundleException(string err) : ExceptionBase(err) {
+
+}
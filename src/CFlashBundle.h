@@ -0,0 +1,175 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CFLASHBUNDLE_H_
+#define CFLASHBUNDLE_H_
+
+#include <inttypes.h>
+#include <string>
+#include "CMemoryImage.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Flash image which is prepared for a target, such that it can be written without parsing.
+ * @throw	BundleException on errors.
+ *
+ * A bundle is created once from a hex, S-record, binary or elf file (see create()) and contains
+ * everything a flash write needs, already laid out in chunks of CHUNK_SIZE bytes:
+ * @code
+ * header       magic "AVRPBNDL", version, chunk size, device signature and name, image size,
+ *              number of chunks, number of chunks with content, hash of the image
+ * bitmap       one bit per chunk, set if the chunk has content (64 bit words)
+ * checksums    16 bit checksum of each chunk (see CMemoryKernels::scan())
+ * hashes       64 bit hash of each chunk (see CJournal::hash())
+ * index        position of each chunk in the data section, 0xffffffff for empty chunks
+ * data         the chunks with content, aligned to CHUNK_SIZE
+ * @endcode
+ * All numbers are stored in host byte order. Empty chunks are not stored, they only consist of
+ * EMPTY_FLASH_BYTE.
+ *
+ * A bundle is opened with a single memory mapping, all accessors only read the mapped tables.
+ */
+class CFlashBundle {
+public:
+	/// bytes per chunk, equals the size of a flash write chunk of the programmer
+	static const int CHUNK_SIZE = 256;
+
+	/**
+	 * @brief	Map a bundle.
+	 * @param	path	Path to the bundle file.
+	 */
+	CFlashBundle(string path);
+	virtual ~CFlashBundle();
+
+	/**
+	 * @brief	Create a bundle file.
+	 *
+	 * The file is written to a temporary file first and renamed, hence a bundle which is mapped
+	 * by another process is never changed.
+	 *
+	 * @param	path		Path to the new bundle.
+	 * @param	image		Flash content.
+	 * @param	signature	Device signature of the target.
+	 * @param	mcu			Name of the target.
+	 */
+	static void create(string path, CMemoryImage *image, uint32_t signature, string mcu);
+
+	/**
+	 * @return	Device signature of the target.
+	 */
+	uint32_t signature();
+
+	/**
+	 * @return	Name of the target.
+	 */
+	string mcu();
+
+	/**
+	 * @return	Size of the image in bytes.
+	 */
+	int size();
+
+	/**
+	 * @return	Number of chunks of the image.
+	 */
+	int numOfChunks();
+
+	/**
+	 * @return	Hash of the whole image (over the hashes of all chunks).
+	 */
+	uint64_t imageHash();
+
+	/**
+	 * @brief	Find the next chunk with content.
+	 * @param	chunk	Number of the first chunk to look at.
+	 * @return	Number of the first chunk (not smaller than \a chunk) with content, -1 if there is none.
+	 */
+	int nextChunk(int chunk);
+
+	/**
+	 * @return	true if \a chunk only contains EMPTY_FLASH_BYTE.
+	 */
+	bool isEmpty(int chunk);
+
+	/**
+	 * @return	Checksum of \a chunk.
+	 */
+	uint16_t checksum(int chunk);
+
+	/**
+	 * @return	Hash of \a chunk.
+	 */
+	uint64_t hash(int chunk);
+
+	/**
+	 * @return	Content of \a chunk (CHUNK_SIZE bytes), valid as long as this object exists.
+	 */
+	const uint8_t *content(int chunk);
+
+private:
+	static const int FORMAT_VERSION = 1;		// version of the bundle format
+	static const uint32_t NO_DATA = 0xffffffff;
+
+	typedef struct {
+		char magic[8];
+		uint32_t version;
+		uint32_t chunkSize;
+		uint32_t signature;
+		uint32_t size;
+		uint32_t numOfChunks;
+		uint32_t numOfDataChunks;
+		uint64_t imageHash;
+		char mcu[32];
+	} header_t;
+
+	typedef struct {
+		size_t bitmap;
+		size_t checksums;
+		size_t hashes;
+		size_t index;
+		size_t data;
+		size_t size;
+	} layout_t;
+
+	string path;
+	uint8_t *mapping;
+	size_t mappingSize;
+	const header_t *header;
+	const uint64_t *bitmap;
+	const uint16_t *checksums;
+	const uint64_t *hashes;
+	const uint32_t *index;
+	const uint8_t *data;
+	uint8_t emptyChunk[CHUNK_SIZE];
+
+	static layout_t layout(int numOfChunks, int numOfDataChunks);
+	void check(int chunk);
+};
+
+/**
+ * @brief	Exception thrown by CFlashBundle.
+ */
+class BundleException : public ExceptionBase {
+public:
+	BundleException(string err);
+};
+
+#endif /* CFLASHBUNDLE_H_ */
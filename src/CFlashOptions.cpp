@@ -24,12 +24,25 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 using namespace std;
 
-CFlashOptions::CFlashOptions(string options) : CMemoryOptions(options, SECTION_OFFSET, vector<string>{".text", ".data"}) {
+CFlashOptions::CFlashOptions(string options, bool stream, bool cache) : CMemoryOptions(options, SECTION_OFFSET, vector<string>{".text", ".data"}, stream, cache), bundle(NULL) {
 	if (operation == READ && this->type == IMMEDIATE) {
 		throw ProgramOptionsException("Cannot read from immediate value.");
 	}
+
+	if (this->type == BUNDLE) {
+		try {
+			bundle = new CFlashBundle(source);
+		}
+		catch (BundleException &e) {
+			throw ProgramOptionsException(e.what());
+		}
+	}
 }
 
-CFlashOptions::~CFlashOptions() {
+CFlashBundle *CFlashOptions::getBundle() {
+	return bundle;
+}
 
+CFlashOptions::~CFlashOptions() {
+	delete bundle;
 }
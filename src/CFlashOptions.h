@@ -21,11 +21,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define CFLASHOPTIONS_H_
 
 #include "CMemoryOptions.h"
+#include "CFlashBundle.h"
 
 /**
  * @brief Parses command line arguments for flash memory operations.
  *
- * See CMemoryOptions for more details.
+ * See CMemoryOptions for more details. A *.bundle file is not loaded into the image, it is
+ * mapped as CFlashBundle.
  *
  * @throw 	ProgramOptionsException on error.
  */
@@ -33,9 +35,19 @@ class CFlashOptions : public CMemoryOptions {
 public:
 	/**
 	 * @param	options	Command line argument.
+	 * @param	stream	Defer loading of a file to write, it is streamed with CChunkStream.
+	 * @param	cache	Use the image cache (see CImageCache).
 	 */
-	CFlashOptions(string options);
+	CFlashOptions(string options, bool stream = false, bool cache = false);
 	virtual ~CFlashOptions();
+
+	/**
+	 * @return	The bundle of a *.bundle file, otherwise NULL. Valid as long as this object exists.
+	 */
+	CFlashBundle *getBundle();
+
+private:
+	CFlashBundle *bundle;
 };
 
 #endif /* CFLASHOPTIONS_H_ */
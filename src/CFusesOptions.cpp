@@ -22,16 +22,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <vector>
 
 CFusesOptions::CFusesOptions(string options) : CMemoryOptions(options, BUFFER_OFFSET, vector<string>{".fuse"}), lfuse(0), hfuse(0), efuse(0), numOfFuses(0) {
-	// parse immediate values, write to buffer
+	if (this->type == BUNDLE) {
+		throw ProgramOptionsException("Bundles only contain flash memory.");
+	}
+
+	// parse immediate values, write to image
 	if ((operation == WRITE || operation == VERIFY) && this->type == IMMEDIATE) {
+		uint8_t buffer[3];
+		int bufferLen = 0;
+
 		switch (source.length()) {
 		case 2:			// 1 fuse
-			buffer = new uint8_t[1];
 			buffer[0] = hexStringToByte(source.substr(0, 2));
 			bufferLen = 1;
 			break;
 		case 5:			// 2 fuses
-			buffer = new uint8_t[2];
 			if (source.substr(2,1).compare(",") != 0) {
 				throw ProgramOptionsException("Unknown fuse settings '" + source + "'.");
 			}
@@ -40,7 +45,6 @@ CFusesOptions::CFusesOptions(string options) : CMemoryOptions(options, BUFFER_OF
 			bufferLen = 2;
 			break;
 		case 8:			// 3 fuses
-			buffer = new uint8_t[3];
 			if (source.substr(2,1).compare(",") != 0) {
 				throw ProgramOptionsException("Unknown fuse settings '" + source + "'.");
 			}
@@ -56,10 +60,15 @@ CFusesOptions::CFusesOptions(string options) : CMemoryOptions(options, BUFFER_OF
 			throw ProgramOptionsException("Unknown fuse settings '" + source + "'.");
 			break;
 		}
+
+		image.addData(0, buffer, bufferLen);
 	}
 
 	// parse fuse settings from buffer
 	if (operation == WRITE || operation == VERIFY) {
+		uint8_t *buffer = getBuffer();
+		int bufferLen = getBufferSize();
+
 		// check number of fuses
 		if (bufferLen > 3 || bufferLen < 1) {
 			throw ProgramOptionsException("Unknown fuse settings.");
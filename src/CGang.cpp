@@ -0,0 +1,573 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CGang.h"
+#include <algorithm>
+#include <iostream>
+#include <streambuf>
+#include <thread>
+#include <boost/algorithm/string.hpp>
+#include "CAVRprog.h"
+#include "CFormat.h"
+#include "COut.h"
+#include "CProgressbar.h"
+
+using namespace std;
+
+const int CGang::HOTPLUG_OPEN_ATTEMPTS;
+const int CGang::HOTPLUG_OPEN_DELAY;
+
+/*
+ * discards the output of the programmers while they run in parallel
+ */
+class CNullBuffer : public streambuf {
+protected:
+	virtual int overflow(int c) {
+		return c;
+	}
+};
+
+static CNullBuffer nullBuffer;
+static streambuf *out = NULL;
+
+CGang::CGang(string devices) : context(NULL), hotplug(devices.compare("hotplug") == 0), remaining(0) {
+	vector<string> found;
+	vector<string> selected;
+
+	if (libusb_init(&context) != LIBUSB_SUCCESS) {
+		context = NULL;
+		throw USBCommunicationException("Initializing libusb failed");
+	}
+
+	// the programmers which are connected now are reported at once
+	if (hotplug == true) {
+#if HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+		if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) == 0) {
+			libusb_exit(context);
+			throw USBCommunicationException("Hotplug is not supported by libusb on this system");
+		}
+		if (libusb_hotplug_register_callback(context, (libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+				LIBUSB_HOTPLUG_ENUMERATE, VENDOR_ID, DEVICE_ID, LIBUSB_HOTPLUG_MATCH_ANY, hotplugCallback, this, &callback) != LIBUSB_SUCCESS) {
+			libusb_exit(context);
+			throw USBCommunicationException("Registering the hotplug callback failed");
+		}
+		return;
+#else
+		libusb_exit(context);
+		throw USBCommunicationException("Hotplug is not supported by this version of libusb");
+#endif
+	}
+
+	try {
+		found = CUSBCommunication::device_list(context);
+	}
+	catch (USBCommunicationException &e) {
+		libusb_exit(context);
+		throw;
+	}
+
+	if (devices.compare("all") == 0) {
+		selected = found;
+	}
+	else {
+		boost::split(selected, devices, boost::is_any_of(","));
+	}
+
+	for (unsigned int i=0; i<selected.size(); i++) {
+		boost::trim(selected[i]);
+		if (find(found.begin(), found.end(), selected[i]) == found.end()) {
+			libusb_exit(context);
+			throw USBCommunicationException("Device " + selected[i] + " not found");
+		}
+		for (unsigned int u=0; u<units.size(); u++) {
+			if (units[u].device.compare(selected[i]) == 0) {
+				libusb_exit(context);
+				throw USBCommunicationException("Device " + selected[i] + " was already specified");
+			}
+		}
+		attach(selected[i]);
+	}
+
+	if (units.size() == 0) {
+		libusb_exit(context);
+		throw USBCommunicationException("Device not found");
+	}
+}
+
+int CGang::execute(CJob *job, int frequency) {
+	vector<thread> threads;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int passed = 0;
+	int returnValue = 0;
+
+	job->share();
+
+	cout << "Program " << units.size() << " targets in parallel..." << endl;
+	silence(true);
+	for (unsigned int i=0; i<units.size(); i++) {
+		threads.push_back(thread(&CGang::run, this, &units[i], job, frequency));
+	}
+	for (unsigned int i=0; i<threads.size(); i++) {
+		threads[i].join();
+	}
+	silence(false);
+
+	cout << endl;
+	cout.precision(2);
+	for (unsigned int i=0; i<units.size(); i++) {
+		unit_t *unit = &units[i];
+
+		cout << "Programmer " << unit->device << ": ";
+		if (unit->result == 0) {
+			cout << "OK";
+			passed++;
+		}
+		else if (unit->result == VERIFY_ERROR_NUMBER) {
+			cout << "verify failed";
+		}
+		else {
+			cout << "error, " << unit->error;
+		}
+		cout << fixed << " (connect " << unit->connectTime << " s, program " << unit->programTime << " s)" << endl;
+
+		// errors outweigh verify failures
+		if (unit->result != 0 && returnValue != COMMON_ERROR_NUMBER) {
+			returnValue = unit->result;
+		}
+	}
+
+	cout << passed << " of " << units.size() << " targets succeeded in " << seconds(start, chrono::steady_clock::now()) << " s." << endl;
+	return returnValue;
+}
+
+int CGang::execute(vector<CJob*> jobs, int frequency) {
+	vector<thread> threads;
+	thread events;
+	atomic<bool> stopEvents(false);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	double total;
+	int passed = 0;
+	int returnValue = 0;
+
+	targets.clear();
+	for (unsigned int i=0; i<jobs.size(); i++) {
+		target_t target;
+		vector<string> files = jobs[i]->getInputFiles();
+
+		target.job = jobs[i];
+		target.image = boost::join(files, ",");
+		target.result = COMMON_ERROR_NUMBER;
+		target.error = "not executed, no programmer left";
+		targets.push_back(target);
+	}
+	remaining = targets.size();
+
+	cout << "Program " << targets.size() << " targets";
+	if (hotplug == true) {
+		cout << " with all connected programmers..." << endl;
+	}
+	else {
+		cout << " with " << units.size() << " programmers..." << endl;
+	}
+
+	unique_lock<mutex> guard(lock);
+
+	// programmers which were connected when the callback was registered
+	while (arrivals.size() != 0) {
+		attach(arrivals.front());
+		arrivals.pop_front();
+	}
+
+	// jobs with the same input files are queued at one programmer, each group at the shortest queue
+	for (unsigned int i=0; i<targets.size(); i++) {
+		unsigned int u;
+
+		for (u=0; u<units.size(); u++) {
+			if (units[u].queue.size() != 0 && targets[units[u].queue.front()].image.compare(targets[i].image) == 0) {
+				break;
+			}
+		}
+		if (u == units.size()) {
+			u = 0;
+			for (unsigned int shortest=1; shortest<units.size(); shortest++) {
+				if (units[shortest].queue.size() < units[u].queue.size()) {
+					u = shortest;
+				}
+			}
+		}
+		if (u < units.size()) {
+			units[u].queue.push_back(i);
+		}
+		else {
+			pending.push_back(i);
+		}
+	}
+
+	silence(true);
+	for (unsigned int i=0; i<units.size(); i++) {
+		units[i].active = true;
+		threads.push_back(thread(&CGang::work, this, &units[i], frequency));
+	}
+	if (hotplug == true) {
+		if (units.size() == 0) {
+			cerr << "Waiting for programmers..." << endl;
+		}
+		events = thread(&CGang::handleEvents, this, &stopEvents);
+	}
+
+	// start a thread for each arriving programmer until all jobs are done
+	while (remaining > 0) {
+		bool active = false;
+
+		for (deque<string>::iterator it = arrivals.begin(); it != arrivals.end(); ) {
+			unit_t *unit = attach(*it);
+
+			// a replugged programmer waits until the thread of its old connection ended
+			if (unit == NULL) {
+				it++;
+				continue;
+			}
+			it = arrivals.erase(it);
+			unit->active = true;
+			threads.push_back(thread(&CGang::work, this, unit, frequency));
+		}
+
+		for (unsigned int i=0; i<units.size(); i++) {
+			active |= units[i].active;
+		}
+		if (active == false && hotplug == false) {
+			break;
+		}
+		changed.wait(guard);
+	}
+	guard.unlock();
+
+	for (unsigned int i=0; i<threads.size(); i++) {
+		threads[i].join();
+	}
+	if (hotplug == true) {
+		stopEvents.store(true);
+		events.join();
+	}
+	silence(false);
+	total = seconds(start, chrono::steady_clock::now());
+
+	cout << endl;
+	for (unsigned int i=0; i<targets.size(); i++) {
+		target_t *target = &targets[i];
+
+		if (target->result == 0) {
+			passed++;
+			continue;
+		}
+		cerr << "Target " << i+1;
+		if (target->device.size() != 0) {
+			cerr << " (" << target->device << ")";
+		}
+		cerr << ": " << ((target->result == VERIFY_ERROR_NUMBER) ? "verify failed" : target->error) << endl;
+
+		if (returnValue != COMMON_ERROR_NUMBER) {
+			returnValue = target->result;
+		}
+	}
+
+	cout.precision(2);
+	for (unsigned int i=0; i<units.size(); i++) {
+		unit_t *unit = &units[i];
+
+		cout << "Programmer " << unit->device << ": " << unit->jobs << " targets, " << unit->failed << " failed, "
+				<< fixed << (total > 0 ? unit->jobs * 60 / total : 0) << " targets/min, "
+				<< (total > 0 ? unit->busyTime * 100 / total : 0) << "% busy";
+		if (unit->error.size() != 0) {
+			cout << ", " << unit->error;
+		}
+		cout << endl;
+	}
+
+	cout << passed << " of " << targets.size() << " targets succeeded in " << total << " s." << endl;
+	return returnValue;
+}
+
+/*
+ * thread of one programmer executing a shared job
+ */
+void CGang::run(unit_t *unit, CJob *job, int frequency) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point connected = start;
+	CAVRprog *prog = NULL;
+
+	try {
+		prog = new CAVRprog(unit->device, context);
+		prog->connect(job->getMcu(), frequency, job->getSocket());
+		connected = chrono::steady_clock::now();
+		unit->result = job->execute(prog);
+	}
+	catch (ExceptionBase &e) {
+		unit->result = COMMON_ERROR_NUMBER;
+		unit->error = e.what();
+		boost::replace_all(unit->error, "\n", " ");
+	}
+	if (connected == start) {
+		connected = chrono::steady_clock::now();
+	}
+	unit->connectTime = seconds(start, connected);
+	unit->programTime = seconds(connected, chrono::steady_clock::now());
+
+	if (prog != NULL) {
+		delete prog;
+	}
+}
+
+/*
+ * thread of one programmer executing the queued jobs, it ends when all jobs are done or the programmer is lost
+ */
+void CGang::work(unit_t *unit, int frequency) {
+	CAVRprog *prog = NULL;
+	int t;
+
+	try {
+		prog = open(unit);
+	}
+	catch (ExceptionBase &e) {
+		unit->error = e.what();
+		boost::replace_all(unit->error, "\n", " ");
+	}
+
+	while (prog != NULL && (t = next(unit)) >= 0) {
+		target_t *target = &targets[t];
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		map<string, int>::iterator known = unit->frequencies.find(target->image);
+
+		target->device = unit->device;
+		try {
+			prog->connect(target->job->getMcu(), frequency, target->job->getSocket(), (known != unit->frequencies.end()) ? known->second : FREQUENCY_AUTODETECT);
+			unit->frequencies[target->image] = prog->getFrequency();
+			target->result = target->job->execute(prog);
+			prog->disconnect();
+		}
+		catch (USBCommunicationException &e) {
+			target->result = COMMON_ERROR_NUMBER;
+			target->error = e.what();
+			unit->error = e.what();
+		}
+		catch (ExceptionBase &e) {
+			target->result = COMMON_ERROR_NUMBER;
+			target->error = e.what();
+			prog->disconnect();
+		}
+		boost::replace_all(target->error, "\n", " ");
+		boost::replace_all(unit->error, "\n", " ");
+
+		unit->jobs++;
+		if (target->result != 0) {
+			unit->failed++;
+		}
+		unit->busyTime += seconds(start, chrono::steady_clock::now());
+
+		lock_guard<mutex> guard(lock);
+		remaining--;
+		changed.notify_all();
+
+		// the programmer is lost
+		if (unit->error.size() != 0) {
+			break;
+		}
+	}
+
+	if (prog != NULL) {
+		delete prog;
+	}
+
+	// the queued jobs are taken over by the other programmers
+	lock_guard<mutex> guard(lock);
+	pending.insert(pending.end(), unit->queue.begin(), unit->queue.end());
+	unit->queue.clear();
+	unit->active = false;
+	changed.notify_all();
+}
+
+/*
+ * next job of a programmer, -1 if all jobs are done or the programmer was unplugged
+ *
+ * An empty queue takes a job which was left by a lost programmer, or steals from the end of the longest queue,
+ * a job with a known image is preferred. If no job is left for the programmer, it waits until the running
+ * jobs are done or a lost programmer leaves its jobs.
+ */
+int CGang::next(unit_t *unit) {
+	unique_lock<mutex> guard(lock);
+	int t;
+
+	while (remaining > 0 && unit->attached == true) {
+		unit_t *victim = NULL;
+
+		if (unit->queue.size() != 0) {
+			t = unit->queue.front();
+			unit->queue.pop_front();
+			return t;
+		}
+		if (pending.size() != 0) {
+			t = pending.front();
+			pending.pop_front();
+			return t;
+		}
+
+		for (unsigned int u=0; u<units.size(); u++) {
+			deque<int> *queue = &units[u].queue;
+
+			for (int i=queue->size()-1; i>=0; i--) {
+				if (unit->frequencies.find(targets[(*queue)[i]].image) != unit->frequencies.end()) {
+					t = (*queue)[i];
+					queue->erase(queue->begin() + i);
+					return t;
+				}
+			}
+			if (victim == NULL || queue->size() > victim->queue.size()) {
+				victim = &units[u];
+			}
+		}
+
+		if (victim != NULL && victim->queue.size() != 0) {
+			t = victim->queue.back();
+			victim->queue.pop_back();
+			return t;
+		}
+
+		changed.wait(guard);
+	}
+	return -1;
+}
+
+/*
+ * open the programmer of a thread, an arrived programmer gets some time until it is accessible
+ */
+CAVRprog *CGang::open(unit_t *unit) {
+	for (int attempt=1; ; attempt++) {
+		try {
+			return new CAVRprog(unit->device, context);
+		}
+		catch (USBCommunicationException &e) {
+			if (hotplug == false || attempt == HOTPLUG_OPEN_ATTEMPTS) {
+				throw;
+			}
+			COut::d("Open programmer " + unit->device + " failed: " + e.what());
+		}
+		this_thread::sleep_for(chrono::milliseconds(HOTPLUG_OPEN_DELAY));
+	}
+}
+
+/*
+ * unit of a programmer, NULL if a thread already works for it (the caller holds the lock, except in the constructor)
+ */
+CGang::unit_t *CGang::attach(string device) {
+	unit_t unit;
+
+	for (unsigned int i=0; i<units.size(); i++) {
+		if (units[i].device.compare(device) == 0) {
+			if (units[i].active == true) {
+				return NULL;
+			}
+			units[i].error = "";
+			units[i].attached = true;
+			return &units[i];
+		}
+	}
+
+	unit.device = device;
+	unit.result = COMMON_ERROR_NUMBER;
+	unit.connectTime = 0;
+	unit.programTime = 0;
+	unit.jobs = 0;
+	unit.failed = 0;
+	unit.busyTime = 0;
+	unit.active = false;
+	unit.attached = true;
+	units.push_back(unit);
+	return &units.back();
+}
+
+/*
+ * thread which handles the hotplug events, the programmer threads handle the events of their own transfers
+ *
+ * This thread waits for no transfer, hence there is no completion flag. 'stop' is checked at least every 100 ms.
+ */
+void CGang::handleEvents(atomic<bool> *stop) {
+	while (stop->load() == false) {
+		struct timeval timeout = {0, 100000};
+
+		libusb_handle_events_timeout_completed(context, &timeout, NULL);
+	}
+}
+
+#if HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+/*
+ * called by libusb when a programmer was connected or disconnected
+ */
+int LIBUSB_CALL CGang::hotplugCallback(libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *gang) {
+	CGang *self = static_cast<CGang*>(gang);
+	string name = CFormat::intToString(libusb_get_bus_number(device)) + ":" + CFormat::intToString(libusb_get_device_address(device));
+
+	lock_guard<mutex> guard(self->lock);
+
+	if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+		COut::d("Programmer " + name + " arrived.");
+		self->arrivals.push_back(name);
+	}
+	else {
+		// a running job of the programmer fails with the next transfer, afterwards the thread ends
+		COut::d("Programmer " + name + " left.");
+		for (unsigned int i=0; i<self->units.size(); i++) {
+			if (self->units[i].device.compare(name) == 0) {
+				self->units[i].attached = false;
+			}
+		}
+	}
+	self->changed.notify_all();
+	return 0;
+}
+#endif
+
+/*
+ * discard the output of the threads (unless debug output is enabled) and disable the progressbars
+ */
+void CGang::silence(bool enable) {
+	CProgressbar::setEnabled(!enable);
+
+	if (enable == true && COut::isSet(1) == false) {
+		out = cout.rdbuf(&nullBuffer);
+	}
+	else if (enable == false && out != NULL) {
+		cout.rdbuf(out);
+		out = NULL;
+	}
+}
+
+double CGang::seconds(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+	return chrono::duration_cast<chrono::duration<double> >(end - start).count();
+}
+
+CGang::~CGang() {
+	if (context != NULL) {
+#if HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+		if (hotplug == true) {
+			libusb_hotplug_deregister_callback(context, callback);
+		}
+#endif
+		libusb_exit(context);
+	}
+}
@@ -0,0 +1,150 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CGANG_H_
+#define CGANG_H_
+
+#include <libusb-1.0/libusb.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "avrprog.h"
+#include "CJob.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Programs targets with several programmers at once (gang programming).
+ * @throw	USBCommunicationException if libusb cannot be initialized or a programmer is not found.
+ *
+ * All programmers are opened in one libusb context. Each of them is driven by its own thread.
+ * The messages of the threads are suppressed (unless debug output is enabled), instead the results
+ * and the timings of each programmer are printed after all of them finished.
+ *
+ * A single job is executed by every programmer, it is loaded once and shared by all threads
+ * (see CJob::share()).
+ *
+ * The jobs of a job file are distributed to the programmers. Each programmer has its own queue, jobs
+ * with the same input files are queued at the same programmer. A programmer with an empty queue steals
+ * a job from the longest queue of another one, preferably a job whose input files it programmed before.
+ * The frequency which a programmer detected for some input files is tried first for the next job with
+ * the same files (see CAVRprog::connect()).
+ *
+ * With hotplug, the programmers are not searched once. A libusb hotplug callback reports each arriving
+ * programmer, it is opened at once and starts to take jobs. A programmer which is unplugged ends its
+ * thread, its queued jobs are taken over by the others or by the next programmer which arrives.
+ */
+class CGang {
+public:
+	/**
+	 * @brief	Find the programmers.
+	 *
+	 * @param	devices		\a all for all connected programmers, a comma separated list of
+	 * 						USB bus and device ids ("bus:device,bus:device,..."), or \a hotplug to
+	 * 						use all programmers which are connected now or later (only with a job file).
+	 */
+	CGang(string devices);
+	virtual ~CGang();
+
+	/**
+	 * @brief	Execute \a job with all programmers.
+	 *
+	 * @param	job			Loaded job, see CJob::load().
+	 * @param	frequency	Device frequency, see CAVRprog::connect().
+	 * @return	0 if all targets succeeded, VERIFY_ERROR_NUMBER if a verify operation failed
+	 * 			and COMMON_ERROR_NUMBER if any other error occurred.
+	 */
+	int execute(CJob *job, int frequency);
+
+	/**
+	 * @brief	Distribute \a jobs to the programmers.
+	 *
+	 * Each job is executed once by one of the programmers. The failed jobs, and the number of jobs,
+	 * the throughput and the utilization of each programmer are printed at the end.
+	 *
+	 * With hotplug, the method returns when all jobs were executed, and waits for programmers as long
+	 * as jobs are left.
+	 *
+	 * @param	jobs		Loaded jobs, e.g. of a job file.
+	 * @param	frequency	Device frequency, see CAVRprog::connect().
+	 * @return	0 if all targets succeeded, VERIFY_ERROR_NUMBER if a verify operation failed
+	 * 			and COMMON_ERROR_NUMBER if any other error occurred.
+	 */
+	int execute(vector<CJob*> jobs, int frequency);
+
+private:
+	typedef struct {
+		CJob *job;
+		string image;			// input files of the job
+		int result;				// return value of CJob::execute(), COMMON_ERROR_NUMBER on errors
+		string error;
+		string device;			// programmer which executed the job
+	} target_t;
+
+	typedef struct {
+		string device;			// "bus:device"
+		int result;				// return value of CJob::execute(), COMMON_ERROR_NUMBER on errors
+		string error;
+		double connectTime;		// seconds
+		double programTime;
+		deque<int> queue;		// targets which are assigned to this programmer
+		map<string, int> frequencies;	// detected frequency of each programmed image
+		int jobs;
+		int failed;
+		double busyTime;		// seconds
+		bool active;			// a thread works for the programmer
+		bool attached;			// false after the programmer was unplugged
+	} unit_t;
+
+	static const int HOTPLUG_OPEN_ATTEMPTS = 20;		// an arrived programmer may not be accessible until udev changed its permissions
+	static const int HOTPLUG_OPEN_DELAY = 50;		// ms between the attempts
+
+	libusb_context *context;
+	bool hotplug;
+#if HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+	libusb_hotplug_callback_handle callback;
+#endif
+	deque<unit_t> units;		// references remain valid when programmers arrive
+	vector<target_t> targets;
+	int remaining;				// targets which were not executed yet
+	deque<int> pending;			// targets which are not queued at a programmer (e.g. of a lost one)
+	deque<string> arrivals;		// arrived programmers without thread
+	mutex lock;					// protects the queues, remaining and arrivals
+	condition_variable changed;	// a programmer arrived or a thread ended
+
+	void run(unit_t *unit, CJob *job, int frequency);
+	void work(unit_t *unit, int frequency);
+	int next(unit_t *unit);
+	CAVRprog *open(unit_t *unit);
+	unit_t *attach(string device);
+	void handleEvents(atomic<bool> *stop);
+#if HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+	static int LIBUSB_CALL hotplugCallback(libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *gang);
+#endif
+	void silence(bool enable);
+	static double seconds(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+};
+
+#endif /* CGANG_H_ */
@@ -0,0 +1,79 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CGzipInputStream.h"
+#include <cstring>
+
+using namespace std;
+
+CGzipInputStream::CGzipInputStream(CInputStream *_source) : CInputStream(_source->getName()), source(_source), eof(false), member(false), flush(false) {
+	memset(&stream, 0, sizeof(stream));
+
+	// 15 + 32: maximal window size, detect gzip and zlib headers
+	if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+		delete source;
+		throw StreamException("Could not initialize zlib for '" + name + "'.");
+	}
+	input = new uint8_t[BLOCK_SIZE];
+}
+
+int CGzipInputStream::read(uint8_t *buffer, int size) {
+	stream.next_out = buffer;
+	stream.avail_out = size;
+
+	// return as soon as some output is available
+	while (stream.avail_out == (unsigned int)size) {
+		int ret;
+
+		if (stream.avail_in == 0 && !flush) {
+			if (eof) {
+				if (member) {
+					throw StreamException("Unexpected end of compressed data in '" + name + "'.");
+				}
+				break;
+			}
+			stream.next_in = input;
+			stream.avail_in = source->read(input, BLOCK_SIZE);
+			if (stream.avail_in == 0) {
+				eof = true;
+				continue;
+			}
+		}
+
+		member = true;
+		ret = inflate(&stream, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			// another gzip member may follow
+			inflateReset(&stream);
+			member = false;
+		}
+		else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			throw StreamException("Error while decompressing '" + name + "' (" + (stream.msg != NULL ? stream.msg : "corrupt data") + ").");
+		}
+		flush = (stream.avail_out == 0);
+	}
+
+	return size - stream.avail_out;
+}
+
+CGzipInputStream::~CGzipInputStream() {
+	inflateEnd(&stream);
+	delete[] input;
+	delete source;
+}
@@ -0,0 +1,53 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CGZIPINPUTSTREAM_H_
+#define CGZIPINPUTSTREAM_H_
+
+#include "CInputStream.h"
+#include <zlib.h>
+
+/**
+ * @brief	Decompresses a gzip (or zlib) compressed stream on the fly.
+ * @throw	StreamException on errors.
+ *
+ * Concatenated gzip members are decompressed one after the other, like gunzip does.
+ */
+class CGzipInputStream : public CInputStream {
+public:
+	/**
+	 * @param	source	Stream with the compressed data, it is deleted by this object.
+	 */
+	CGzipInputStream(CInputStream *source);
+	virtual ~CGzipInputStream();
+
+	virtual int read(uint8_t *buffer, int size);
+
+private:
+	static const int BLOCK_SIZE = 65536;	// compressed bytes read from the source at once
+
+	CInputStream *source;
+	z_stream stream;
+	uint8_t *input;
+	bool eof;			// end of source reached
+	bool member;		// inside of a gzip member
+	bool flush;			// the output buffer was filled, inflate() may hold more output
+};
+
+#endif /* CGZIPINPUTSTREAM_H_ */
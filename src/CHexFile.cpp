@@ -24,54 +24,268 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
 #include "CHexFile.h"
-#include "config.h"
-#include <bfd.h>
-#include <iostream>
+#include "CMemoryKernels.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 
 using namespace std;
 
-CHexFile::CHexFile(string _path) : path(_path) {
+const int CHexFile::RECORD_SIZE;
 
+CHexFile::CHexFile(string _path) : path(_path), fill(0xff), minGap(0), upper(0), fd(-1), output(NULL), end(NULL), position(0), pendingLen(0), empty(0) {
+
+}
+
+void CHexFile::setGaps(uint8_t fill, int minGap) {
+	this->fill = fill;
+	this->minGap = minGap;
 }
 
 void CHexFile::save(uint8_t *buffer, int size) {
-	bfd *outputFile = NULL;
-	asection *section;
+	begin(size);
+	append(buffer, size);
+	finish();
+}
+
+/*
+ * A regular file is written to path.tmp and renamed by finish(), so an incomplete file never
+ * replaces an existing one. Standard output and other special files are written directly.
+ */
+void CHexFile::begin(int size) {
+	struct stat st;
 
-	bfd_init();
+	tmpPath.clear();
+	if (path.compare("-") == 0) {
+		fd = STDOUT_FILENO;
+	}
+	else if (stat(path.c_str(), &st) == 0 && !S_ISREG(st.st_mode)) {
+		fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+	}
+	else {
+		tmpPath = path + ".tmp";
+		fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	}
+	if (fd < 0) {
+		throw FileException("Could not write to '" + path + "'.\n" + strerror(errno));
+	}
+
+	if (output == NULL) {
+		output = new char[OUTPUT_SIZE];
+	}
+	end = beginRecords(output, size);
+	position = 0;
+	pendingLen = 0;
+	empty = 0;
+}
+
+/*
+ * Records are aligned to RECORD_SIZE, complete records are added at once and the rest
+ * of 'data' is kept in 'pending' until the next call.
+ */
+void CHexFile::append(const uint8_t *data, int len) {
+	if (pendingLen > 0) {
+		int n = min(RECORD_SIZE - pendingLen, len);
+
+		memcpy(pending + pendingLen, data, n);
+		pendingLen += n;
+		data += n;
+		len -= n;
+		if (pendingLen < RECORD_SIZE) {
+			return;
+		}
+		addRecord(position, pending, RECORD_SIZE);
+		position += RECORD_SIZE;
+		pendingLen = 0;
+	}
 
-	// open new file
-	outputFile = bfd_openw(path.c_str(), "ihex");
-	if (outputFile == NULL) {
-		throw FileException("Could not write to '" + path + "'.\n" + bfd_errmsg(bfd_get_error()));
+	while (len >= RECORD_SIZE) {
+		addRecord(position, data, RECORD_SIZE);
+		position += RECORD_SIZE;
+		data += RECORD_SIZE;
+		len -= RECORD_SIZE;
 	}
 
-	// set format to object
-	if (!bfd_set_format(outputFile, bfd_object)) {
-		throw FileException("Could not write to '" + path + "'.\n" + bfd_errmsg(bfd_get_error()));
+	memcpy(pending, data, len);
+	pendingLen = len;
+}
+
+void CHexFile::finish() {
+	if (pendingLen > 0) {
+		addRecord(position, pending, pendingLen);
+		position += pendingLen;
+		pendingLen = 0;
 	}
 
-	// create a new section
-	section = bfd_make_section_with_flags(outputFile, ".sec1", SEC_HAS_CONTENTS | SEC_ALLOC | SEC_LOAD);
-	if (section == NULL) {
-		throw FileException("Could not write to '" + path + "'.\n" + bfd_errmsg(bfd_get_error()));
+	// a run of empty records at the end is omitted like a gap
+	if (empty < minGap) {
+		addFill(position - empty, empty);
 	}
+	empty = 0;
+
+	flush();
+	end = endRecords(end);
+	flush();
 
-	// set size to fit to buffer
-	if (!bfd_set_section_size(outputFile, section, size)) {
-		throw FileException("Could not write to '" + path + "'.\n" + bfd_errmsg(bfd_get_error()));
+	if (fd != STDOUT_FILENO && close(fd) != 0) {
+		fd = -1;
+		discard();
+		throw FileException("Could not write to '" + path + "'.\n" + strerror(errno));
 	}
+	fd = -1;
 
-	// write content to the created section
-	if (!bfd_set_section_contents(outputFile, section, buffer, 0, size)) {
-		throw FileException("Could not write to '" + path + "'.\n" + bfd_errmsg(bfd_get_error()));
+	if (tmpPath.size() != 0) {
+		if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+			discard();
+			throw FileException("Could not write to '" + path + "'.\n" + strerror(errno));
+		}
+		tmpPath.clear();
 	}
+}
 
-	bfd_close(outputFile);
+/*
+ * remove the temporary file of an incomplete write
+ */
+void CHexFile::discard() {
+	if (tmpPath.size() != 0) {
+		unlink(tmpPath.c_str());
+		tmpPath.clear();
+	}
 }
 
-CHexFile::~CHexFile() {
+/*
+ * A segment ends in front of a run of at least minGap empty bytes. Whether a run reaches this
+ * length is known only at its end, hence empty records are counted and written by addFill()
+ * when a shorter run is followed by a record with content.
+ */
+void CHexFile::addRecord(uint32_t address, const uint8_t *data, int len) {
+	if (minGap > 0 && CMemoryKernels::isEmpty(data, len, fill)) {
+		empty += len;
+		return;
+	}
+
+	if (empty < minGap) {
+		addFill(address - empty, empty);
+	}
+	empty = 0;
+
+	addData(address, data, len);
+}
 
+/*
+ * format the data records of at most RECORD_SIZE bytes
+ */
+void CHexFile::addData(uint32_t address, const uint8_t *data, int len) {
+	if (end - output > OUTPUT_SIZE - maxLength(RECORD_SIZE)) {
+		flush();
+	}
+	end = dataRecords(end, address, data, len);
+}
+
+/*
+ * format 'len' empty bytes
+ */
+void CHexFile::addFill(uint32_t address, int len) {
+	uint8_t data[RECORD_SIZE];
+
+	memset(data, fill, sizeof(data));
+	for (int i=0; i<len; i+=RECORD_SIZE) {
+		addData(address + i, data, min(RECORD_SIZE, len - i));
+	}
+}
+
+/*
+ * upper bound of the file size: data records, extended address records and the end of file record
+ */
+int CHexFile::maxLength(int size) {
+	return (size / RECORD_SIZE + 1) * (13 + 2 * RECORD_SIZE) + (size / 0x10000 + 1) * 17 + 13;
+}
+
+char *CHexFile::beginRecords(char *out, int size) {
+	upper = 0;
+	return out;
+}
+
+/*
+ * An extended linear address record is inserted whenever the upper 16 bit of the address
+ * differ from 'upper', which holds the upper address bits of the previous record.
+ */
+char *CHexFile::dataRecords(char *out, uint32_t address, const uint8_t *data, int len) {
+	for (int i=0; i<len; ) {
+		// a record must not cross a 64 KiB boundary
+		int n = min(min(RECORD_SIZE, len - i), (int)(0x10000 - (address & 0xffff)));
+
+		if ((address >> 16) != upper) {
+			uint8_t ext[] = {(uint8_t)(address >> 24), (uint8_t)(address >> 16)};
+			upper = address >> 16;
+			out = record(out, 0x04, 0, ext, sizeof(ext));
+		}
+
+		out = record(out, 0x00, address & 0xffff, data + i, n);
+		address += n;
+		i += n;
+	}
+	return out;
+}
+
+char *CHexFile::endRecords(char *out) {
+	return record(out, 0x01, 0, NULL, 0);
+}
+
+/*
+ * format one record
+ */
+char *CHexFile::record(char *out, uint8_t type, uint16_t address, const uint8_t *data, int len) {
+	uint8_t header[] = {(uint8_t)len, (uint8_t)(address >> 8), (uint8_t)address, type};
+	uint8_t checksum;
+
+	checksum = CMemoryKernels::checksum(header, sizeof(header)) + CMemoryKernels::checksum(data, len);
+	checksum = -checksum;
+
+	*out++ = ':';
+	CMemoryKernels::toHex(header, sizeof(header), out);
+	out += 2 * sizeof(header);
+	CMemoryKernels::toHex(data, len, out);
+	out += 2 * len;
+	CMemoryKernels::toHex(&checksum, 1, out);
+	out += 2;
+	*out++ = '\r';
+	*out++ = '\n';
+
+	return out;
+}
+
+/*
+ * write the formatted records
+ */
+void CHexFile::flush() {
+	const char *data = output;
+	int len = end - output;
+
+	while (len > 0) {
+		ssize_t written = ::write(fd, data, len);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written < 0) {
+			throw FileException("Could not write to '" + path + "'.\n" + strerror(errno));
+		}
+		data += written;
+		len -= written;
+	}
+	end = output;
+}
+
+CHexFile::~CHexFile() {
+	if (fd >= 0 && fd != STDOUT_FILENO) {
+		close(fd);
+	}
+	discard();		// not finished, e.g. the readout failed
+	delete[] output;
 }
 
 
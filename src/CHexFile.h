@@ -29,6 +29,21 @@ using namespace std;
 /**
  * @brief	Writes a ihex file.
  * @throw	FileException on errors.
+ *
+ * The records are formatted into a buffer of OUTPUT_SIZE bytes (the hex digits are encoded with
+ * CMemoryKernels::toHex()), which is written whenever it is full. Data records contain RECORD_SIZE
+ * bytes, extended linear address records are inserted for content above 64 KiB. Lines end with
+ * CR LF, like the files written by libbfd.
+ *
+ * save() writes a whole buffer at once. With begin(), append() and finish() a file is written
+ * while its content arrives (see CReadoutStream), the output is the same.
+ *
+ * With setGaps() the file becomes sparse: runs of empty records are omitted, hence a readout with
+ * an application at the beginning and a bootloader at the end of flash memory only contains these two
+ * segments.
+ *
+ * Other formats (see CSRecordFile and CBinaryFile) derive from this class and replace the formatting
+ * of the records.
  */
 class CHexFile {
 public:
@@ -49,11 +64,103 @@ public:
 	 * @param	buffer	Byte array of data, which should be stored.
 	 * @param	size	Length of the \a buffer array.
 	 */
-	void save(uint8_t *buffer, int size);
+	virtual void save(uint8_t *buffer, int size);
 	virtual ~CHexFile();
 
+	/**
+	 * @brief	Start writing the file, existing files are overridden.
+	 *
+	 * The path "-" writes to standard output. A regular file is only replaced by finish(),
+	 * if the object is destroyed before, an existing file is left untouched.
+	 *
+	 * @param	size	Size of the whole content, e.g. of the memory which is read.
+	 */
+	void begin(int size);
+
+	/**
+	 * @brief	Add the next bytes of the content.
+	 *
+	 * The content is appended to the previous one, the first byte has the address 0.
+	 *
+	 * @param	data	Byte array of data.
+	 * @param	len		Length of \a data.
+	 */
+	void append(const uint8_t *data, int len);
+
+	/**
+	 * @brief	Write the remaining records and close the file.
+	 */
+	void finish();
+
+	/**
+	 * @brief	Omit empty regions in files written by save().
+	 *
+	 * The buffer is examined in records of RECORD_SIZE bytes. A run of records, which only contain
+	 * \a fill bytes, is omitted if it is at least \a minGap bytes long.
+	 *
+	 * @param	fill	Value of an empty byte.
+	 * @param	minGap	Minimal size of an omitted region in bytes, 0 writes the whole buffer.
+	 */
+	virtual void setGaps(uint8_t fill, int minGap);
+
 protected:
+	static const int RECORD_SIZE = 16;		///< data bytes per record
+
 	string path;	///< path of the file
+
+	/**
+	 * @brief	Get an upper bound of the formatted file size.
+	 * @param	size	Number of data bytes.
+	 */
+	virtual int maxLength(int size);
+
+	/**
+	 * @brief	Format the records in front of the first data record.
+	 * @param	out		Receives the formatted records.
+	 * @param	size	Size of the buffer passed to save().
+	 * @return	End of the formatted records.
+	 */
+	virtual char *beginRecords(char *out, int size);
+
+	/**
+	 * @brief	Format a segment of consecutive data as data records.
+	 * @param	out		Receives the formatted records.
+	 * @param	address	Address of the first byte of \a data.
+	 * @param	data	Content of the segment.
+	 * @param	len		Length of \a data.
+	 * @return	End of the formatted records.
+	 */
+	virtual char *dataRecords(char *out, uint32_t address, const uint8_t *data, int len);
+
+	/**
+	 * @brief	Format the records behind the last data record.
+	 * @param	out		Receives the formatted records.
+	 * @return	End of the formatted records.
+	 */
+	virtual char *endRecords(char *out);
+
+private:
+	static const int OUTPUT_SIZE = 65536;	// bytes of formatted records written at once
+
+	uint8_t fill;
+	int minGap;
+	uint32_t upper;		// upper 16 bit of the address of the previous data record
+
+	int fd;							// output file, -1 if not open
+	string tmpPath;					// temporary file which is renamed to path by finish(), empty if path is written directly
+	char *output;					// formatted records which are not written yet
+	char *end;						// end of the formatted records in output
+	uint32_t position;				// address of the first byte in pending
+	uint8_t pending[RECORD_SIZE];	// incomplete record
+	int pendingLen;
+	int empty;						// length of the run of empty records in front of address
+
+	void addRecord(uint32_t address, const uint8_t *data, int len);
+	void addData(uint32_t address, const uint8_t *data, int len);
+	void addFill(uint32_t address, int len);
+	void flush();
+	void discard();
+	char *record(char *out, uint8_t type, uint16_t address, const uint8_t *data, int len);
 };
 
 /**
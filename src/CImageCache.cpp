@@ -0,0 +1,467 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CImageCache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "CFormat.h"
+#include "COut.h"
+#include "CSha256.h"
+
+using namespace std;
+
+static const char MAGIC[8] = {'A', 'V', 'R', 'P', 'I', 'M', 'G', 0};
+
+/// temporary files of crashed processes are removed after this time (s)
+static const int STALE_TMP_AGE = 3600;
+
+CImageCache::CImageCache(string _directory, uint64_t _maxSize) : directory(_directory), maxSize(_maxSize), enabled(true), contentKnown(false), contentSize(0) {
+	if (directory.size() == 0) {
+		char const *home = getenv("HOME");
+
+		if (home == NULL) {
+			COut::d("Image cache disabled, HOME is not set.");
+			enabled = false;
+			return;
+		}
+		// the user config directory may not exist yet
+		mkdir((home + (string)"/" + HOME_CONFIG_DIR).c_str(), 0755);
+		directory = home + (string)"/" + HOME_CONFIG_DIR + "cache/";
+	}
+
+	if (maxSize == 0) {
+		enabled = false;
+	}
+	else if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+		COut::d("Image cache disabled, cannot create '" + directory + "' (" + strerror(errno) + ").");
+		enabled = false;
+	}
+}
+
+bool CImageCache::load(string path, string parameters, CMemorySink *sink) {
+	uint8_t identity[CSha256::SIZE];
+	uint8_t digest[CSha256::SIZE];
+	uint64_t size;
+
+	contentKnown = false;
+	if (!enabled || !fileDigest(path, parameters, identity, &size)) {
+		return false;
+	}
+
+	// unchanged file
+	if (readReference(referencePath(keyOf(identity)), identity, digest) && loadImage(digest, size, sink)) {
+		COut::d("Load cached image of '" + path + "'.");
+		return true;
+	}
+
+	// changed or new file, maybe with the content of a cached one
+	if (!contentDigestOf(path, parameters, contentDigest, &contentSize)) {
+		return false;
+	}
+	contentKnown = true;
+	if (loadImage(contentDigest, contentSize, sink)) {
+		COut::d("Load cached image of '" + path + "' (same content).");
+		writeReference(identity, contentDigest);
+		return true;
+	}
+	return false;
+}
+
+void CImageCache::store(string path, string parameters, CMemoryImage *image) {
+	const CMemoryImage::segments_t &segments = image->getSegments();
+	header_t header;
+	vector<segment_t> table;
+	uint8_t identity[CSha256::SIZE];
+	uint64_t size;
+	uint64_t dataSize = 0;
+
+	if (!enabled || !fileDigest(path, parameters, identity, &size)) {
+		return;
+	}
+	if (!contentKnown && !contentDigestOf(path, parameters, contentDigest, &contentSize)) {
+		return;
+	}
+	contentKnown = true;
+
+	for (CMemoryImage::segments_t::const_iterator it = segments.begin(); it != segments.end(); it++) {
+		segment_t segment;
+
+		segment.address = it->first;
+		segment.length = it->second.size();
+		segment.offset = dataSize;
+		table.push_back(segment);
+		dataSize += segment.length;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = FORMAT_VERSION;
+	header.numOfSegments = table.size();
+	header.fileSize = contentSize;
+	header.dataSize = dataSize;
+	memcpy(header.digest, contentDigest, CSha256::SIZE);
+
+	size_t imageSize = sizeof(header_t) + table.size() * sizeof(segment_t) + dataSize;
+	if (imageSize > maxSize) {
+		return;
+	}
+
+	vector<uint8_t> file(imageSize);
+	uint8_t *pos = file.data();
+	memcpy(pos, &header, sizeof(header));
+	pos += sizeof(header);
+	memcpy(pos, table.data(), table.size() * sizeof(segment_t));
+	pos += table.size() * sizeof(segment_t);
+	for (CMemoryImage::segments_t::const_iterator it = segments.begin(); it != segments.end(); it++) {
+		memcpy(pos, it->second.data(), it->second.size());
+		pos += it->second.size();
+	}
+
+	if (writeFile(imagePath(keyOf(contentDigest)), file.data(), file.size()) && writeReference(identity, contentDigest)) {
+		COut::d("Stored image of '" + path + "' in the cache.");
+	}
+	evict();
+}
+
+/*
+ * digest of a file which is known by its path, size, inode and modification time
+ */
+bool CImageCache::fileDigest(string path, string parameters, uint8_t *digest, uint64_t *size) {
+	struct stat st;
+	char *real;
+	CSha256 sha;
+
+	if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+		return false;
+	}
+	real = realpath(path.c_str(), NULL);
+	if (real == NULL) {
+		return false;
+	}
+
+	uint64_t identity[5] = {(uint64_t)st.st_dev, (uint64_t)st.st_ino, (uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec};
+	sha.update(real, strlen(real) + 1);
+	sha.update(identity, sizeof(identity));
+	sha.update(parameters.data(), parameters.size());
+	sha.final(digest);
+	*size = st.st_size;
+	free(real);
+	return true;
+}
+
+/*
+ * digest of the file content and the parse parameters, the file is mapped and hashed
+ */
+bool CImageCache::contentDigestOf(string path, string parameters, uint8_t *digest, uint64_t *size) {
+	struct stat st;
+	void *content;
+	CSha256 sha;
+	int fd;
+
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	content = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (content == MAP_FAILED) {
+		return false;
+	}
+
+	sha.update(content, st.st_size);
+	sha.update(parameters.data(), parameters.size());
+	sha.final(digest);
+	munmap(content, st.st_size);
+
+	*size = st.st_size;
+	return true;
+}
+
+/*
+ * The whole image is checked before the first segment is passed to the sink, a broken image is a cache miss.
+ * The file name only contains the first 64 bits of the digest, hence the whole digest and the file size
+ * are compared as well.
+ */
+bool CImageCache::loadImage(const uint8_t *digest, uint64_t fileSize, CMemorySink *sink) {
+	string path = imagePath(keyOf(digest));
+	struct stat st;
+	uint8_t *mapping;
+	size_t tableEnd;
+	bool valid = true;
+	int fd;
+
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header_t)) {
+		close(fd);
+		return false;
+	}
+	mapping = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+
+	const header_t *header = (const header_t*)mapping;
+	const segment_t *table = (const segment_t*)(mapping + sizeof(header_t));
+
+	tableEnd = sizeof(header_t) + (size_t)header->numOfSegments * sizeof(segment_t);
+	if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != FORMAT_VERSION
+			|| header->fileSize != fileSize || memcmp(header->digest, digest, CSha256::SIZE) != 0
+			|| tableEnd + header->dataSize != (size_t)st.st_size) {
+		valid = false;
+	}
+	for (uint32_t i=0; valid && i<header->numOfSegments; i++) {
+		if (table[i].length == 0 || table[i].offset + table[i].length > header->dataSize) {
+			valid = false;
+		}
+	}
+
+	if (valid) {
+		for (uint32_t i=0; i<header->numOfSegments; i++) {
+			sink->addData(table[i].address, mapping + tableEnd + table[i].offset, table[i].length);
+		}
+		// least recently used images are evicted first
+		utimensat(AT_FDCWD, path.c_str(), NULL, 0);
+	}
+	else {
+		COut::d("Ignore broken cache entry '" + path + "'.");
+	}
+
+	munmap(mapping, st.st_size);
+	return valid;
+}
+
+/*
+ * A reference is a line with the digest of the file (see fileDigest()) and the digest of its content.
+ * The first one is compared with 'identity' (unless it is NULL), since the file name only contains
+ * 64 bits of it.
+ */
+bool CImageCache::readReference(string refPath, const uint8_t *identity, uint8_t *digest) {
+	char line[4 * CSha256::SIZE + 8];
+	FILE *file;
+	bool found;
+
+	file = fopen(refPath.c_str(), "r");
+	if (file == NULL) {
+		return false;
+	}
+	found = (fgets(line, sizeof(line), file) != NULL);
+	fclose(file);
+
+	if (!found || strlen(line) < 4 * CSha256::SIZE + 1 || line[2 * CSha256::SIZE] != ' ') {
+		return false;
+	}
+	if (identity != NULL && hex(identity).compare(0, string::npos, line, 2 * CSha256::SIZE) != 0) {
+		return false;
+	}
+	for (int i=0; i<CSha256::SIZE; i++) {
+		unsigned int byte;
+
+		if (sscanf(line + 2 * CSha256::SIZE + 1 + 2 * i, "%2x", &byte) != 1) {
+			return false;
+		}
+		digest[i] = byte;
+	}
+	return true;
+}
+
+bool CImageCache::writeReference(const uint8_t *identity, const uint8_t *digest) {
+	string ref = hex(identity) + " " + hex(digest) + "\n";
+
+	return writeFile(referencePath(keyOf(identity)), ref.data(), ref.size());
+}
+
+/*
+ * write a file atomically, the temporary file is unique for each process
+ */
+bool CImageCache::writeFile(string path, const void *data, size_t size) {
+	string tmpPath = path + ".tmp" + CFormat::intToString(getpid());
+	const uint8_t *pos = (const uint8_t*)data;
+	int fd;
+
+	fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		COut::d("Cannot write cache entry '" + path + "' (" + strerror(errno) + ").");
+		return false;
+	}
+	while (size > 0) {
+		ssize_t written = write(fd, pos, size);
+
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			COut::d("Cannot write cache entry '" + path + "' (" + strerror(errno) + ").");
+			close(fd);
+			unlink(tmpPath.c_str());
+			return false;
+		}
+		pos += written;
+		size -= written;
+	}
+	if (close(fd) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		COut::d("Cannot write cache entry '" + path + "' (" + strerror(errno) + ").");
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*
+ * remove the least recently used images until the size limit is met, and the references to them
+ *
+ * Only one process evicts at a time, others skip the eviction. A process which still maps a removed
+ * image is not affected.
+ */
+void CImageCache::evict() {
+	typedef struct {
+		string name;
+		uint64_t size;
+		struct timespec used;
+	} entry_t;
+
+	vector<entry_t> images;
+	vector<string> references;
+	uint64_t total = 0;
+	struct dirent *dirEntry;
+	struct stat st;
+	DIR *dir;
+	int lock;
+
+	dir = opendir(directory.c_str());
+	if (dir == NULL) {
+		return;
+	}
+	while ((dirEntry = readdir(dir)) != NULL) {
+		string name = dirEntry->d_name;
+
+		if (stat((directory + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if (name.find(".tmp") != string::npos) {
+			if (st.st_mtime + STALE_TMP_AGE < time(NULL)) {
+				unlink((directory + name).c_str());
+			}
+		}
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".img") == 0) {
+			entry_t entry = {name, (uint64_t)st.st_size, st.st_mtim};
+
+			images.push_back(entry);
+			total += st.st_size;
+		}
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".ref") == 0) {
+			references.push_back(name);
+		}
+	}
+	closedir(dir);
+
+	if (total <= maxSize) {
+		return;
+	}
+
+	lock = open((directory + "lock").c_str(), O_RDWR | O_CREAT, 0644);
+	if (lock < 0) {
+		return;
+	}
+	if (flock(lock, LOCK_EX | LOCK_NB) != 0) {
+		// another process evicts
+		close(lock);
+		return;
+	}
+
+	sort(images.begin(), images.end(), [](const entry_t &a, const entry_t &b) {
+		return (a.used.tv_sec != b.used.tv_sec) ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+	});
+	for (unsigned int i=0; i<images.size() && total > maxSize; i++) {
+		if (unlink((directory + images[i].name).c_str()) == 0) {
+			COut::dd("Evict cache entry '" + images[i].name + "'.");
+			total -= images[i].size;
+		}
+	}
+
+	for (unsigned int i=0; i<references.size(); i++) {
+		uint8_t digest[CSha256::SIZE];
+
+		if (!readReference(directory + references[i], NULL, digest) || access(imagePath(keyOf(digest)).c_str(), F_OK) != 0) {
+			unlink((directory + references[i]).c_str());
+		}
+	}
+
+	flock(lock, LOCK_UN);
+	close(lock);
+}
+
+string CImageCache::keyName(uint64_t key) {
+	char name[17];
+
+	snprintf(name, sizeof(name), "%016" PRIx64, key);
+	return name;
+}
+
+string CImageCache::imagePath(uint64_t key) {
+	return directory + keyName(key) + ".img";
+}
+
+string CImageCache::referencePath(uint64_t key) {
+	return directory + keyName(key) + ".ref";
+}
+
+/*
+ * the first 64 bits of a digest name the files of the cache
+ */
+uint64_t CImageCache::keyOf(const uint8_t *digest) {
+	uint64_t key = 0;
+
+	for (int i=0; i<8; i++) {
+		key = (key << 8) | digest[i];
+	}
+	return key;
+}
+
+string CImageCache::hex(const uint8_t *digest) {
+	char text[2 * CSha256::SIZE + 1];
+
+	for (int i=0; i<CSha256::SIZE; i++) {
+		snprintf(text + 2 * i, 3, "%02x", digest[i]);
+	}
+	return text;
+}
+
+CImageCache::~CImageCache() {
+
+}
@@ -0,0 +1,128 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CIMAGECACHE_H_
+#define CIMAGECACHE_H_
+
+#include <inttypes.h>
+#include <string>
+#include "CMemoryImage.h"
+#include "CMemorySink.h"
+#include "CSha256.h"
+#include "avrprog.h"
+
+using namespace std;
+
+/**
+ * @brief	On-disk cache of parsed memory images, such that repeated writes of the same file skip the parsing.
+ *
+ * The cache is a directory (usually ~/HOME_CONFIG_DIR/cache/) with two kinds of files:
+ * - \<key\>.img: a parsed image, named by the SHA-256 digest of the file content and the parse parameters.
+ *   It contains a table of the segments of the image followed by their content, hence the
+ *   segments are passed from the mapped file to the image without parsing:
+ *   @code
+ *   header     magic "AVRPIMG", version, number of segments, file size, size of the data, content digest
+ *   segments   address, length and offset of each segment
+ *   data       content of the segments
+ *   @endcode
+ * - \<key\>.ref: the content digest of a file, named by the digest of its path, size, inode, modification
+ *   time and the parse parameters. An unchanged file is found without reading it.
+ *
+ * If the reference of a file is missing, its content is hashed, such that copies of a file share one image.
+ * File names contain the first 64 bits of a digest (the key), the whole digests and the file size are
+ * compared before an entry is used.
+ *
+ * Files are written to a temporary file and renamed, a mapped image is never changed. Each hit
+ * touches the image, and if the images exceed the size limit the least recently used ones are
+ * removed. The removal is serialized between processes with flock() on the file \a lock.
+ *
+ * Errors of the cache are only reported in debug output, the file is parsed then.
+ */
+class CImageCache {
+public:
+	/**
+	 * @brief	Open a cache directory, it is created if it does not exist.
+	 *
+	 * @param	directory	Path to the cache, with trailing slash. Empty for ~/HOME_CONFIG_DIR/cache/.
+	 * @param	maxSize		Size limit of all images in bytes.
+	 */
+	CImageCache(string directory = "", uint64_t maxSize = IMAGE_CACHE_SIZE);
+	virtual ~CImageCache();
+
+	/**
+	 * @brief	Load a cached image.
+	 *
+	 * @param	path		Path to the parsed file.
+	 * @param	parameters	Everything else the image depends on, e.g. the file type and section names.
+	 * @param	sink		Receives the segments of the image.
+	 * @return	true if the image was found, false if the file has to be parsed.
+	 */
+	bool load(string path, string parameters, CMemorySink *sink);
+
+	/**
+	 * @brief	Store the parsed image of a file.
+	 *
+	 * Must follow a failed load() with the same arguments.
+	 *
+	 * @param	path		Path to the parsed file.
+	 * @param	parameters	See load().
+	 * @param	image		Parsed image.
+	 */
+	void store(string path, string parameters, CMemoryImage *image);
+
+private:
+	static const int FORMAT_VERSION = 2;		// version of the image format
+
+	typedef struct {
+		char magic[8];
+		uint32_t version;
+		uint32_t numOfSegments;
+		uint64_t fileSize;
+		uint64_t dataSize;
+		uint8_t digest[CSha256::SIZE];
+	} header_t;
+
+	typedef struct {
+		uint32_t address;
+		uint32_t length;
+		uint64_t offset;
+	} segment_t;
+
+	string directory;
+	uint64_t maxSize;
+	bool enabled;
+	bool contentKnown;						// contentDigest and contentSize belong to the last failed load()
+	uint8_t contentDigest[CSha256::SIZE];
+	uint64_t contentSize;
+
+	bool fileDigest(string path, string parameters, uint8_t *digest, uint64_t *size);
+	bool contentDigestOf(string path, string parameters, uint8_t *digest, uint64_t *size);
+	bool loadImage(const uint8_t *digest, uint64_t fileSize, CMemorySink *sink);
+	bool readReference(string refPath, const uint8_t *identity, uint8_t *digest);
+	bool writeReference(const uint8_t *identity, const uint8_t *digest);
+	bool writeFile(string path, const void *data, size_t size);
+	void evict();
+	static string keyName(uint64_t key);
+	string imagePath(uint64_t key);
+	string referencePath(uint64_t key);
+	static uint64_t keyOf(const uint8_t *digest);
+	static string hex(const uint8_t *digest);
+};
+
+#endif /* CIMAGECACHE_H_ */
@@ -0,0 +1,81 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CInputStream.h"
+#include "CFileInputStream.h"
+#include "CGzipInputStream.h"
+#include "CZstdInputStream.h"
+#include <unistd.h>
+
+using namespace std;
+
+CInputStream::CInputStream(string _name) : name(_name) {
+
+}
+
+/*
+ * The compression is detected by the magic number at the beginning of the file, hence the
+ * file name does not matter and compressed data can be piped to standard input.
+ */
+CInputStream *CInputStream::open(string path) {
+	CFileInputStream *file;
+
+	if (path.compare("-") == 0) {
+		file = new CFileInputStream(STDIN_FILENO, "<stdin>");
+	}
+	else {
+		file = new CFileInputStream(path);
+	}
+	uint8_t magic[CFileInputStream::MAX_PEEK];
+	int len;
+
+	try {
+		len = file->peek(magic, sizeof(magic));
+	}
+	catch (...) {
+		delete file;
+		throw;
+	}
+
+	if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		return new CGzipInputStream(file);
+	}
+	if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+#if HAVE_LIBZSTD
+		return new CZstdInputStream(file);
+#else
+		delete file;
+		throw StreamException("Cannot read '" + path + "', this version was built without zstd support.");
+#endif
+	}
+
+	return file;
+}
+
+string CInputStream::getName() {
+	return name;
+}
+
+CInputStream::~CInputStream() {
+
+}
+
+StreamException::StreamException(string err) : ExceptionBase(err) {
+
+}
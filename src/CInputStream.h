@@ -0,0 +1,81 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CINPUTSTREAM_H_
+#define CINPUTSTREAM_H_
+
+#include <inttypes.h>
+#include <string>
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Sequential source of bytes, e.g. an input file.
+ * @throw	StreamException on errors.
+ *
+ * Readers of file formats (see CIntelHexReader) take their input from a stream, hence they
+ * do not depend on where the bytes come from.
+ */
+class CInputStream {
+public:
+	virtual ~CInputStream();
+
+	/**
+	 * @brief	Open an input file.
+	 *
+	 * Compressed files (gzip and, if available, zstd) are decompressed on the fly.
+	 *
+	 * @param	path	Path to the file, "-" for standard input.
+	 * @return	A new stream, the caller is responsible to delete it.
+	 */
+	static CInputStream *open(string path);
+
+	/**
+	 * @brief	Read the next bytes of the stream.
+	 *
+	 * @param	buffer	The read bytes are stored here.
+	 * @param	size	Maximal number of bytes to read.
+	 * @return	Number of read bytes, 0 at the end of the stream.
+	 */
+	virtual int read(uint8_t *buffer, int size) = 0;
+
+	/**
+	 * @return	Name of the stream for messages (usually the path).
+	 */
+	string getName();
+
+protected:
+	/**
+	 * @param	name	Name of the stream for messages.
+	 */
+	CInputStream(string name);
+
+	string name;	///< name of the stream
+};
+
+/**
+ * @brief	Exception thrown by CInputStream and derived classes.
+ */
+class StreamException : public ExceptionBase {
+public:
+	StreamException(string err);
+};
+
+#endif /* CINPUTSTREAM_H_ */
@@ -0,0 +1,92 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CIntelHexReader.h"
+#include "CFormat.h"
+
+using namespace std;
+
+CIntelHexReader::CIntelHexReader(CInputStream *input) : CRecordReader(input, MAX_LINE_LENGTH), base(0) {
+
+}
+
+/*
+ * parse a single record, 'line' is not terminated
+ */
+void CIntelHexReader::parseLine(const char *line, int len, CMemorySink *sink, int *bytes) {
+	uint8_t record[5 + 255];
+	int recordLen;
+	uint8_t sum;
+	uint16_t offset;
+
+	if (line[0] != ':') {
+		error("Record does not start with ':'.");
+	}
+	if ((len - 1) % 2 != 0 || len < 1 + 2 * 5 || len > 1 + 2 * (int)sizeof(record)) {
+		error("Invalid record length.");
+	}
+
+	// decode all hex digits
+	recordLen = (len - 1) / 2;
+	sum = decode(line + 1, recordLen, record);
+	if (record[0] + 5 != recordLen) {
+		error("Byte count does not match the record length.");
+	}
+	if (sum != 0) {
+		error("Checksum error.");
+	}
+
+	offset = record[1] << 8 | record[2];
+
+	switch (record[3]) {
+	case 0x00:	// data
+		if (record[0] > 0) {
+			sink->addData(base + offset, record + 4, record[0]);
+			*bytes += record[0];
+		}
+		break;
+	case 0x01:	// end of file
+		end = true;
+		break;
+	case 0x02:	// extended segment address
+		if (record[0] != 2) {
+			error("Invalid extended segment address record.");
+		}
+		base = (record[4] << 8 | record[5]) << 4;
+		break;
+	case 0x04:	// extended linear address
+		if (record[0] != 2) {
+			error("Invalid extended linear address record.");
+		}
+		base = (uint32_t)(record[4] << 8 | record[5]) << 16;
+		break;
+	case 0x03:	// start segment address
+	case 0x05:	// start linear address
+		if (record[0] != 4) {
+			error("Invalid start address record.");
+		}
+		break;
+	default:
+		error("Unknown record type " + CFormat::intToHexString(record[3]) + ".");
+	}
+}
+
+CIntelHexReader::~CIntelHexReader() {
+
+}
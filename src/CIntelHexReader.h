@@ -0,0 +1,59 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CINTELHEXREADER_H_
+#define CINTELHEXREADER_H_
+
+#include <inttypes.h>
+#include "CRecordReader.h"
+
+using namespace std;
+
+/**
+ * @brief	Streaming parser for Intel HEX files.
+ * @throw	RecordException on syntax and checksum errors.
+ *
+ * Each data record is passed to a CMemorySink as soon as it is decoded (see CRecordReader).
+ *
+ * Supported record types:
+ * - 00 data
+ * - 01 end of file (all following lines are ignored)
+ * - 02 extended segment address
+ * - 03 start segment address (ignored)
+ * - 04 extended linear address
+ * - 05 start linear address (ignored)
+ */
+class CIntelHexReader : public CRecordReader {
+public:
+	/**
+	 * @param	input	Stream with the content of the hex file. The stream is not owned by this object.
+	 */
+	CIntelHexReader(CInputStream *input);
+	virtual ~CIntelHexReader();
+
+protected:
+	virtual void parseLine(const char *line, int len, CMemorySink *sink, int *bytes);
+
+private:
+	static const int MAX_LINE_LENGTH = 1 + 2 * (5 + 255) + 16;	// colon, hex digits of the longest record and some white space
+
+	uint32_t base;		// address offset of extended segment/linear address records
+};
+
+#endif /* CINTELHEXREADER_H_ */
@@ -0,0 +1,89 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CISPCOMMAND_H_
+#define CISPCOMMAND_H_
+
+#include <inttypes.h>
+
+/**
+ * @brief	Compile time sum of bytes (16 bit wide), see CIspCommand::CHECKSUM.
+ */
+template<uint8_t... Bytes>
+struct CIspChecksum;
+
+template<>
+struct CIspChecksum<> {
+	static const uint16_t value = 0;
+};
+
+template<uint8_t First, uint8_t... Rest>
+struct CIspChecksum<First, Rest...> {
+	static const uint16_t value = (uint16_t)(First + CIspChecksum<Rest...>::value);
+};
+
+/**
+ * @brief	Compile time description of ISP instructions, which are executed by the programmer.
+ *
+ * Some operations (chip erase, fuse bytes, device signature,...) have no own command on the programmer.
+ * Instead the raw ISP instructions are transferred to the programmer, which clocks them out to the target
+ * (see CAvrProgCommands::executeCommands()). This transfer consists of
+ * - a setup command, which describes the instructions
+ * - a data buffer of 256 bytes, which contains the instructions and is zero otherwise
+ * - the checksum of the whole data buffer
+ *
+ * Since the unused part of the data buffer is zero, the checksum depends only on the instruction bytes and
+ * is computed by the compiler. Bytes which are set at runtime (e.g. fuse values) have to be declared as zero
+ * and must be added to the checksum by the caller.
+ *
+ * @code
+ * // chip erase: one instruction of 4 bytes, no response, no delay
+ * typedef CIspCommand<4, 0, 0,	0xac, 0x80, 0x00, 0x00> ChipErase;
+ * @endcode
+ *
+ * @tparam	SendSize	Number of bytes sent to the target per instruction.
+ * @tparam	ReceiveSize	Number of bytes read from the target per instruction.
+ * @tparam	Delay		Delay after each instruction in ms.
+ * @tparam	Bytes		The instructions.
+ */
+template<uint8_t SendSize, uint8_t ReceiveSize, uint8_t Delay, uint8_t... Bytes>
+class CIspCommand {
+public:
+	/// Number of instruction bytes.
+	static const int SIZE = sizeof...(Bytes);
+	/// Number of instructions.
+	static const int INSTRUCTIONS = SIZE / SendSize;
+	/// Checksum of the data buffer (16 bit sum of all instruction bytes).
+	static const uint16_t CHECKSUM = CIspChecksum<Bytes...>::value;
+
+	/// Setup command, which describes the instructions.
+	static constexpr uint8_t setup[] = {0x02, SendSize, 0x00, ReceiveSize, 0x00, Delay, 0x00};
+	/// Instruction bytes, the remaining bytes of the data buffer are zero.
+	static constexpr uint8_t data[] = {Bytes...};
+
+	static_assert(SendSize > 0 && SIZE % SendSize == 0, "incomplete ISP instruction");
+};
+
+template<uint8_t SendSize, uint8_t ReceiveSize, uint8_t Delay, uint8_t... Bytes>
+constexpr uint8_t CIspCommand<SendSize, ReceiveSize, Delay, Bytes...>::setup[];
+
+template<uint8_t SendSize, uint8_t ReceiveSize, uint8_t Delay, uint8_t... Bytes>
+constexpr uint8_t CIspCommand<SendSize, ReceiveSize, Delay, Bytes...>::data[];
+
+#endif /* CISPCOMMAND_H_ */
@@ -0,0 +1,505 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CJob.h"
+#include <iostream>
+#include "CFormat.h"
+#include "CBinaryFile.h"
+#include "CHexFile.h"
+#include "CSRecordFile.h"
+#include "CFlashBundle.h"
+#include "CJournal.h"
+#include "CReadoutStream.h"
+#include "CLArgumentException.h"
+#include "COut.h"
+
+using namespace std;
+
+CJob::CJob(string _flash, string _eeprom, string _fuses) :
+		flash(_flash), eeprom(_eeprom), fuses(_fuses), mcu(""), socket(AUTO_DETECT), verify(false), chipErase(false), noChipErase(false), journalPath(""),
+		fill(EMPTY_FLASH_BYTE), minGap(HEX_MIN_GAP), standardStreams(0), stream(false), cache(false), flashOptions(NULL), eepromOptions(NULL), fusesOptions(NULL) {
+
+}
+
+void CJob::setMcu(string mcu) {
+	this->mcu = mcu;
+}
+
+void CJob::setSocket(int socket) {
+	this->socket = socket;
+}
+
+void CJob::setGaps(uint8_t fill, int minGap) {
+	this->fill = fill;
+	this->minGap = minGap;
+}
+
+void CJob::setStream(bool stream) {
+	this->stream = stream;
+}
+
+void CJob::setCache(bool cache) {
+	this->cache = cache;
+}
+
+void CJob::setVerify(bool verify) {
+	this->verify = verify;
+}
+
+void CJob::setErase(bool erase) {
+	this->chipErase = erase;
+}
+
+void CJob::setNoErase(bool noErase) {
+	this->noChipErase = noErase;
+}
+
+void CJob::setJournal(string path) {
+	this->journalPath = path;
+}
+
+string CJob::getMcu() {
+	return mcu;
+}
+
+int CJob::getSocket() {
+	return socket;
+}
+
+void CJob::load() {
+	if (flash.size() != 0) {
+		COut::d("Prepare buffer for flash operations.");
+		flashOptions = new CFlashOptions(flash, stream, cache);
+		if (flashOptions->getOperation() == WRITE) {
+			chipErase = true;
+		}
+		COut::d("");
+	}
+	if (eeprom.size() != 0) {
+		COut::d("Prepare buffer for eeprom operations.");
+		eepromOptions = new CEEPROMOptions(eeprom, cache);
+		//if (eepromOptions->getOperation() == WRITE) {
+		//	chipErase = true;
+		//}
+		COut::d("");
+	}
+	if (fuses.size() != 0) {
+		COut::d("Prepare buffer for fuse bytes operations.");
+		fusesOptions = new CFusesOptions(fuses);
+		COut::d("");
+	}
+
+	if (journalPath.size() != 0 && (flashOptions == NULL || flashOptions->getOperation() != WRITE)) {
+		throw CLArgumentException("journal requires a flash write operation.");
+	}
+	if (journalPath.size() != 0 && stream) {
+		throw CLArgumentException("journal cannot be combined with stream.");
+	}
+
+	// standard input can be read only once, and several readouts on standard output could not be separated
+	standardStreams = 0;
+	if (flashOptions != NULL && flashOptions->isStandardStream())
+		standardStreams++;
+	if (eepromOptions != NULL && eepromOptions->isStandardStream())
+		standardStreams++;
+	if (fusesOptions != NULL && fusesOptions->isStandardStream())
+		standardStreams++;
+	if (standardStreams > 1) {
+		throw CLArgumentException("'-' can only be used for one memory operation.");
+	}
+}
+
+bool CJob::usesStandardStream() {
+	return standardStreams > 0;
+}
+
+vector<string> CJob::getInputFiles() {
+	CMemoryOptions *options[] = {flashOptions, eepromOptions, fusesOptions};
+	vector<string> files;
+
+	for (unsigned int i=0; i<sizeof(options)/sizeof(options[0]); i++) {
+		if (options[i] == NULL || options[i]->getOperation() == READ || options[i]->getType() == IMMEDIATE) {
+			continue;
+		}
+		for (unsigned int s=0; s<options[i]->getSources().size(); s++) {
+			files.push_back(options[i]->getSources()[s].path);
+		}
+	}
+	return files;
+}
+
+void CJob::share() {
+	CMemoryOptions *options[] = {flashOptions, eepromOptions, fusesOptions};
+
+	if (journalPath.size() != 0) {
+		throw CLArgumentException("journal cannot be used for several targets.");
+	}
+	if (stream) {
+		throw CLArgumentException("stream cannot be used for several targets.");
+	}
+
+	for (unsigned int i=0; i<sizeof(options)/sizeof(options[0]); i++) {
+		if (options[i] == NULL) {
+			continue;
+		}
+		if (options[i]->getOperation() == READ) {
+			throw CLArgumentException("Memory cannot be read for several targets.");
+		}
+		// the flat buffer for verify operations is created on the first call
+		options[i]->getBuffer();
+	}
+}
+
+int CJob::execute(CAVRprog *prog) {
+	uint8_t *buffer = NULL;
+	int size;
+	bool equal;
+	CHexFile *hexFile = NULL;
+	CJournal *journal = NULL;
+	bool erase = chipErase;
+	bool noErase = noChipErase;
+	int returnValue = 0;
+
+	// an interrupted write of the same image continues without chip erase
+	if (journalPath.size() != 0) {
+		CFlashBundle *bundle = flashOptions->getBundle();
+
+		if (bundle != NULL) {
+			journal = new CJournal(journalPath, bundle->imageHash(), bundle->size(), prog->getDevice()->deviceSignature());
+		}
+		else {
+			journal = new CJournal(journalPath, flashOptions->getBuffer(), flashOptions->getBufferSize(), prog->getDevice()->deviceSignature());
+		}
+		prog->setJournal(journal);
+
+		if (journal->resumable() == true && noErase == false) {
+			cout << "Resume interrupted flash write from journal '" << journalPath << "', skip chip erase." << endl;
+			noErase = true;
+		}
+	}
+
+	try {
+		// this is only for output
+		if (fusesOptions == NULL && flashOptions == NULL && eepromOptions == NULL && erase == false) {
+			cout << "Reset device..." << endl;
+		}
+		if (flashOptions != NULL && noErase) {
+			cout << "Flash memory will be programmed without a preceding chip erase." << endl;
+		}
+
+		// perform chip erase
+		if (erase == true && noErase == false) {
+			cout << endl << "Chip erase..." << endl;
+			prog->chipErase();
+		}
+
+		// perform fuses actions
+		if (fusesOptions != NULL) {
+			switch (fusesOptions->getOperation()) {
+			case WRITE:
+				cout << endl << "Write fuse bytes..." << endl;
+
+				// check weather device was specified
+				if (mcu.size() == 0) {
+					throw ProgramOptionsException("Writing fuses requires a specified mcu type.");
+				}
+#if WRITE_FUSES_SUPPORT
+				prog->writeFuses(fusesOptions->getLfuse(), fusesOptions->getHfuse(), fusesOptions->getEfuse(), fusesOptions->getNumOfFuses());
+				cout << fusesOptions->getNumOfFuses() << " fuse bytes written" << endl;
+
+				if (verify == true) {
+					cout << endl << "Verify fuse bytes..." << endl;
+					if (prog->verifyFuses(fusesOptions->getBuffer(), fusesOptions->getBufferSize()) == false) {
+						throw ExceptionBase("Verify fuse bytes failed.");
+					}
+					else {
+						cout << "OK, " << fusesOptions->getBufferSize() << " fuse bytes verified" << endl;
+					}
+				}
+#else
+				cout << "This version does not support writing of fuse bytes.";
+#endif
+				break;
+			case READ:
+				cout << endl << "Read fuse bytes..." << endl;
+				size = prog->readFuses(&buffer);
+				switch (fusesOptions->getType()) {
+				case HEX:
+				case SREC:
+				case BIN:
+					hexFile = createFile(fusesOptions);
+					hexFile->save(buffer, size);
+					delete hexFile;
+					break;
+				case IMMEDIATE:
+					cout << "\tlfuse: " << "0x" << CFormat::intToHexString(buffer[0]) << endl;
+					if (size > 1)
+						cout << "\thfuse: " << "0x" << CFormat::intToHexString(buffer[1]) << endl;
+					if (size > 2)
+						cout << "\tefuse: " << "0x" << CFormat::intToHexString(buffer[2]) << endl;
+					break;
+				case ELF:
+					throw ProgramOptionsException("Read fuse bytes into *.elf files is not supported.");
+					break;
+				case BUNDLE:
+					// rejected by CFusesOptions
+					break;
+				}
+				delete[] buffer;
+				cout << size << " fuse bytes read" << endl;
+				break;
+			case VERIFY:
+				cout << endl << "Verify fuse bytes..." << endl;
+				if (prog->verifyFuses(fusesOptions->getBuffer(), fusesOptions->getBufferSize()) == false) {
+					cout << "failed";
+					returnValue = VERIFY_ERROR_NUMBER;
+				}
+				else {
+					cout << "OK";
+				}
+				cout << ", " << fusesOptions->getBufferSize() << " fuse bytes verified" << endl;
+				break;
+			}
+		}
+
+		// perform flash actions
+		if (flashOptions != NULL) {
+			switch (flashOptions->getOperation()) {
+			case WRITE:
+				if (stream) {
+					writeFlashStream(prog);
+					break;
+				}
+				if (flashOptions->getBundle() != NULL) {
+					writeFlashBundle(prog);
+					break;
+				}
+				cout << endl << "Write to flash memory..." << endl;
+				prog->writeFlash(flashOptions->getImage());
+				cout << flashOptions->getBufferSize() << " bytes written" << endl;
+
+				if (verify == true) {
+					cout << endl << "Verify flash memory..." << endl;
+					if (prog->fastVerifyFlash(flashOptions->getBuffer(), flashOptions->getBufferSize()) == false) {
+						throw ExceptionBase("Verify flash failed.");
+					}
+					else {
+						cout << "OK, " << flashOptions->getBufferSize() << " bytes verified" << endl;
+					}
+				}
+				break;
+			case READ:
+				cout << endl << "Read from flash memory..." << endl;
+				size = readMemory(prog, flashOptions, FLASH);
+				cout << size << " bytes read" << endl;
+				break;
+			case VERIFY:
+				cout << endl << "Verify flash memory..." << endl;
+				if (flashOptions->getBundle() != NULL) {
+					equal = prog->verifyFlash(flashOptions->getBundle());
+					size = flashOptions->getBundle()->size();
+				}
+				else {
+					equal = prog->verifyFlash(flashOptions->getBuffer(), flashOptions->getBufferSize());
+					size = flashOptions->getBufferSize();
+				}
+				if (equal == false) {
+					cout << "failed";
+					returnValue = VERIFY_ERROR_NUMBER;
+				}
+				else {
+					cout << "OK";
+				}
+				cout << ", " << size << " bytes verified" << endl;
+				break;
+			}
+		}
+
+		// perform eeprom actions
+		if (eepromOptions != NULL) {
+			switch (eepromOptions->getOperation()) {
+			case WRITE:
+				cout << endl << "Write to eeprom memory..." << endl;
+				prog->writeEEPROM(eepromOptions->getImage());
+				cout << eepromOptions->getBufferSize() << " bytes written" << endl;
+
+				if (verify == true) {
+					cout << endl << "Verify eeprom memory..." << endl;
+					if (prog->fastVerifyEEPROM(eepromOptions->getBuffer(), eepromOptions->getBufferSize()) == false) {
+						//cout << "failed" << endl;
+						throw ExceptionBase("Verify eeprom failed.");
+					}
+					else {
+						cout << "OK, " << eepromOptions->getBufferSize() << " bytes verified" << endl;
+					}
+				}
+				break;
+			case READ:
+				cout << endl << "Read from eeprom memory..." << endl;
+				size = readMemory(prog, eepromOptions, EEPROM);
+				cout << size << " bytes read" << endl;
+				break;
+			case VERIFY:
+				cout << endl << "Verify eeprom memory..." << endl;
+				if (prog->verifyEEPROM(eepromOptions->getBuffer(), eepromOptions->getBufferSize()) == false) {
+					cout << "failed";
+					returnValue = VERIFY_ERROR_NUMBER;
+				}
+				else {
+					cout << "OK";
+				}
+				cout << ", " << eepromOptions->getBufferSize() << " bytes verified" << endl;
+				break;
+			}
+		}
+	}
+	catch (...) {
+		prog->setJournal(NULL);
+		delete journal;
+		throw;
+	}
+
+	prog->setJournal(NULL);
+	delete journal;
+
+	return returnValue;
+}
+
+/*
+ * the producer thread of the stream parses the file while the chunks are written
+ */
+void CJob::writeFlashStream(CAVRprog *prog) {
+	CChunkStream chunks(flashOptions, EMPTY_FLASH_BYTE, prog->getDevice()->flashSize());
+
+	cout << endl << "Write to flash memory (streaming)..." << endl;
+	chunks.start();
+	prog->writeFlash(&chunks);
+	cout << chunks.size() << " bytes written" << endl;
+
+	if (verify == true) {
+		cout << endl << "Verify flash memory..." << endl;
+		if (prog->fastVerifyFlash(&chunks) == false) {
+			throw ExceptionBase("Verify flash failed.");
+		}
+		else {
+			cout << "OK, " << chunks.size() << " bytes verified" << endl;
+		}
+	}
+}
+
+void CJob::writeFlashBundle(CAVRprog *prog) {
+	CFlashBundle *bundle = flashOptions->getBundle();
+
+	cout << endl << "Write to flash memory..." << endl;
+	prog->writeFlash(bundle);
+	cout << bundle->size() << " bytes written" << endl;
+
+	if (verify == true) {
+		cout << endl << "Verify flash memory..." << endl;
+		if (prog->fastVerifyFlash(bundle) == false) {
+			throw ExceptionBase("Verify flash failed.");
+		}
+		else {
+			cout << "OK, " << bundle->size() << " bytes verified" << endl;
+		}
+	}
+}
+
+/*
+ * No programmer is needed, the target is given by the mcu option.
+ */
+void CJob::saveBundle(string path) {
+	if (flashOptions == NULL || flashOptions->getOperation() != WRITE || flashOptions->getBundle() != NULL || stream) {
+		throw CLArgumentException("bundle requires a flash write operation with a hex, S-record, binary or elf file.");
+	}
+	if (eepromOptions != NULL || fusesOptions != NULL || journalPath.size() != 0) {
+		throw CLArgumentException("bundle cannot be combined with other operations.");
+	}
+	if (mcu.size() == 0) {
+		throw CLArgumentException("bundle requires a specified mcu type.");
+	}
+
+	CAVRDevice device(mcu);
+
+	if ((int)flashOptions->getImage()->size() > device.flashSize()) {
+		throw ExceptionBase("Not enough flash memory.");
+	}
+
+	CFlashBundle::create(path, flashOptions->getImage(), device.deviceSignature(), device.name());
+	cout << "Bundle '" << path << "' for '" << device.name() << "' created, " << flashOptions->getImage()->size() << " bytes." << endl;
+}
+
+/*
+ * The stream has to be destroyed (its writer thread stopped) before the file is deleted. A file which
+ * was not finished (the read failed) is discarded by its destructor, an existing file stays untouched.
+ */
+int CJob::readMemory(CAVRprog *prog, CProgramOptions *options, memory_t mem) {
+	CHexFile *file = createFile(options);
+	int size;
+
+	try {
+		if (mem == FLASH) {
+			file->setGaps(fill, minGap);
+		}
+
+		CReadoutStream readout(file, mem == FLASH ? EMPTY_FLASH_BYTE : EMPTY_EEPROM_BYTE,
+				mem == FLASH ? prog->getDevice()->flashSize() : prog->getDevice()->eepromSize());
+
+		readout.start();
+		if (mem == FLASH) {
+			prog->readFlash(&readout);
+		}
+		else {
+			prog->readEEPROM(&readout);
+		}
+		size = readout.finish();
+	}
+	catch (...) {
+		delete file;
+		throw;
+	}
+	delete file;
+
+	return size;
+}
+
+CHexFile *CJob::createFile(CProgramOptions *options) {
+	switch (options->getType()) {
+	case HEX:
+		return new CHexFile(options->getPath());
+	case SREC:
+		return new CSRecordFile(options->getPath());
+	case BIN:
+		return new CBinaryFile(options->getPath());
+	default:
+		throw ProgramOptionsException("Only reads into *.hex, *.srec and *.bin files are supported.");
+	}
+}
+
+CJob::~CJob() {
+	if (flashOptions != NULL) {
+		delete flashOptions;
+	}
+	if (eepromOptions != NULL) {
+		delete eepromOptions;
+	}
+	if (fusesOptions != NULL) {
+		delete fusesOptions;
+	}
+}
@@ -0,0 +1,206 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CJOB_H_
+#define CJOB_H_
+
+#include <string>
+#include <vector>
+#include "avrprog.h"
+#include "CAVRprog.h"
+#include "CEEPROMOptions.h"
+#include "CFlashOptions.h"
+#include "CFusesOptions.h"
+#include "CHexFile.h"
+
+using namespace std;
+
+/**
+ * @brief	All memory operations on one target device.
+ *
+ * A job collects the memory operations (see CProgramOptions) for one target, loads
+ * the input files and performs the operations in the following order:
+ * - chip erase
+ * - fuse bytes
+ * - flash memory
+ * - eeprom memory
+ *
+ * @throw	ProgramOptionsException, CLArgumentException and all exceptions of CAVRprog.
+ */
+class CJob {
+public:
+	/**
+	 * @param	flash	Flash memory operation (see CFlashOptions) or empty string.
+	 * @param	eeprom	EEPROM memory operation (see CEEPROMOptions) or empty string.
+	 * @param	fuses	Fuse bytes operation (see CFusesOptions) or empty string.
+	 */
+	CJob(string flash, string eeprom, string fuses);
+	virtual ~CJob();
+
+	/**
+	 * @param	mcu	Name of the target mcu or path to a device description file, empty for autodetection.
+	 */
+	void setMcu(string mcu);
+
+	/**
+	 * @param	socket	Programming pins of the target, AUTO_DETECT to use the device description file.
+	 */
+	void setSocket(int socket);
+
+	/**
+	 * @param	verify	Verify memory writes.
+	 */
+	void setVerify(bool verify);
+
+	/**
+	 * @param	erase	Perform a chip erase.
+	 */
+	void setErase(bool erase);
+
+	/**
+	 * @param	noErase	Skip the implicit chip erase before programming flash memory.
+	 */
+	void setNoErase(bool noErase);
+
+	/**
+	 * @param	path	Path to a journal file for the flash write operation (see CJournal), empty to disable journaling.
+	 */
+	void setJournal(string path);
+
+	/**
+	 * @brief	Omit empty regions when a flash readout is saved (see CHexFile::setGaps()).
+	 * @param	fill	Value of an empty byte.
+	 * @param	minGap	Minimal size of an omitted region in bytes, 0 saves the whole readout.
+	 */
+	void setGaps(uint8_t fill, int minGap);
+
+	/**
+	 * @brief	Create a bundle (see CFlashBundle) of the flash file of a write operation.
+	 *
+	 * The job must only contain the flash write and a specified mcu, load() has to be called before.
+	 *
+	 * @param	path	Path to the new bundle.
+	 */
+	void saveBundle(string path);
+
+	/**
+	 * @brief	Stream a flash write: the file is parsed while it is written (see CChunkStream).
+	 *
+	 * The file has to be ordered by address, it cannot be combined with a journal.
+	 */
+	void setStream(bool stream);
+
+	/**
+	 * @param	cache	Use the image cache (see CImageCache) when the input files are loaded.
+	 */
+	void setCache(bool cache);
+
+	/**
+	 * @return	Name of the target mcu, empty for autodetection.
+	 */
+	string getMcu();
+
+	/**
+	 * @return	Programming pins of the target.
+	 */
+	int getSocket();
+
+	/**
+	 * @brief	Parse the memory operations and load the input files.
+	 *
+	 * Does not need a connection to the programmer.
+	 */
+	void load();
+
+	/**
+	 * @brief	Check if an operation reads from standard input or writes to standard output.
+	 *
+	 * load() must be called before.
+	 */
+	bool usesStandardStream();
+
+	/**
+	 * @brief	Get the paths of all files which are written or verified.
+	 *
+	 * load() must be called before.
+	 */
+	vector<string> getInputFiles();
+
+	/**
+	 * @brief	Prepare the job to be executed for many targets, on several programmers at once or one after another.
+	 *
+	 * Afterwards execute() does not modify the job and can be called from several threads. Readouts,
+	 * journals and streams are rejected, since each of them belongs to one target. load() must be called before.
+	 */
+	void share();
+
+	/**
+	 * @brief	Perform all memory operations.
+	 *
+	 * load() must be called before and the programmer must be connected to the target.
+	 *
+	 * @param	prog	Connected programmer.
+	 * @return	0 on success or VERIFY_ERROR_NUMBER if a verify operation failed.
+	 */
+	int execute(CAVRprog *prog);
+
+protected:
+	string flash;
+	string eeprom;
+	string fuses;
+	string mcu;
+	int socket;
+	bool verify;
+	bool chipErase;
+	bool noChipErase;
+	string journalPath;
+	uint8_t fill;
+	int minGap;
+	int standardStreams;	///< number of operations on standard input/output
+	bool stream;
+	bool cache;
+
+	CFlashOptions *flashOptions;
+	CEEPROMOptions *eepromOptions;
+	CFusesOptions *fusesOptions;
+
+	/**
+	 * @brief	Create the output file of a read operation according to its type.
+	 * @return	A new file, the caller is responsible to delete it.
+	 */
+	CHexFile *createFile(CProgramOptions *options);
+
+	/**
+	 * @brief	Write the flash file with a CChunkStream (see setStream()).
+	 */
+	void writeFlashStream(CAVRprog *prog);
+
+	/**
+	 * @brief	Write the flash bundle and verify it if requested.
+	 */
+	void writeFlashBundle(CAVRprog *prog);
+
+	/**
+	 * @brief	Read flash or eeprom memory into the file of \a options with a CReadoutStream.
+	 * @return	Size of the readout without empty bytes at the end.
+	 */
+	int readMemory(CAVRprog *prog, CProgramOptions *options, memory_t mem);
+};
+
+#endif /* CJOB_H_ */
@@ -0,0 +1,147 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CJobFile.h"
+#include <fstream>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include "CAVRDevice.h"
+#include "CFormat.h"
+
+using namespace std;
+
+CJobFile::CJobFile(string _path) : path(_path) {
+	ifstream in(path.c_str());
+	string line;
+	int lineNumber = 0;
+
+	if (!in.is_open()) {
+		throw JobFileException("Could not open job file '" + path + "'.");
+	}
+
+	while (getline(in, line)) {
+		CJob *job;
+
+		lineNumber++;
+		try {
+			job = parseLine(line);
+		}
+		catch (JobFileException &e) {
+			for (unsigned int i=0; i<jobs.size(); i++) {
+				delete jobs[i];
+			}
+			throw JobFileException(path + ":" + CFormat::intToString(lineNumber) + ": " + e.what());
+		}
+
+		if (job != NULL) {
+			jobs.push_back(job);
+		}
+	}
+
+	if (jobs.size() == 0) {
+		throw JobFileException("No targets found in job file '" + path + "'.");
+	}
+}
+
+CJob *CJobFile::parseLine(string line) {
+	stringstream tokens(line);
+	string socket;
+	string mcu;
+	string flash = "";
+	string eeprom = "";
+	string fuses = "";
+	string journal = "";
+	string token;
+	bool verify = false;
+	bool erase = false;
+	bool noErase = false;
+	int socketNumber = AUTO_DETECT;
+	CJob *job;
+
+	boost::trim(line);
+	if (line.size() == 0 || line[0] == '#') {
+		return NULL;
+	}
+
+	if (!(tokens >> socket >> mcu)) {
+		throw JobFileException("Expected '<socket> <mcu> <operations>'.");
+	}
+
+	if (socket.compare("auto") != 0) {
+		socketNumber = CAVRDevice::parseSocket(socket);
+		if (socketNumber == AUTO_DETECT) {
+			throw JobFileException("Unknown socket '" + socket + "'.");
+		}
+	}
+
+	while (tokens >> token) {
+		size_t equal = token.find('=');
+		string key = token.substr(0, equal);
+		string value = (equal == token.npos) ? "" : token.substr(equal+1);
+
+		if (key.compare("flash") == 0 && value.size() != 0) {
+			flash = value;
+		}
+		else if (key.compare("eeprom") == 0 && value.size() != 0) {
+			eeprom = value;
+		}
+		else if (key.compare("fuses") == 0 && value.size() != 0) {
+			fuses = value;
+		}
+		else if (key.compare("journal") == 0 && value.size() != 0) {
+			journal = value;
+		}
+		else if (token.compare("verify") == 0) {
+			verify = true;
+		}
+		else if (token.compare("erase") == 0) {
+			erase = true;
+		}
+		else if (token.compare("no-erase") == 0) {
+			noErase = true;
+		}
+		else {
+			throw JobFileException("Unknown operation '" + token + "'.");
+		}
+	}
+
+	job = new CJob(flash, eeprom, fuses);
+	job->setMcu(mcu.compare("auto") == 0 ? "" : mcu);
+	job->setSocket(socketNumber);
+	job->setVerify(verify);
+	job->setErase(erase);
+	job->setNoErase(noErase);
+	job->setJournal(journal);
+
+	return job;
+}
+
+vector<CJob*> &CJobFile::getJobs() {
+	return jobs;
+}
+
+CJobFile::~CJobFile() {
+	for (unsigned int i=0; i<jobs.size(); i++) {
+		delete jobs[i];
+	}
+}
+
+JobFileException::JobFileException(string err) : ExceptionBase(err) {
+
+}
@@ -0,0 +1,83 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CJOBFILE_H_
+#define CJOBFILE_H_
+
+#include <string>
+#include <vector>
+#include "CJob.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Parses a multi-target job file.
+ *
+ * Each line of a job file describes the memory operations for one target:
+ * @code
+ * # <socket> <mcu> <operations>
+ * TQFP64   atmega128   flash=w:app64.hex eeprom=w:app64.eep verify
+ * TQFP100  atmega2560  flash=w:app100.hex fuses=w:ff,d8,fd
+ * @endcode
+ *
+ * - The socket is TQFP64, TQFP100, DIP40B, a socket number or \a auto (see CAVRDevice::parseSocket()).
+ * - The mcu is the name of a device description file or \a auto for autodetection.
+ * - Operations are \a flash=, \a eeprom=, \a fuses= and \a journal= with the same values as the
+ *   corresponding command line options, and the flags \a verify, \a erase and \a no-erase.
+ *
+ * Empty lines and lines starting with \a # are ignored.
+ *
+ * @throw	JobFileException on errors.
+ */
+class CJobFile {
+public:
+	/**
+	 * @brief	Read a job file.
+	 * @param	path	Path to the job file.
+	 */
+	CJobFile(string path);
+	virtual ~CJobFile();
+
+	/**
+	 * @return	All jobs in the order of the file. The jobs are owned by this object.
+	 */
+	vector<CJob*> &getJobs();
+
+	/**
+	 * @brief	Parse one line of a job file.
+	 * @param	line	Line without trailing newline.
+	 * @return	A new job (the caller is responsible to delete it), or NULL for empty lines and comments.
+	 */
+	static CJob *parseLine(string line);
+
+protected:
+	string path;
+	vector<CJob*> jobs;
+};
+
+/**
+ * @brief	Exception thrown by CJobFile
+ */
+class JobFileException : public ExceptionBase {
+public:
+	JobFileException(string err);
+};
+
+#endif /* CJOBFILE_H_ */
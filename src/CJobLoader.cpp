@@ -0,0 +1,62 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CJobLoader.h"
+#include "CLArgumentException.h"
+
+using namespace std;
+
+CJobLoader::CJobLoader(vector<CJob*> _jobs, bool _standardStream) : jobs(_jobs), standardStream(_standardStream) {
+	worker = thread(&CJobLoader::run, this);
+}
+
+/*
+ * worker thread
+ */
+void CJobLoader::run() {
+	try {
+		for (unsigned int i=0; i<jobs.size(); i++) {
+			jobs[i]->load();
+			if (!standardStream && jobs[i]->usesStandardStream()) {
+				throw CLArgumentException("'-' cannot be used in job files.");
+			}
+		}
+	}
+	catch (...) {
+		error = current_exception();
+	}
+}
+
+void CJobLoader::wait() {
+	if (worker.joinable()) {
+		worker.join();
+	}
+	if (error) {
+		exception_ptr e = error;
+
+		error = nullptr;
+		rethrow_exception(e);
+	}
+}
+
+CJobLoader::~CJobLoader() {
+	if (worker.joinable()) {
+		worker.join();
+	}
+}
@@ -0,0 +1,69 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CJOBLOADER_H_
+#define CJOBLOADER_H_
+
+#include <exception>
+#include <thread>
+#include <vector>
+#include "CJob.h"
+
+using namespace std;
+
+/**
+ * @brief	Loads the input files of jobs (see CJob::load()) in a worker thread.
+ *
+ * The files are parsed while the main thread opens the programmer and connects to the target,
+ * both stages only meet in wait(), right before the memory operations need the data.
+ *
+ * The jobs must not be used by other threads before wait() returned.
+ */
+class CJobLoader {
+public:
+	/**
+	 * @brief	Start loading.
+	 *
+	 * @param	jobs			Jobs to load, not owned by this object.
+	 * @param	standardStream	Allow operations on standard input or output (not used in job files).
+	 */
+	CJobLoader(vector<CJob*> jobs, bool standardStream);
+
+	/**
+	 * @brief	Waits for the worker thread if it is still running, errors are discarded.
+	 */
+	virtual ~CJobLoader();
+
+	/**
+	 * @brief	Wait until all jobs are loaded.
+	 *
+	 * @throw	ExceptionBase	Errors of CJob::load() are passed on, with their original type.
+	 */
+	void wait();
+
+private:
+	vector<CJob*> jobs;
+	bool standardStream;
+	thread worker;
+	exception_ptr error;		// error of the worker, valid after the worker has been joined
+
+	void run();
+};
+
+#endif /* CJOBLOADER_H_ */
@@ -0,0 +1,179 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CJournal.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include "CFormat.h"
+#include "COut.h"
+
+using namespace std;
+
+CJournal::CJournal(string _path, uint8_t *buffer, int size, uint32_t _signature) :
+		path(_path), file(NULL), imageHash(hash(buffer, size)), imageSize(size), signature(_signature), acknowledged(0), matches(false) {
+	load();
+}
+
+CJournal::CJournal(string _path, uint64_t _imageHash, int size, uint32_t _signature) :
+		path(_path), file(NULL), imageHash(_imageHash), imageSize(size), signature(_signature), acknowledged(0), matches(false) {
+	load();
+}
+
+/*
+ * parse an existing journal
+ *
+ * A journal which does not belong to the current image or target is ignored and
+ * overwritten by begin(). Chunks without content are never written, so the acknowledged
+ * chunks need not be contiguous; they only have to ascend. Broken lines (e.g. the process
+ * was killed while writing a line) end the list of acknowledged chunks.
+ */
+void CJournal::load() {
+	ifstream in(path.c_str());
+	string line;
+	string keyword;
+	int version = 0;
+	uint64_t h = 0;
+	int s = -1;
+	uint32_t sig = 0;
+	int numOfAcks = 0;
+
+	if (!in.is_open()) {
+		COut::d("No journal found at '" + path + "'.");
+		return;
+	}
+
+	// header
+	if (!getline(in, line) || sscanf(line.c_str(), "avrprog2 journal %d", &version) != 1 || version != FORMAT_VERSION) {
+		COut::d("Ignore journal '" + path + "' (unknown format).");
+		return;
+	}
+	if (!getline(in, line) || sscanf(line.c_str(), "image %" SCNx64 " %d", &h, &s) != 2) {
+		COut::d("Ignore journal '" + path + "' (no image).");
+		return;
+	}
+	if (!getline(in, line) || sscanf(line.c_str(), "signature %" SCNx32, &sig) != 1) {
+		COut::d("Ignore journal '" + path + "' (no signature).");
+		return;
+	}
+
+	if (h != imageHash || s != imageSize || sig != signature) {
+		COut::d("Journal '" + path + "' belongs to another image or target.");
+		return;
+	}
+
+	matches = true;
+
+	// acknowledged chunks are written in ascending order, everything before the last one is done
+	while (getline(in, line)) {
+		int chunk;
+
+		if (sscanf(line.c_str(), "ack %d", &chunk) != 1 || chunk < acknowledged) {
+			break;
+		}
+		acknowledged = chunk + 1;
+		numOfAcks++;
+	}
+
+	COut::d("Journal '" + path + "' contains " + CFormat::intToString(numOfAcks) + " acknowledged chunks, resume at chunk " + CFormat::intToString(acknowledged) + ".");
+}
+
+bool CJournal::resumable() {
+	return matches && acknowledged > 0;
+}
+
+int CJournal::nextChunk() {
+	if (matches == false) {
+		return 0;
+	}
+	return acknowledged;
+}
+
+void CJournal::begin() {
+	if (resumable()) {
+		file = fopen(path.c_str(), "a");
+	}
+	else {
+		file = fopen(path.c_str(), "w");
+	}
+
+	if (file == NULL) {
+		throw JournalException("Could not open journal '" + path + "': " + strerror(errno));
+	}
+
+	if (resumable() == false) {
+		fprintf(file, "avrprog2 journal %d\n", FORMAT_VERSION);
+		fprintf(file, "image %016" PRIx64 " %d\n", imageHash, imageSize);
+		fprintf(file, "signature %06" PRIx32 "\n", signature);
+		acknowledged = 0;
+		matches = true;
+	}
+	fflush(file);
+}
+
+/*
+ * The line is flushed to the operating system immediately, such that it survives a
+ * killed process. No fsync is done, otherwise each chunk would wait for the disk.
+ */
+void CJournal::acknowledge(int chunk) {
+	if (file == NULL) {
+		return;
+	}
+
+	fprintf(file, "ack %d\n", chunk);
+	if (fflush(file) != 0) {
+		throw JournalException("Could not write to journal '" + path + "': " + strerror(errno));
+	}
+	acknowledged = chunk + 1;
+}
+
+void CJournal::complete() {
+	if (file != NULL) {
+		fclose(file);
+		file = NULL;
+	}
+
+	if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+		throw JournalException("Could not remove journal '" + path + "': " + strerror(errno));
+	}
+	matches = false;
+	acknowledged = 0;
+}
+
+uint64_t CJournal::hash(uint8_t *buffer, int size) {
+	uint64_t h = 0xcbf29ce484222325ULL;		// FNV offset basis
+
+	for (int i=0; i<size; i++) {
+		h ^= buffer[i];
+		h *= 0x100000001b3ULL;				// FNV prime
+	}
+	return h;
+}
+
+CJournal::~CJournal() {
+	if (file != NULL) {
+		fclose(file);
+	}
+}
+
+JournalException::JournalException(string err) : ExceptionBase(err) {
+
+}
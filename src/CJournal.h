@@ -0,0 +1,134 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CJOURNAL_H_
+#define CJOURNAL_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string>
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Journal of a flash write operation, which allows to resume an interrupted write.
+ *
+ * The journal is a small text file which looks like:
+ * @code
+ * avrprog2 journal 1
+ * image <hash> <size>
+ * signature <device signature>
+ * ack 0
+ * ack 1
+ * ...
+ * @endcode
+ *
+ * Each chunk, which was acknowledged by the programmer, is appended as \a ack line.
+ * Chunks are written in ascending order and chunks without content are skipped, so
+ * if the journal of a previous run matches the image and the target device, the write
+ * operation continues behind the last acknowledged chunk.
+ *
+ * The file is removed after the write operation has completed.
+ *
+ * @throw	JournalException on errors.
+ */
+class CJournal {
+public:
+	/**
+	 * @brief	Open a journal and check if it belongs to the given image and target.
+	 *
+	 * @param	path		Path to the journal file. The file is created if it does not exist.
+	 * @param	buffer		Flash image, which should be written.
+	 * @param	size		Length of \a buffer.
+	 * @param	signature	Device signature of the target.
+	 */
+	CJournal(string path, uint8_t *buffer, int size, uint32_t signature);
+
+	/**
+	 * @brief	Open a journal for an image whose hash is already known, e.g. of a CFlashBundle.
+	 *
+	 * @param	path		Path to the journal file. The file is created if it does not exist.
+	 * @param	imageHash	Hash of the image, which should be written.
+	 * @param	size		Size of the image.
+	 * @param	signature	Device signature of the target.
+	 */
+	CJournal(string path, uint64_t imageHash, int size, uint32_t signature);
+	virtual ~CJournal();
+
+	/**
+	 * @return	true if a previous write of the same image to the same target was interrupted.
+	 */
+	bool resumable();
+
+	/**
+	 * @return	Number of the chunk behind the last acknowledged one.
+	 */
+	int nextChunk();
+
+	/**
+	 * @brief	Start journaling.
+	 *
+	 * If the journal is not resumable, the file is truncated and a new header is written.
+	 */
+	void begin();
+
+	/**
+	 * @brief	Record an acknowledged chunk.
+	 * @param	chunk	Chunk number.
+	 */
+	void acknowledge(int chunk);
+
+	/**
+	 * @brief	Finish journaling and remove the journal file.
+	 */
+	void complete();
+
+	/**
+	 * @brief	64 bit FNV-1a hash of a buffer.
+	 * @param	buffer	Byte array.
+	 * @param	size	Length of \a buffer.
+	 * @return	Hash value.
+	 */
+	static uint64_t hash(uint8_t *buffer, int size);
+
+protected:
+	static const int FORMAT_VERSION = 1;	///< version of the journal file format
+
+	string path;		///< path of the journal file
+	FILE *file;			///< journal file, opened by begin()
+	uint64_t imageHash;
+	int imageSize;
+	uint32_t signature;
+	int acknowledged;	///< number of the chunk behind the last acknowledged one
+	bool matches;		///< true if an existing journal belongs to the image and target
+
+private:
+	void load();
+};
+
+/**
+ * @brief	Exception thrown by CJournal
+ */
+class JournalException : public ExceptionBase {
+public:
+	JournalException(string err);
+};
+
+#endif /* CJOURNAL_H_ */
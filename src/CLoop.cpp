@@ -0,0 +1,108 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CLoop.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+CLoop::CLoop(CAVRprog *_prog, int _frequency, int _interval) : prog(_prog), frequency(_frequency), interval(_interval) {
+
+}
+
+void CLoop::run(CJob *job) {
+	chrono::steady_clock::time_point first;
+	int socket = job->getSocket();
+	int knownFrequency = FREQUENCY_AUTODETECT;
+	int boards = 0;
+	int failed = 0;
+
+	job->share();
+
+	while (true) {
+		chrono::steady_clock::time_point start;
+		double latency;
+		double hours;
+		int result;
+
+		cout << endl << "Waiting for a target..." << endl;
+		socket = waitForTarget(socket, true);
+
+		start = chrono::steady_clock::now();
+		if (boards == 0) {
+			first = start;
+		}
+		boards++;
+		cout << "Board " << boards << "..." << endl;
+
+		try {
+			prog->connect(job->getMcu(), frequency, socket, knownFrequency);
+			knownFrequency = prog->getFrequency();
+			socket = prog->getSocket();
+			result = job->execute(prog);
+			prog->disconnect();
+		}
+		catch (USBCommunicationException &e) {
+			throw;
+		}
+		catch (ExceptionBase &e) {
+			cerr << e.what() << endl;
+			result = COMMON_ERROR_NUMBER;
+			prog->disconnect();
+		}
+
+		if (result != 0) {
+			failed++;
+		}
+		latency = chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now() - start).count();
+		hours = chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now() - first).count() / 3600;
+
+		cout.precision(2);
+		cout << endl << "Board " << boards << ": " << ((result == 0) ? "OK" : "FAILED") << " in " << fixed << latency << " s ("
+				<< boards - failed << " passed, " << failed << " failed";
+		cout.precision(0);
+		if (boards > 1) {
+			cout << ", " << boards / hours << " boards/h";
+		}
+		cout << ")" << endl;
+
+		cout << "Remove the target..." << endl;
+		waitForTarget(socket, false);
+	}
+}
+
+/*
+ * poll until a target is present (returns its socket) or was removed
+ */
+int CLoop::waitForTarget(int socket, bool present) {
+	while (true) {
+		int found = prog->findTarget(socket);
+
+		if ((found >= 0) == present) {
+			return found;
+		}
+		this_thread::sleep_for(chrono::milliseconds(interval));
+	}
+}
+
+CLoop::~CLoop() {
+
+}
@@ -0,0 +1,65 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CLOOP_H_
+#define CLOOP_H_
+
+#include "CAVRprog.h"
+#include "CJob.h"
+
+using namespace std;
+
+/**
+ * @brief	Programs one board after another without closing the programmer (production line).
+ * @throw	USBCommunicationException if the programmer is lost.
+ *
+ * The programmer polls for a target with the programming enable instruction only (see CAVRprog::findTarget()).
+ * When a board is inserted, the job is executed, then the loop waits until the board is removed and
+ * starts again. The socket and the frequency of the first board are used for the following ones
+ * (the frequency is detected again if it does not work).
+ *
+ * The result and the latency (from the detection until the job is done) of each board are printed,
+ * together with the number of boards per hour since the first board was inserted.
+ */
+class CLoop {
+public:
+	/**
+	 * @param	prog		Opened programmer, not owned by this object.
+	 * @param	frequency	Device frequency, see CAVRprog::connect().
+	 * @param	interval	Polling interval in ms.
+	 */
+	CLoop(CAVRprog *prog, int frequency, int interval);
+	virtual ~CLoop();
+
+	/**
+	 * @brief	Program boards with \a job until the program is stopped.
+	 *
+	 * @param	job		Loaded job, it is prepared with CJob::share().
+	 */
+	void run(CJob *job);
+
+private:
+	CAVRprog *prog;
+	int frequency;
+	int interval;
+
+	int waitForTarget(int socket, bool present);
+};
+
+#endif /* CLOOP_H_ */
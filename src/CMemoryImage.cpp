@@ -0,0 +1,173 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CMemoryImage.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+CMemoryImage::CMemoryImage() {
+
+}
+
+/*
+ * Segments which overlap with or touch [address, address+len) are merged into one segment.
+ */
+void CMemoryImage::addData(uint32_t address, const uint8_t *data, int len) {
+	uint32_t end = address + len;
+	segments_t::iterator first;
+	segments_t::iterator last;
+
+	if (len <= 0) {
+		return;
+	}
+
+	// first segment which ends at or behind address
+	first = segments.upper_bound(address);
+	if (first != segments.begin()) {
+		segments_t::iterator previous = first;
+		--previous;
+		if (previous->first + previous->second.size() >= address) {
+			first = previous;
+		}
+	}
+
+	// segments behind the last one, which has to be merged
+	last = segments.upper_bound(end);
+
+	if (first == last) {
+		// no overlap, new segment
+		segments[address] = vector<uint8_t>(data, data + len);
+		return;
+	}
+
+	segments_t::iterator next = first;
+	++next;
+	if (next == last && first->first <= address) {
+		// only one segment is affected and the data starts within it (e.g. append)
+		vector<uint8_t> &segment = first->second;
+		uint32_t offset = address - first->first;
+
+		if (offset + len > segment.size()) {
+			segment.resize(offset + len);
+		}
+		memcpy(&segment[offset], data, len);
+		return;
+	}
+
+	// merge all affected segments into a new one
+	uint32_t start = min(address, first->first);
+	segments_t::iterator back = last;
+	--back;
+	uint32_t stop = max(end, (uint32_t)(back->first + back->second.size()));
+	vector<uint8_t> merged(stop - start);
+
+	for (segments_t::iterator it=first; it!=last; ++it) {
+		memcpy(&merged[it->first - start], &it->second[0], it->second.size());
+	}
+	memcpy(&merged[address - start], data, len);
+
+	segments.erase(first, last);
+	segments[start].swap(merged);
+}
+
+uint32_t CMemoryImage::size() {
+	if (segments.empty()) {
+		return 0;
+	}
+
+	segments_t::reverse_iterator last = segments.rbegin();
+	return last->first + last->second.size();
+}
+
+bool CMemoryImage::overlaps(uint32_t address, int len) {
+	// last segment which starts in front of the end of the block
+	segments_t::iterator it = segments.lower_bound(address + len);
+
+	if (len <= 0 || it == segments.begin()) {
+		return false;
+	}
+	--it;
+	return it->first + it->second.size() > address;
+}
+
+const CMemoryImage::segments_t &CMemoryImage::getSegments() {
+	return segments;
+}
+
+int CMemoryImage::nextChunk(int chunk, int chunkSize) {
+	uint32_t address = chunk * chunkSize;
+	segments_t::iterator it = segments.upper_bound(address);
+
+	// a segment which starts in front of the chunk may reach into it
+	if (it != segments.begin()) {
+		segments_t::iterator previous = it;
+		--previous;
+		if (previous->first + previous->second.size() > address) {
+			return chunk;
+		}
+	}
+
+	if (it == segments.end()) {
+		return -1;
+	}
+	return it->first / chunkSize;
+}
+
+bool CMemoryImage::readChunk(int chunk, int chunkSize, uint8_t fill, uint8_t *buffer) {
+	memset(buffer, fill, chunkSize);
+
+	if (nextChunk(chunk, chunkSize) != chunk) {
+		return false;
+	}
+
+	copy(chunk * chunkSize, chunkSize, buffer);
+	return true;
+}
+
+void CMemoryImage::flatten(uint8_t *buffer, int size, uint8_t fill) {
+	memset(buffer, fill, size);
+	copy(0, size, buffer);
+}
+
+/*
+ * copy the content of all segments within [address, address+size) to buffer, other bytes are not touched
+ */
+void CMemoryImage::copy(uint32_t address, int size, uint8_t *buffer) {
+	uint32_t end = address + size;
+	segments_t::iterator it = segments.upper_bound(address);
+
+	if (it != segments.begin()) {
+		--it;
+	}
+
+	for (; it != segments.end() && it->first < end; ++it) {
+		uint32_t from = max(address, it->first);
+		uint32_t to = min(end, (uint32_t)(it->first + it->second.size()));
+
+		if (from < to) {
+			memcpy(buffer + (from - address), &it->second[from - it->first], to - from);
+		}
+	}
+}
+
+CMemoryImage::~CMemoryImage() {
+
+}
@@ -0,0 +1,112 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CMEMORYIMAGE_H_
+#define CMEMORYIMAGE_H_
+
+#include <inttypes.h>
+#include <map>
+#include <vector>
+#include "CMemorySink.h"
+
+using namespace std;
+
+/**
+ * @brief	Sparse memory content, stored as a sorted set of segments.
+ *
+ * Each segment is a block of consecutive bytes. Segments never overlap and are never adjacent;
+ * data which overlaps or touches existing segments is merged with them, where the new data
+ * overwrites the old content. Appending to the end of a segment (the usual case when reading a
+ * file record by record) does not copy the segment.
+ *
+ * Memory operations process the image in chunks (see nextChunk() and readChunk()), hence only
+ * chunks with content are touched. A gap of 256 KiB between two segments costs no memory.
+ */
+class CMemoryImage : public CMemorySink {
+public:
+	/// segments sorted by their start address
+	typedef map<uint32_t, vector<uint8_t> > segments_t;
+
+	CMemoryImage();
+	virtual ~CMemoryImage();
+
+	/**
+	 * @brief	Store a block of memory content (see CMemorySink).
+	 *
+	 * @param	address	Address of the first byte.
+	 * @param	data	Byte array.
+	 * @param	len		Length of \a data.
+	 */
+	virtual void addData(uint32_t address, const uint8_t *data, int len);
+
+	/**
+	 * @return	Address behind the last byte of the image, 0 for an empty image.
+	 */
+	uint32_t size();
+
+	/**
+	 * @brief	Check if a block of memory contains content of the image.
+	 *
+	 * @param	address	Address of the first byte.
+	 * @param	len		Length of the block.
+	 * @return	true if at least one byte of [address, address+len) is part of the image.
+	 */
+	bool overlaps(uint32_t address, int len);
+
+	/**
+	 * @return	All segments of the image.
+	 */
+	const segments_t &getSegments();
+
+	/**
+	 * @brief	Find the next chunk with content.
+	 *
+	 * @param	chunk		Number of the first chunk to look at.
+	 * @param	chunkSize	Size of a chunk in bytes.
+	 * @return	Number of the first chunk (not smaller than \a chunk) which contains at least one byte of the image, -1 if there is none.
+	 */
+	int nextChunk(int chunk, int chunkSize);
+
+	/**
+	 * @brief	Copy a chunk of the image.
+	 *
+	 * @param	chunk		Number of the chunk.
+	 * @param	chunkSize	Size of a chunk in bytes.
+	 * @param	fill		Value of bytes which are not part of the image.
+	 * @param	buffer		Receives \a chunkSize bytes.
+	 * @return	true if the chunk contains at least one byte of the image.
+	 */
+	bool readChunk(int chunk, int chunkSize, uint8_t fill, uint8_t *buffer);
+
+	/**
+	 * @brief	Copy the image to a contiguous buffer.
+	 *
+	 * @param	buffer	Receives \a size bytes, starting at address 0.
+	 * @param	size	Length of \a buffer.
+	 * @param	fill	Value of bytes which are not part of the image.
+	 */
+	void flatten(uint8_t *buffer, int size, uint8_t fill);
+
+private:
+	segments_t segments;
+
+	void copy(uint32_t address, int size, uint8_t *buffer);
+};
+
+#endif /* CMEMORYIMAGE_H_ */
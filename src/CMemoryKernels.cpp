@@ -0,0 +1,319 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CMemoryKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define X86_KERNELS 0
+#endif
+
+using namespace std;
+
+/*
+ * Each operation has a scalar, a SSE2 and an AVX2 implementation. The SIMD versions process
+ * blocks of 16 or 32 bytes and use the scalar code for the remaining bytes.
+ *
+ * Checksums are accumulated with psadbw (sum of absolute differences against zero), which adds
+ * 8 bytes into one 64 bit lane. The sum is truncated to 16 bit at the end, which gives the same
+ * result as a 16 bit accumulator.
+ *
+ * Hex encoding splits each byte into two nibbles, converts both to ASCII with a compare and add
+ * (digits above 9 get an offset of 7 to reach 'A') and interleaves high and low digits.
+ */
+
+// scalar implementations
+
+static bool scanScalar(const uint8_t *buffer, int size, uint8_t emptyByte, uint16_t *checksum) {
+	uint16_t sum = 0;
+	uint8_t diff = 0;
+
+	for (int i=0; i<size; i++) {
+		sum += buffer[i];
+		diff |= buffer[i] ^ emptyByte;
+	}
+
+	*checksum = sum;
+	return diff == 0;
+}
+
+static int trimmedSizeScalar(const uint8_t *buffer, int size, uint8_t emptyByte) {
+	while (size > 0 && buffer[size-1] == emptyByte) {
+		size--;
+	}
+	return size;
+}
+
+static int compareScalar(const uint8_t *a, const uint8_t *b, int size) {
+	for (int i=0; i<size; i++) {
+		if (a[i] != b[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void toHexScalar(const uint8_t *buffer, int size, char *hex) {
+	static const char digits[] = "0123456789ABCDEF";
+
+	for (int i=0; i<size; i++) {
+		hex[2*i] = digits[buffer[i] >> 4];
+		hex[2*i+1] = digits[buffer[i] & 0x0f];
+	}
+}
+
+#if X86_KERNELS
+
+// SSE2 implementations
+
+__attribute__((target("sse2")))
+static bool scanSSE2(const uint8_t *buffer, int size, uint8_t emptyByte, uint16_t *checksum) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i empty = _mm_set1_epi8((char)emptyByte);
+	__m128i sum = _mm_setzero_si128();
+	__m128i equal = _mm_cmpeq_epi8(zero, zero);		// all ones
+	uint16_t tailSum;
+	int i;
+
+	for (i=0; i+16<=size; i+=16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(buffer+i));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+		equal = _mm_and_si128(equal, _mm_cmpeq_epi8(v, empty));
+	}
+
+	bool tailEmpty = scanScalar(buffer+i, size-i, emptyByte, &tailSum);
+	*checksum = (uint16_t)(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum)) + tailSum);
+
+	return tailEmpty && _mm_movemask_epi8(equal) == 0xffff;
+}
+
+__attribute__((target("sse2")))
+static int trimmedSizeSSE2(const uint8_t *buffer, int size, uint8_t emptyByte) {
+	const __m128i empty = _mm_set1_epi8((char)emptyByte);
+
+	// unaligned tail
+	while ((size % 16) != 0) {
+		if (buffer[size-1] != emptyByte) {
+			return size;
+		}
+		size--;
+	}
+
+	for (; size>0; size-=16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(buffer+size-16));
+		unsigned int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, empty)) & 0xffff;
+		if (mask != 0) {
+			return size - 16 + (31 - __builtin_clz(mask)) + 1;
+		}
+	}
+	return 0;
+}
+
+__attribute__((target("sse2")))
+static int compareSSE2(const uint8_t *a, const uint8_t *b, int size) {
+	int i;
+
+	for (i=0; i+16<=size; i+=16) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a+i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b+i));
+		unsigned int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xffff;
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	int tail = compareScalar(a+i, b+i, size-i);
+	return (tail < 0) ? -1 : i + tail;
+}
+
+__attribute__((target("sse2")))
+static inline __m128i nibblesToHexSSE2(__m128i nibbles) {
+	__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+__attribute__((target("sse2")))
+static void toHexSSE2(const uint8_t *buffer, int size, char *hex) {
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	int i;
+
+	for (i=0; i+16<=size; i+=16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(buffer+i));
+		__m128i high = nibblesToHexSSE2(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		__m128i low = nibblesToHexSSE2(_mm_and_si128(v, mask));
+		_mm_storeu_si128((__m128i*)(hex+2*i), _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128((__m128i*)(hex+2*i+16), _mm_unpackhi_epi8(high, low));
+	}
+
+	toHexScalar(buffer+i, size-i, hex+2*i);
+}
+
+// AVX2 implementations
+
+__attribute__((target("avx2")))
+static bool scanAVX2(const uint8_t *buffer, int size, uint8_t emptyByte, uint16_t *checksum) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i empty = _mm256_set1_epi8((char)emptyByte);
+	__m256i sum = _mm256_setzero_si256();
+	__m256i equal = _mm256_cmpeq_epi8(zero, zero);	// all ones
+	uint16_t tailSum;
+	int i;
+
+	for (i=0; i+32<=size; i+=32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buffer+i));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(v, zero));
+		equal = _mm256_and_si256(equal, _mm256_cmpeq_epi8(v, empty));
+	}
+
+	bool tailEmpty = scanScalar(buffer+i, size-i, emptyByte, &tailSum);
+	__m128i sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	*checksum = (uint16_t)(_mm_cvtsi128_si32(sum128) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum128, sum128)) + tailSum);
+
+	return tailEmpty && _mm256_movemask_epi8(equal) == -1;
+}
+
+__attribute__((target("avx2")))
+static int trimmedSizeAVX2(const uint8_t *buffer, int size, uint8_t emptyByte) {
+	const __m256i empty = _mm256_set1_epi8((char)emptyByte);
+
+	// unaligned tail
+	while ((size % 32) != 0) {
+		if (buffer[size-1] != emptyByte) {
+			return size;
+		}
+		size--;
+	}
+
+	for (; size>0; size-=32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buffer+size-32));
+		unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, empty));
+		if (mask != 0) {
+			return size - 32 + (31 - __builtin_clz(mask)) + 1;
+		}
+	}
+	return 0;
+}
+
+__attribute__((target("avx2")))
+static int compareAVX2(const uint8_t *a, const uint8_t *b, int size) {
+	int i;
+
+	for (i=0; i+32<=size; i+=32) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a+i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b+i));
+		unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	int tail = compareScalar(a+i, b+i, size-i);
+	return (tail < 0) ? -1 : i + tail;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i nibblesToHexAVX2(__m256i nibbles) {
+	__m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), _mm256_set1_epi8('A' - '0' - 10));
+	return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+static void toHexAVX2(const uint8_t *buffer, int size, char *hex) {
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	int i;
+
+	for (i=0; i+32<=size; i+=32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buffer+i));
+		__m256i high = nibblesToHexAVX2(_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		__m256i low = nibblesToHexAVX2(_mm256_and_si256(v, mask));
+		// unpack works within 128 bit lanes, the permutation restores the byte order
+		__m256i a = _mm256_unpacklo_epi8(high, low);
+		__m256i b = _mm256_unpackhi_epi8(high, low);
+		_mm256_storeu_si256((__m256i*)(hex+2*i), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i*)(hex+2*i+32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+
+	toHexSSE2(buffer+i, size-i, hex+2*i);
+}
+
+#endif
+
+// runtime dispatch
+
+typedef struct {
+	const char *name;
+	bool (*scan)(const uint8_t *buffer, int size, uint8_t emptyByte, uint16_t *checksum);
+	int (*trimmedSize)(const uint8_t *buffer, int size, uint8_t emptyByte);
+	int (*compare)(const uint8_t *a, const uint8_t *b, int size);
+	void (*toHex)(const uint8_t *buffer, int size, char *hex);
+} kernels_t;
+
+static const kernels_t scalarKernels = {"scalar", scanScalar, trimmedSizeScalar, compareScalar, toHexScalar};
+#if X86_KERNELS
+static const kernels_t sse2Kernels = {"sse2", scanSSE2, trimmedSizeSSE2, compareSSE2, toHexSSE2};
+static const kernels_t avx2Kernels = {"avx2", scanAVX2, trimmedSizeAVX2, compareAVX2, toHexAVX2};
+#endif
+
+static const kernels_t *selectKernels() {
+#if X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return &avx2Kernels;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return &sse2Kernels;
+	}
+#endif
+	return &scalarKernels;
+}
+
+static const kernels_t *kernels = selectKernels();
+
+bool CMemoryKernels::scan(const uint8_t *buffer, int size, uint8_t emptyByte, uint16_t *checksum) {
+	return kernels->scan(buffer, size, emptyByte, checksum);
+}
+
+uint16_t CMemoryKernels::checksum(const uint8_t *buffer, int size) {
+	uint16_t checksum;
+
+	kernels->scan(buffer, size, 0x00, &checksum);
+	return checksum;
+}
+
+bool CMemoryKernels::isEmpty(const uint8_t *buffer, int size, uint8_t emptyByte) {
+	return kernels->trimmedSize(buffer, size, emptyByte) == 0;
+}
+
+int CMemoryKernels::trimmedSize(const uint8_t *buffer, int size, uint8_t emptyByte) {
+	return kernels->trimmedSize(buffer, size, emptyByte);
+}
+
+int CMemoryKernels::compare(const uint8_t *a, const uint8_t *b, int size) {
+	return kernels->compare(a, b, size);
+}
+
+void CMemoryKernels::toHex(const uint8_t *buffer, int size, char *hex) {
+	kernels->toHex(buffer, size, hex);
+}
+
+string CMemoryKernels::implementation() {
+	return kernels->name;
+}
@@ -0,0 +1,100 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CMEMORYKERNELS_H_
+#define CMEMORYKERNELS_H_
+
+#include <inttypes.h>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief	Byte operations on chunks and memory images.
+ *
+ * These functions run over every chunk which is transferred to the programmer and over whole
+ * memory images. On x86 processors SSE2 or AVX2 implementations are selected at runtime,
+ * otherwise (or if the processor supports neither of them) a scalar implementation is used.
+ */
+class CMemoryKernels {
+public:
+	/**
+	 * @brief	Checksum (16 bit sum of all bytes) and emptiness of a buffer in one pass.
+	 *
+	 * @param	buffer		Byte array.
+	 * @param	size		Length of \a buffer.
+	 * @param	emptyByte	Value of an empty byte.
+	 * @param	checksum	The checksum of \a buffer is returned here.
+	 * @return	true if all bytes in \a buffer are equal to \a emptyByte.
+	 */
+	static bool scan(const uint8_t *buffer, int size, uint8_t emptyByte, uint16_t *checksum);
+
+	/**
+	 * @param	buffer		Byte array.
+	 * @param	size		Length of \a buffer.
+	 * @return	16 bit sum of all bytes in \a buffer.
+	 */
+	static uint16_t checksum(const uint8_t *buffer, int size);
+
+	/**
+	 * @param	buffer		Byte array.
+	 * @param	size		Length of \a buffer.
+	 * @param	emptyByte	Value of an empty byte.
+	 * @return	true if all bytes in \a buffer are equal to \a emptyByte.
+	 */
+	static bool isEmpty(const uint8_t *buffer, int size, uint8_t emptyByte);
+
+	/**
+	 * @brief	Length of a buffer without trailing empty bytes.
+	 *
+	 * The buffer is scanned backwards, hence only the trailing empty bytes are touched.
+	 *
+	 * @param	buffer		Byte array.
+	 * @param	size		Length of \a buffer.
+	 * @param	emptyByte	Value of an empty byte.
+	 * @return	Index of the last byte which is not \a emptyByte plus one, 0 if the buffer is empty.
+	 */
+	static int trimmedSize(const uint8_t *buffer, int size, uint8_t emptyByte);
+
+	/**
+	 * @brief	Compares two buffers.
+	 *
+	 * @param	a		Byte array.
+	 * @param	b		Byte array.
+	 * @param	size	Length of \a a and \a b.
+	 * @return	Index of the first byte which differs, -1 if both buffers are equal.
+	 */
+	static int compare(const uint8_t *a, const uint8_t *b, int size);
+
+	/**
+	 * @brief	Encodes a buffer as upper case hex digits.
+	 *
+	 * @param	buffer	Byte array.
+	 * @param	size	Length of \a buffer.
+	 * @param	hex		Receives 2 * \a size characters (no terminating zero).
+	 */
+	static void toHex(const uint8_t *buffer, int size, char *hex);
+
+	/**
+	 * @return	Name of the selected implementation (avx2, sse2 or scalar).
+	 */
+	static string implementation();
+};
+
+#endif /* CMEMORYKERNELS_H_ */
@@ -28,151 +28,340 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <string.h>
 #include <boost/foreach.hpp>
 #include <cstring>
+#include <algorithm>
 #include "CFormat.h"
+#include "CBinaryFile.h"
+#include "CIntelHexReader.h"
+#include "CSRecordReader.h"
+#include "CImageCache.h"
 #include "avrprog.h"
 #include "COut.h"
 
 using namespace std;
 
 
-CMemoryOptions::CMemoryOptions(string options, offset_t offsetType, vector<string> sectionNames) : CProgramOptions(options), buffer(NULL), bufferLen(0) {
-	bfd *inputFile;
-
+CMemoryOptions::CMemoryOptions(string options, offset_t _offsetType, vector<string> _sectionNames, bool deferred, bool cache) : CProgramOptions(options),
+		buffer(NULL), elfFile(NULL), target(&image), current(&image), sectionNames(_sectionNames), offsetType(_offsetType), sectionCount(0), nextAddress(0), sectionOffset(0) {
 	if (this->type == IMMEDIATE) {
 		// nothing to do here
 		return;
 	}
 
-	if (operation == WRITE || operation == VERIFY) {
-		char *target = NULL;
-		
-		bfd_init();
+	if (deferred && operation == WRITE) {
+		if (sources.size() > 1 || (this->type != HEX && this->type != SREC && this->type != BIN)) {
+			throw ProgramOptionsException("Streaming requires a single hex, S-record or binary file.");
+		}
+		return;
+	}
+
+	if (this->type == BUNDLE) {
+		// mapped by CFlashOptions
+		return;
+	}
+
+	if ((operation == WRITE || operation == VERIFY) && sources.size() > 1) {
+		loadOverlay(cache);
+	}
+	else if (operation == WRITE || operation == VERIFY) {
+		if (cache && !standardStream) {
+			loadCached(&image);
+		}
+		else {
+			load(&image);
+		}
+	}
+}
+
+void CMemoryOptions::load(CMemorySink *sink) {
+	target = sink;
+
+	switch (this->type) {
+	case IMMEDIATE:
+	case BUNDLE:
+		// do nothing
+		break;
+	case HEX:
+	case SREC:
+		loadRecordFile();
+		break;
+	case ELF:
+		loadElfFile();
+		break;
+	case BIN:
+		loadBinaryFile();
+		break;
+	}
+}
+
+/*
+ * load several files into one image, each file is loaded into its own image first
+ *
+ * The files must not overlap, in contrast to the sections within one file.
+ */
+void CMemoryOptions::loadOverlay(bool cache) {
+	for (unsigned int i=0; i<sources.size(); i++) {
+		CMemoryImage part;
 
-		// open file
-		inputFile = bfd_openr(this->source.c_str(), target);
-		if (inputFile == NULL) {
-			throw ProgramOptionsException("Could not open file '" + this->source + "'");
+		selectSource(i);
+		current = &part;
+		if (cache) {
+			loadCached(&part);
+		}
+		else {
+			load(&part);
 		}
 
-		// check file format
-		if (!bfd_check_format (inputFile, bfd_object)) {
-			if (bfd_get_error () != bfd_error_file_ambiguously_recognized) {
-				throw ProgramOptionsException("Incompatible file format in '" + this->source + "'");
+		const CMemoryImage::segments_t &segments = part.getSegments();
+		for (CMemoryImage::segments_t::const_iterator it = segments.begin(); it != segments.end(); it++) {
+			if (image.overlaps(it->first, it->second.size())) {
+				throw ProgramOptionsException("'" + this->source + "' (0x" + CFormat::intToHexString(it->first) + " - 0x"
+						+ CFormat::intToHexString(it->first + it->second.size() - 1) + ") overlaps with a previous file.");
 			}
 		}
+		for (CMemoryImage::segments_t::const_iterator it = segments.begin(); it != segments.end(); it++) {
+			image.addData(it->first, it->second.data(), it->second.size());
+		}
+	}
 
-		//printf("Entry point is at address %d\n",bfd_get_start_address(inputFile));
+	// the accessors describe the first file
+	selectSource(0);
+	current = &image;
+	target = &image;
+}
 
-		// print sections
-		//for (asection *section = inputFile->sections; section; section = section->next) {
-		//	cout << section->name << endl;
-		//	cout << section->flags << endl;
-		//	//cout << section->output_section->name << endl << endl;
-		//}
+/*
+ * set up the loaders for one of the files
+ */
+void CMemoryOptions::selectSource(int index) {
+	this->source = sources[index].path;
+	type = sources[index].type;
+	baseAddress = sources[index].baseAddress;
+	compressed = sources[index].compressed;
+	sectionCount = 0;
+	nextAddress = 0;
+	sectionOffset = 0;
+}
 
-		if (operation == WRITE || operation == VERIFY) {
-			int sectionCount = 0;
+/*
+ * load the image from the image cache, or parse the file and store the image in the cache
+ *
+ * The image depends on the file and everything which affects the parsing, a new version of
+ * avrprog does not use images of older versions.
+ */
+void CMemoryOptions::loadCached(CMemoryImage *destination) {
+	CImageCache cache;
+	string parameters = (string)PACKAGE_STRING + "\n" + CFormat::intToString(this->type) + " " + CFormat::intToString(offsetType) + " "
+			+ CFormat::intToString(baseAddress);
 
-			asection *section;
+	BOOST_FOREACH(string sectionName, sectionNames) {
+		parameters += " " + sectionName;
+	}
 
-			switch (this->type) {
-			case IMMEDIATE:
-				// do nothing
-				break;
-			case HEX:
-				COut::d("Load hex file");
-				// load all sections from an ihex file
+	if (!cache.load(this->source, parameters, destination)) {
+		load(destination);
+		cache.store(this->source, parameters, destination);
+	}
+}
 
-				// check file format
-				if (strcmp(bfd_get_target(inputFile), "ihex") != 0) {
-					throw ProgramOptionsException("Incompatible file format in '" + this->source + "'. Expected an 'ihex' file.");
-				}
+/*
+ * load all records of an ihex or S-record file, the records are passed to addData()
+ */
+void CMemoryOptions::loadRecordFile() {
+	CInputStream *input;
+	CRecordReader *reader = NULL;
 
-				// loop sections
-				for (section = inputFile->sections; section; section = section->next) {
-					sectionCount++;
-					// add section to buffer
-					if (offsetType == SECTION_OFFSET)
-						addSectionToBuffer(inputFile, section, section->lma);
-					else
-						addSectionToBuffer(inputFile, section, bufferLen);
-				}
+	COut::d(this->type == SREC ? "Load S-record file" : "Load hex file");
 
-				if (sectionCount == 0) {
-					throw ProgramOptionsException("No data found in '" + this->source + "'.");
-				}
+	try {
+		input = CInputStream::open(this->source);
+	}
+	catch (StreamException &e) {
+		throw ProgramOptionsException(e.what());
+	}
 
-				break;
-			case ELF:
-				COut::d("Load elf file.");
-				// load the given sections from an elf file
-				BOOST_FOREACH(string sectionName, sectionNames) {
-					sectionCount++;
-					// get section
-					section = bfd_get_section_by_name(inputFile, sectionName.c_str());
-					if (section == NULL) {
-						// the first section is mandatory
-						if (sectionCount == 1) {
-							throw ProgramOptionsException("No '" + (string)sectionName + "' section found in '" + this->source + "'.");
-						}
-						else {
-							continue;
-						}
-					}
-					if (offsetType == SECTION_OFFSET)
-						addSectionToBuffer(inputFile, section, section->lma);
-					else
-						addSectionToBuffer(inputFile, section, bufferLen);
-				}
-				break;
-			}
+	try {
+		if (this->type == SREC) {
+			reader = new CSRecordReader(input);
+		}
+		else {
+			reader = new CIntelHexReader(input);
+		}
+		reader->read(this);
+	}
+	catch (...) {
+		delete reader;
+		delete input;
+		throw;
+	}
+	delete reader;
+	delete input;
+
+	if (sectionCount == 0) {
+		throw ProgramOptionsException("No data found in '" + this->source + "'.");
+	}
+}
+
+/*
+ * load a binary file as one section at the base address
+ *
+ * A binary file has no load addresses which could be ignored, hence the base address is used
+ * for all memories (see addData()). Compressed files and standard input cannot be mapped, they
+ * are read as a stream.
+ */
+void CMemoryOptions::loadBinaryFile() {
+	CBinaryFile file(this->source);
+
+	COut::d("Load binary file at 0x" + CFormat::intToHexString(baseAddress) + ".");
+
+	if (compressed || standardStream) {
+		CInputStream *input;
+
+		try {
+			input = CInputStream::open(this->source);
+		}
+		catch (StreamException &e) {
+			throw ProgramOptionsException(e.what());
+		}
+
+		try {
+			file.load(input, baseAddress, this);
+		}
+		catch (StreamException &e) {
+			delete input;
+			throw ProgramOptionsException(e.what());
+		}
+		catch (...) {
+			delete input;
+			throw;
+		}
+		delete input;
+	}
+	else {
+		try {
+			file.load(baseAddress, this);
+		}
+		catch (FileException &e) {
+			throw ProgramOptionsException(e.what());
 		}
-		bfd_close(inputFile);
+	}
+
+	if (sectionCount == 0) {
+		throw ProgramOptionsException("No data found in '" + this->source + "'.");
 	}
 }
 
-void CMemoryOptions::addSectionToBuffer(bfd *inputFile, asection *section, int offset) {
-	uint8_t *oldBuffer;
-	int oldSize;
+/*
+ * load the given sections from an elf file
+ */
+void CMemoryOptions::loadElfFile() {
+	// several elf files may be loaded into one image
+	if (elfFile != NULL) {
+		elfFile->release();
+		elfFile = NULL;
+	}
 
-	oldBuffer = buffer;						// remember buffer
-	oldSize = bufferLen;
+	try {
+		elfFile = CElfFile::open(this->source);
+	}
+	catch (ElfException &e) {
+		throw ProgramOptionsException(e.what());
+	}
+
+	COut::d("Load elf file.");
+	try {
+		BOOST_FOREACH(string sectionName, sectionNames) {
+			sectionCount++;
+			if (!elfFile->hasSection(sectionName)) {
+				// the first section is mandatory
+				if (sectionCount == 1) {
+					throw ProgramOptionsException("No '" + (string)sectionName + "' section found in '" + this->source + "'.");
+				}
+				else {
+					continue;
+				}
+			}
+			if (offsetType == SECTION_OFFSET)
+				addSectionToImage(sectionName, elfFile->sectionLma(sectionName) + baseAddress);
+			else
+				addSectionToImage(sectionName, bufferEnd());
+		}
+	}
+	catch (...) {
+		// the destructor is not called, if the constructor fails
+		elfFile->release();
+		elfFile = NULL;
+		throw;
+	}
+}
 
+void CMemoryOptions::addSectionToImage(string name, uint32_t offset) {
 	if (offset >= MAX_SECTION_OFFSET) {
 		throw ProgramOptionsException("Cannot load sections above 0x" + CFormat::intToHexString(MAX_SECTION_OFFSET) + ".");
 	}
 
-	COut::d("\tAdd section: '" + (string)section->name + "' at 0x" + CFormat::intToHexString(offset) + ".");
+	COut::d("\tAdd section: '" + name + "' at 0x" + CFormat::intToHexString(offset) + ".");
 
-	// determine new size and extend buffer
-	if ((int)(offset + section->size) > bufferLen) {
-		bufferLen = offset + section->size;
+	// the content is copied directly from the mapped file
+	elfFile->readSection(name, offset, target);
+}
 
-		buffer = new uint8_t[bufferLen];
-		memcpy(buffer, oldBuffer, oldSize);		// copy old buffer
-		delete[] oldBuffer;
+void CMemoryOptions::addData(uint32_t address, const uint8_t *data, int len) {
+	uint32_t offset;
 
-		// initialize extended buffer
-		memset(buffer + oldSize, 0xff, bufferLen - oldSize);
-		COut::d("\tExtend buffer to: " + CFormat::intToString(bufferLen) + " bytes.");
+	// a block which does not continue the previous one starts a new section
+	if (sectionCount == 0 || address != nextAddress) {
+		sectionCount++;
+		if (this->type == BIN) {
+			// the base address is already applied
+			sectionOffset = 0;
+		}
+		else if (offsetType == SECTION_OFFSET) {
+			sectionOffset = baseAddress;
+		}
+		else {
+			sectionOffset = bufferEnd() - address;
+		}
+		COut::d("\tAdd section: '.sec" + CFormat::intToString(sectionCount) + "' at 0x" + CFormat::intToHexString(address + sectionOffset) + ".");
 	}
+	nextAddress = address + len;
 
-	// read section and add it to buffer
-	if (!bfd_get_section_contents(inputFile, section, buffer+offset, 0, section->size)) {
-		throw ProgramOptionsException("Error while reading '" + this->source + "'");
+	offset = address + sectionOffset;
+	if (offset + len > MAX_SECTION_OFFSET) {
+		throw ProgramOptionsException("Cannot load sections above 0x" + CFormat::intToHexString(MAX_SECTION_OFFSET) + ".");
 	}
+
+	target->addData(offset, data, len);
+}
+
+/*
+ * address of the next section if lma entries are ignored: the end of the loaded file, but not
+ * in front of its base address
+ */
+uint32_t CMemoryOptions::bufferEnd() {
+	return max(current->size(), baseAddress);
+}
+
+CMemoryImage *CMemoryOptions::getImage() {
+	return &image;
 }
 
 uint8_t *CMemoryOptions::getBuffer() {
+	if (buffer == NULL && image.size() > 0) {
+		buffer = new uint8_t[image.size()];
+		image.flatten(buffer, image.size(), 0xff);
+	}
 	return buffer;
 }
 
 int CMemoryOptions::getBufferSize() {
-	return bufferLen;
+	return image.size();
 }
 
 CMemoryOptions::~CMemoryOptions() {
 	if (buffer != NULL) {
 		delete[] buffer;
 	}
+	if (elfFile != NULL) {
+		elfFile->release();
+	}
 }
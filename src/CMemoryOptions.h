@@ -21,9 +21,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define CMEMORYOPTIONS_H_
 
 #include "CProgramOptions.h"
+#include "CMemoryImage.h"
+#include "CMemorySink.h"
+#include "CElfFile.h"
 #include <inttypes.h>
 #include "config.h"
-#include <bfd.h>
 #include <vector>
 
 /// Specifies the offset type, when reading ihex and elf files.
@@ -35,35 +37,63 @@ typedef enum {
 /**
  * @brief	Parses command a line argument of a memory operations.
  *
- * Further it parses ihex and elf files to a byte buffer.
+ * Further it parses ihex, S-record, binary and elf files to a memory image (see CMemoryImage). Hex files
+ * are read with CIntelHexReader, S-record files with CSRecordReader, binary files with CBinaryFile and elf
+ * files with CElfFile.
+ *
+ * If the argument contains several files (e.g. w:boot.hex,app.elf@0x0), each file is loaded
+ * and added to one image. The files must not overlap.
  *
  * For the parsing of the argument look at CProgramOptions.
  *
  * @throws	ProgramOptionsException on errors.
  */
-class CMemoryOptions : public CProgramOptions {
+class CMemoryOptions : public CProgramOptions, public CMemorySink {
 public:
 	/**
 	 * @brief	Parses a command line argument and open the corresponding file.
 	 *
-	 * This class can read files in ihex and elf format.
+	 * This class can read files in ihex, S-record, binary and elf format.
 	 *
-	 * If a *.hex file was detected this class loads all sections into its buffer. When a *.elf file is given, it
-	 * copies only the sections in \a sectionNames to the internal buffer.
+	 * If a *.hex or *.srec file was detected this class loads all sections into its image. A section of such a
+	 * file is a block of consecutive data records. A *.bin file is loaded as one section at its base address.
+	 * When a *.elf file is given, it copies only the sections in \a sectionNames to the image.
 	 *
 	 * According to the given \a offsetType the lma entries in the sections are condidered (\a SECTION_OFFSET) or ignored (\a BUFFER_OFFSET).
 	 *
-	 * If neither a *hex nor a *.elf file was detected, this class does nothing.
+	 * If no file was detected, this class does nothing.
 	 *
 	 * @param	options		Command line argument.
 	 * @param	offsetType	Interpretation of lma entries.
 	 * @param	sectionNames	List of section names which should be read from an *.elf file. The first section is mandatory, all others are ignored if they are not present in a file.
+	 * @param	deferred	Do not load the file of a write operation, it is loaded later with load(). Only hex, S-record and binary files are supported.
+	 * @param	cache		Look up the image in the image cache (see CImageCache) before the file is parsed, and store it afterwards.
 	 */
-	CMemoryOptions(string options, offset_t offsetType, vector<string> sectionNames);
+	CMemoryOptions(string options, offset_t offsetType, vector<string> sectionNames, bool deferred = false, bool cache = false);
 	virtual ~CMemoryOptions();
 
+	/**
+	 * @brief	Load the file into another sink than the image, e.g. for streaming (see CChunkStream).
+	 *
+	 * Only used for deferred options, the content passes the same section handling as when
+	 * it is loaded into the image.
+	 *
+	 * @param	sink	Receives the file content.
+	 */
+	void load(CMemorySink *sink);
+
+	/**
+	 * @brief	Get the file contents.
+	 * @return	Pointer to the image. This pointer is valid as long as this object exists.
+	 */
+	CMemoryImage *getImage();
+
 	/**
 	 * @brief	Get a buffer with a binary representation of the file contents.
+	 *
+	 * The buffer starts at address 0, gaps between the sections are filled with 0xff. It is created
+	 * at the first call, memory operations which only need the image do not create it.
+	 *
 	 * @return	Pointer to the buffer. This pointer is valid as long as this object exists.
 	 */
 	uint8_t *getBuffer();
@@ -73,18 +103,39 @@ public:
 	 */
 	int getBufferSize();
 
+	/**
+	 * @brief	Add a block of a hex file to the image (see CMemorySink).
+	 *
+	 * A block which does not continue the previous block starts a new section.
+	 */
+	virtual void addData(uint32_t address, const uint8_t *data, int len);
+
 protected:
-	uint8_t *buffer;
-	int bufferLen;
+	CMemoryImage image;
 
 private:
+	uint8_t *buffer;		// flat copy of image, created by getBuffer()
+	CElfFile *elfFile;		// kept open, such that other options on the same file share the mapping
+	CMemorySink *target;	// receives the file content, usually the image
+	CMemoryImage *current;	// image of the file which is loaded, it differs from image if several files are loaded
+	vector<string> sectionNames;
+	offset_t offsetType;
+	int sectionCount;
+	uint32_t nextAddress;	// address behind the last block passed to addData()
+	int sectionOffset;		// offset of the current hex section in the image relative to its address
+
+	void loadOverlay(bool cache);
+	void selectSource(int index);
+	void loadCached(CMemoryImage *destination);
+	void loadRecordFile();
+	void loadBinaryFile();
+	void loadElfFile();
+	uint32_t bufferEnd();
+
 	/**
-	 * @brief	Adds a the content of section to the buffer.
-	 *
-	 * This method automatically extends the size of the buffer such that
-	 * the new section fits into it.
+	 * @brief	Adds a the content of section to the image.
 	 */
-	void addSectionToBuffer(bfd *inputFile, asection *section, int offset);
+	void addSectionToImage(string name, uint32_t offset);
 };
 
 #endif /* CMEMORYOPTIONS_H_ */
@@ -0,0 +1,44 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CMEMORYSINK_H_
+#define CMEMORYSINK_H_
+
+#include <inttypes.h>
+
+/**
+ * @brief	Receiver of memory content, which is produced by a file reader.
+ *
+ * Readers call addData() for each block of bytes they decode, in the order of the input file.
+ */
+class CMemorySink {
+public:
+	virtual ~CMemorySink() {}
+
+	/**
+	 * @brief	Store a block of memory content.
+	 *
+	 * @param	address	Load address of the first byte.
+	 * @param	data	Byte array, only valid during the call.
+	 * @param	len		Length of \a data.
+	 */
+	virtual void addData(uint32_t address, const uint8_t *data, int len) = 0;
+};
+
+#endif /* CMEMORYSINK_H_ */
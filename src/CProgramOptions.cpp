@@ -19,9 +19,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "CProgramOptions.h"
 #include <boost/algorithm/string.hpp>
+#include "CFormat.h"
 #include "CLArgumentException.h"
 
-CProgramOptions::CProgramOptions(string options) {
+CProgramOptions::CProgramOptions(string options) : baseAddress(0), compressed(false), standardStream(false) {
 	// parse options string
 	// it should look like: (r|w|v):source
 
@@ -46,27 +47,130 @@ CProgramOptions::CProgramOptions(string options) {
 		throw CLArgumentException("Unsupported memory operation '" + operation + "'");
 	}
 
-	// check source (path or immediate value) and determine type
-	this->source = options.substr(2, options.length());
+	// check sources (paths or immediate value), several files are separated by ','
+	string value = options.substr(2, options.length());
+	vector<string> parts;
+
+	boost::split(parts, value, boost::is_any_of(","));
+	if (parts.size() > 1 && parts[0].find('.') == string::npos && parts[0].substr(0, 2).compare("-:") != 0) {
+		// immediate values, e.g. fuse bytes
+		parts.assign(1, value);
+	}
+
+	for (unsigned int i=0; i<parts.size(); i++) {
+		source_t source;
+
+		parseSource(parts[i]);
+		if (parts.size() > 1) {
+			if (this->operation == READ) {
+				throw ProgramOptionsException("Only one file can be read.");
+			}
+			if (type == IMMEDIATE || type == BUNDLE || standardStream) {
+				throw ProgramOptionsException("'" + parts[i] + "' cannot be combined with other files.");
+			}
+		}
+		source.path = this->source;
+		source.type = type;
+		source.baseAddress = baseAddress;
+		source.compressed = compressed;
+		sources.push_back(source);
+	}
+
+	// the first source is the one of a single file operation
+	this->source = sources[0].path;
+	type = sources[0].type;
+	baseAddress = sources[0].baseAddress;
+	compressed = sources[0].compressed;
+}
+
+/*
+ * parse one path or immediate value and determine its type
+ */
+void CProgramOptions::parseSource(string value) {
+	baseAddress = 0;
+	compressed = false;
+	this->source = value;
+
+	// standard input/output with an explicit format (e.g. -:hex), the format is parsed like an extension
+	if (this->source.substr(0, 2).compare("-:") == 0) {
+		this->source = "-." + this->source.substr(2);
+		standardStream = true;
+	}
 
 	size_t dot = this->source.rfind('.');
+	size_t at = this->source.rfind('@');
+	string base = "";
+
+	// split the base address from the path
+	if (dot != this->source.npos && at != this->source.npos && at > dot) {
+		base = this->source.substr(at+1);
+		this->source = this->source.substr(0, at);
+
+		bool hex = base.substr(0, 2).compare("0x") == 0;
+		string digits = hex ? base.substr(2) : base;
+		if (digits.size() == 0 || digits.find_first_not_of(hex ? "0123456789abcdefABCDEF" : "0123456789") != digits.npos) {
+			throw ProgramOptionsException("Invalid base address '" + base + "'");
+		}
+		baseAddress = CFormat::stringToInt(base);
+	}
+
 	if (dot == this->source.npos) {
 		type = IMMEDIATE;
 	}
 	else {
-		string fileExtension = this->source.substr(dot+1, 4);
+		string fileExtension = this->source.substr(dot+1);
 		boost::to_lower(fileExtension);
 
+		// the type of a compressed file is given by the extension in front of the compression suffix
+		if (fileExtension.compare("gz") == 0 || fileExtension.compare("zst") == 0) {
+			size_t innerDot = (dot > 0) ? this->source.rfind('.', dot-1) : this->source.npos;
+			if (innerDot == this->source.npos) {
+				throw ProgramOptionsException("Unknown filetype of compressed file '" + this->source + "'");
+			}
+			fileExtension = this->source.substr(innerDot+1, dot-innerDot-1);
+			boost::to_lower(fileExtension);
+			compressed = true;
+		}
+
 		if (fileExtension.compare("elf") == 0) {
 			type = ELF;
 		}
 		else if ((fileExtension.compare("hex") == 0) || (fileExtension.compare("eep") == 0) || (fileExtension.compare("ihex") == 0)) {
 			type = HEX;
 		}
+		else if ((fileExtension.compare("srec") == 0) || (fileExtension.compare("s19") == 0) || (fileExtension.compare("s28") == 0) ||
+				(fileExtension.compare("s37") == 0) || (fileExtension.compare("mot") == 0)) {
+			type = SREC;
+		}
+		else if (fileExtension.compare("bin") == 0) {
+			type = BIN;
+		}
+		else if (fileExtension.compare("bundle") == 0) {
+			type = BUNDLE;
+		}
 		else {
 			throw ProgramOptionsException("Unsupported filetype '" + fileExtension + "'");
 		}
 	}
+
+	if (type == BUNDLE && (compressed || standardStream || this->operation == READ)) {
+		throw ProgramOptionsException("Bundles can only be written or verified from a file, they are created with --bundle.");
+	}
+	if (compressed && (type == ELF || this->operation == READ)) {
+		throw ProgramOptionsException("Compressed files are only supported as hex, S-record or binary input files.");
+	}
+	if (base.size() != 0 && (type == BUNDLE || this->operation == READ)) {
+		throw ProgramOptionsException("An address is only supported when writing or verifying hex, S-record, binary or elf files.");
+	}
+	if (standardStream) {
+		if (type == ELF) {
+			throw ProgramOptionsException("Elf files cannot be read from standard input.");
+		}
+		if (compressed) {
+			throw ProgramOptionsException("The compression of standard input is detected automatically, use '-:" + this->source.substr(2, dot-2) + "'.");
+		}
+		this->source = "-";
+	}
 }
 
 operation_t CProgramOptions::getOperation() {
@@ -81,6 +185,22 @@ filetype_t CProgramOptions::getType() {
 	return type;
 }
 
+uint32_t CProgramOptions::getBaseAddress() {
+	return baseAddress;
+}
+
+bool CProgramOptions::isCompressed() {
+	return compressed;
+}
+
+const vector<CProgramOptions::source_t> &CProgramOptions::getSources() {
+	return sources;
+}
+
+bool CProgramOptions::isStandardStream() {
+	return standardStream;
+}
+
 CProgramOptions::~CProgramOptions() {
 
 }
@@ -21,7 +21,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define CPROGRAMOPTIONS_H_
 
 #include "ExceptionBase.h"
+#include <inttypes.h>
 #include <string>
+#include <vector>
 
 /// memory operation types
 typedef enum {
@@ -34,6 +36,9 @@ typedef enum {
 typedef enum {
 	HEX,
 	ELF,
+	SREC,
+	BIN,
+	BUNDLE,
 	IMMEDIATE,
 } filetype_t;
 
@@ -44,15 +49,36 @@ using namespace std;
  *
  * The argument has to look like:
  * @code
- * (r|w|v):value[hex|elf]
+ * (r|w|v):value[hex|elf|srec|bin|bundle][@address][,...]
  * @endcode
  *
  * The class parses the operation (read, write or verify) and the
- * value type of the argument, which can be a path to a *.hex or *.elf,
- * or an immediate value.
+ * value type of the argument, which can be a path to a *.hex, *.elf,
+ * *.srec, *.bin or *.bundle file (see CFlashBundle), or an immediate value.
+ *
+ * A binary file has no addresses, hence the address of its first byte
+ * may be appended to the path (e.g. boot.bin@0x7000). For hex, S-record
+ * and elf files the appended address is added to the addresses in the file.
+ *
+ * Several files may be written or verified at once, separated by ','
+ * (e.g. boot.hex,app.elf@0x0), see getSources(). The other accessors
+ * describe the first file.
+ *
+ * Input files may be compressed (e.g. main.hex.gz or main.hex.zst).
+ *
+ * Instead of a file name '-' followed by the format (e.g. -:hex or -:bin@0x7000)
+ * selects standard input or output.
  */
 class CProgramOptions {
 public:
+	/// one file of the argument
+	typedef struct {
+		string path;			///< path to the file
+		filetype_t type;		///< type of the file
+		uint32_t baseAddress;	///< address given after '@', or 0
+		bool compressed;		///< the file is compressed
+	} source_t;
+
 	/**
 	 * @brief	Parses the argument.
 	 * @param	options	Commandline argument to parse.
@@ -77,11 +103,41 @@ public:
 	 * @return	Type of the command line argument value.
 	 */
 	filetype_t getType();
+
+	/**
+	 * @brief	Get the address of the first byte of a binary file, or the offset of the addresses in other files.
+	 * @return	The address given after '@', or 0.
+	 */
+	uint32_t getBaseAddress();
+
+	/**
+	 * @brief	Check for a compressed file (*.gz or *.zst), the type is given by the extension in front.
+	 * @return	true if the file is compressed.
+	 */
+	bool isCompressed();
+
+	/**
+	 * @brief	Check for standard input (write and verify) or standard output (read) instead of a file.
+	 * @return	true if the argument looks like (r|w|v):-:format, \a getPath() returns "-" in this case.
+	 */
+	bool isStandardStream();
+
+	/**
+	 * @brief	Get all files of the argument, in the order they were given.
+	 * @return	The files, one entry for an immediate value or standard input.
+	 */
+	const vector<source_t> &getSources();
 protected:
 	filetype_t type;
 	operation_t operation;
 	string source;
+	uint32_t baseAddress;
+	bool compressed;
+	bool standardStream;
+	vector<source_t> sources;
 
+private:
+	void parseSource(string value);
 };
 
 /**
@@ -23,7 +23,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 using namespace std;
 
+bool CProgressbar::enabled = true;
+
 CProgressbar::CProgressbar(int max) : maxValue(max), value(0), drawn(0) {
+	if (enabled == false) {
+		return;
+	}
+
 	// label the progressbar
 	cout << "0%";
 	for (int i=0; i<WIDTH-6; i++) {
@@ -33,10 +39,17 @@ CProgressbar::CProgressbar(int max) : maxValue(max), value(0), drawn(0) {
 }
 
 void CProgressbar::step() {
+	// increase progress
+	update(value + 1);
+}
+
+void CProgressbar::update(int value) {
 	int draw;
 
-	// increase progress
-	value++;
+	this->value = value;
+	if (enabled == false) {
+		return;
+	}
 
 	draw = floor((float)value/(float)maxValue * (float)WIDTH);
 
@@ -47,6 +60,12 @@ void CProgressbar::step() {
 	}
 }
 
+void CProgressbar::setEnabled(bool enabled) {
+	CProgressbar::enabled = enabled;
+}
+
 CProgressbar::~CProgressbar() {
-	cout << endl;
+	if (enabled == true) {
+		cout << endl;
+	}
 }
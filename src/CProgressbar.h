@@ -37,11 +37,22 @@ public:
 	 */
 	void step();
 
+	/**
+	 * @brief	Set the progress to \a value steps.
+	 */
+	void update(int value);
+
+	/**
+	 * @brief	Enable or disable drawing of all progressbars (e.g. while several programmers run in parallel).
+	 */
+	static void setEnabled(bool enabled);
+
 protected:
 	static const int WIDTH = 80;	///< Width (in characters) of the drawn bar.
 	int maxValue;
 	int value;
 	int drawn;
+	static bool enabled;
 };
 
 #endif /* CPROGRESSBAR_H_ */
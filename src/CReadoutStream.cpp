@@ -0,0 +1,137 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CReadoutStream.h"
+#include <algorithm>
+#include <cstring>
+#include "CFormat.h"
+#include "CMemoryKernels.h"
+
+using namespace std;
+
+CReadoutStream::CReadoutStream(CHexFile *_file, uint8_t _empty, int _size) : file(_file), empty(_empty), size(_size), ring(RING_SIZE),
+		current(NULL), currentLen(0), next(0), trimmed(0) {
+	memset(emptyChunk, empty, sizeof(emptyChunk));
+}
+
+void CReadoutStream::start() {
+	file->begin(size);
+	writer = thread(&CReadoutStream::run, this);
+}
+
+/*
+ * writer thread
+ *
+ * The empty bytes between the previous and the current chunk with content are appended when the
+ * current chunk is written. On errors the reader is stopped by cancelling the ring.
+ */
+void CReadoutStream::run() {
+	CChunkRing::slot_t *slot;
+
+	try {
+		while ((slot = ring.front()) != NULL) {
+			int address = slot->chunk * CChunkRing::CHUNK_SIZE;
+			int len = CMemoryKernels::trimmedSize(slot->data, min(CChunkRing::CHUNK_SIZE, size - address), empty);
+
+			if (len > 0) {
+				while (trimmed < address) {
+					int n = min(CChunkRing::CHUNK_SIZE, address - trimmed);
+					file->append(emptyChunk, n);
+					trimmed += n;
+				}
+				file->append(slot->data, len);
+				trimmed = address + len;
+			}
+			ring.pop();
+		}
+	}
+	catch (...) {
+		error = current_exception();
+		ring.cancel();
+	}
+}
+
+void CReadoutStream::addData(uint32_t address, const uint8_t *data, int len) {
+	if (address != next) {
+		throw ReadoutStreamException("Readout at 0x" + CFormat::intToHexString(address) + " does not follow 0x" + CFormat::intToHexString(next) + ".");
+	}
+	next += len;
+
+	// bytes behind the memory are ignored
+	len = min(len, size - (int)address);
+
+	while (len > 0) {
+		int n = min(len, CChunkRing::CHUNK_SIZE - currentLen);
+
+		if (current == NULL) {
+			current = ring.back();
+			if (current == NULL) {
+				rethrow_exception(error);
+			}
+			current->chunk = address / CChunkRing::CHUNK_SIZE;
+			currentLen = 0;
+		}
+
+		memcpy(current->data + currentLen, data, n);
+		currentLen += n;
+		address += n;
+		data += n;
+		len -= n;
+
+		if (currentLen == CChunkRing::CHUNK_SIZE) {
+			push();
+		}
+	}
+}
+
+/*
+ * pass the current chunk to the writer
+ */
+void CReadoutStream::push() {
+	ring.push();
+	current = NULL;
+}
+
+int CReadoutStream::finish() {
+	if (current != NULL) {
+		push();
+	}
+	ring.close();
+	writer.join();
+	if (error) {
+		rethrow_exception(error);
+	}
+
+	file->finish();
+	return trimmed;
+}
+
+/*
+ * The writer stops when it reached the end of the ring, or it already stopped because of an error.
+ */
+CReadoutStream::~CReadoutStream() {
+	ring.close();
+	if (writer.joinable()) {
+		writer.join();
+	}
+}
+
+ReadoutStreamException::ReadoutStreamException(string err) : ExceptionBase(err) {
+
+}
@@ -0,0 +1,110 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CREADOUTSTREAM_H_
+#define CREADOUTSTREAM_H_
+
+#include <inttypes.h>
+#include <exception>
+#include <thread>
+#include "CChunkRing.h"
+#include "CHexFile.h"
+#include "CMemorySink.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Writes a memory readout to a file while it is read.
+ * @throw	ReadoutStreamException on errors.
+ *
+ * The reader (CAvrProgCommands::readFlash()) passes each chunk to addData(), which copies it into a
+ * CChunkRing. A writer thread takes the chunks from the ring and appends them to a CHexFile (see
+ * CHexFile::append()), hence formatting and writing overlap the USB transfers, and the memory usage
+ * does not depend on the memory size. The file is complete as soon as the last chunk is read.
+ *
+ * Like CAVRprog::readFlash() did with a buffer, empty bytes at the end of the memory are cut off.
+ * Empty bytes are kept back by the writer until a byte with content follows, so the file is the
+ * same as if the whole readout was saved at once. Only the S-record type is chosen by the memory
+ * size instead of the size of the content.
+ *
+ * Errors of the writer (e.g. a full disk) are thrown by the next call of addData() or by finish().
+ */
+class CReadoutStream : public CMemorySink {
+public:
+	/**
+	 * @param	file	File for the readout, not owned by this object. Gaps have to be set before start().
+	 * @param	empty	Value of an empty byte of the memory.
+	 * @param	size	Size of the memory, bytes behind it are ignored.
+	 */
+	CReadoutStream(CHexFile *file, uint8_t empty, int size);
+
+	/**
+	 * @brief	Waits for the writer thread if it is still running.
+	 */
+	virtual ~CReadoutStream();
+
+	/**
+	 * @brief	Create the file and start the writer thread.
+	 */
+	void start();
+
+	/**
+	 * @brief	Pass the next block of the readout (reader).
+	 *
+	 * Blocks have to be passed in the order of the memory, starting at address 0.
+	 */
+	virtual void addData(uint32_t address, const uint8_t *data, int len);
+
+	/**
+	 * @brief	Wait until all chunks are written and close the file.
+	 *
+	 * @return	Size of the readout without empty bytes at the end.
+	 * @throw	ExceptionBase	Errors of the writer are passed on.
+	 */
+	int finish();
+
+private:
+	static const int RING_SIZE = 64;	// chunks between reader and writer
+
+	CHexFile *file;
+	uint8_t empty;
+	int size;
+	CChunkRing ring;
+	thread writer;
+	exception_ptr error;			// error of the writer, set before the ring is cancelled
+	CChunkRing::slot_t *current;	// chunk which is filled at the moment
+	int currentLen;
+	uint32_t next;					// address of the next byte of the readout
+	int trimmed;					// end of the last byte with content, written by the writer
+	uint8_t emptyChunk[CChunkRing::CHUNK_SIZE];
+
+	void run();
+	void push();
+};
+
+/**
+ * @brief	Exception thrown by CReadoutStream.
+ */
+class ReadoutStreamException : public ExceptionBase {
+public:
+	ReadoutStreamException(string err);
+};
+
+#endif /* CREADOUTSTREAM_H_ */
@@ -0,0 +1,154 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CRecordReader.h"
+#include <cstring>
+#include "CFormat.h"
+#include "COut.h"
+
+using namespace std;
+
+/*
+ * Lookup table for hex digits
+ *
+ * Each ASCII character is mapped to its value, all characters which are no hex digits are mapped
+ * to 0x10. Hence a whole record can be decoded without branches, and invalid characters are detected
+ * by or-ing all looked up values.
+ */
+namespace {
+	struct hex_table_t {
+		uint8_t value[256];
+	};
+
+	hex_table_t makeHexTable() {
+		hex_table_t table;
+
+		memset(table.value, 0x10, sizeof(table.value));
+		for (int i=0; i<10; i++) {
+			table.value['0' + i] = i;
+		}
+		for (int i=0; i<6; i++) {
+			table.value['a' + i] = 10 + i;
+			table.value['A' + i] = 10 + i;
+		}
+		return table;
+	}
+
+	const hex_table_t hexTable = makeHexTable();
+}
+
+CRecordReader::CRecordReader(CInputStream *_input, int _maxLineLength) : input(_input), end(false), maxLineLength(_maxLineLength), lineNumber(0) {
+
+}
+
+/*
+ * The input is read in blocks of BLOCK_SIZE bytes. Complete lines are parsed directly in the block,
+ * an incomplete line at the end of a block is moved to the front of the buffer before the next block
+ * is appended.
+ */
+int CRecordReader::read(CMemorySink *sink) {
+	char *buffer = new char[BLOCK_SIZE + maxLineLength];
+	int fill = 0;		// number of bytes in buffer
+	int bytes = 0;
+	bool eof = false;
+
+	try {
+		while (!end && !eof) {
+			int len = input->read((uint8_t*)buffer + fill, BLOCK_SIZE);
+			char *line = buffer;
+			char *newline;
+
+			if (len == 0) {
+				eof = true;
+				// the last line does not need to be terminated
+				if (fill > 0) {
+					buffer[fill++] = '\n';
+				}
+			}
+			fill += len;
+
+			while (!end && (newline = (char*)memchr(line, '\n', fill - (line - buffer))) != NULL) {
+				int lineLen = newline - line;
+
+				lineNumber++;
+
+				// strip trailing white space
+				while (lineLen > 0 && (line[lineLen-1] == '\r' || line[lineLen-1] == ' ' || line[lineLen-1] == '\t')) {
+					lineLen--;
+				}
+				if (lineLen > 0) {
+					parseLine(line, lineLen, sink, &bytes);
+				}
+				line = newline + 1;
+			}
+
+			// keep the incomplete line
+			fill -= line - buffer;
+			if (fill > maxLineLength) {
+				lineNumber++;
+				error("Line too long.");
+			}
+			memmove(buffer, line, fill);
+		}
+	}
+	catch (...) {
+		delete[] buffer;
+		throw;
+	}
+
+	delete[] buffer;
+
+	if (!end) {
+		COut::d("No end record in '" + input->getName() + "'.");
+	}
+
+	return bytes;
+}
+
+uint8_t CRecordReader::decode(const char *digits, int len, uint8_t *data) {
+	const uint8_t *d = (const uint8_t*)digits;
+	uint8_t invalid = 0;
+	uint8_t sum = 0;
+
+	for (int i=0; i<len; i++) {
+		uint8_t high = hexTable.value[d[2*i]];
+		uint8_t low = hexTable.value[d[2*i+1]];
+		invalid |= high | low;
+		data[i] = (high << 4) | low;
+		sum += data[i];
+	}
+
+	if ((invalid & 0xf0) != 0) {
+		error("Invalid hex digit.");
+	}
+
+	return sum;
+}
+
+void CRecordReader::error(string msg) {
+	throw RecordException(input->getName() + ":" + CFormat::intToString(lineNumber) + ": " + msg);
+}
+
+CRecordReader::~CRecordReader() {
+
+}
+
+RecordException::RecordException(string err) : ExceptionBase(err) {
+
+}
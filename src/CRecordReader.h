@@ -0,0 +1,108 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CRECORDREADER_H_
+#define CRECORDREADER_H_
+
+#include <inttypes.h>
+#include <string>
+#include "CInputStream.h"
+#include "CMemorySink.h"
+#include "ExceptionBase.h"
+
+using namespace std;
+
+/**
+ * @brief	Base class of streaming parsers for line based file formats with hex encoded records.
+ * @throw	RecordException on syntax and checksum errors.
+ *
+ * The input is read in large blocks and each line is passed to parseLine() of the derived class as
+ * soon as it is complete, hence the file is never held in memory completely. The derived class
+ * passes the content of data records to a CMemorySink.
+ *
+ * Empty lines and trailing white space (e.g. CR of DOS line endings) are skipped before a line is
+ * passed to parseLine().
+ */
+class CRecordReader {
+public:
+	virtual ~CRecordReader();
+
+	/**
+	 * @brief	Parse the whole stream.
+	 *
+	 * Parsing stops at the end of the stream or when the derived class sets \a end.
+	 *
+	 * @param	sink	Receives the content of all data records.
+	 * @return	Number of data bytes passed to \a sink.
+	 */
+	int read(CMemorySink *sink);
+
+protected:
+	/**
+	 * @param	input			Stream with the content of the file. The stream is not owned by this object.
+	 * @param	maxLineLength	Length of the longest valid line including some white space.
+	 */
+	CRecordReader(CInputStream *input, int maxLineLength);
+
+	/**
+	 * @brief	Parse a single line.
+	 *
+	 * @param	line	The line without trailing white space, it is not terminated and not empty.
+	 * @param	len		Length of \a line.
+	 * @param	sink	Receives the content of data records.
+	 * @param	bytes	Must be incremented by the number of data bytes passed to \a sink.
+	 */
+	virtual void parseLine(const char *line, int len, CMemorySink *sink, int *bytes) = 0;
+
+	/**
+	 * @brief	Decode pairs of hex digits.
+	 *
+	 * @param	digits	2 * \a len hex digits.
+	 * @param	len		Number of bytes to decode.
+	 * @param	data	Receives the decoded bytes.
+	 * @return	Sum of all decoded bytes (modulo 256).
+	 * @throw	RecordException if \a digits contains an invalid character.
+	 */
+	uint8_t decode(const char *digits, int len, uint8_t *data);
+
+	/**
+	 * @brief	Report an error in the current line.
+	 * @throw	RecordException always.
+	 */
+	void error(string msg);
+
+	CInputStream *input;	///< stream with the file content
+	bool end;				///< set by the derived class when the end record was found
+
+private:
+	static const int BLOCK_SIZE = 65536;	// bytes read from the input at once
+
+	int maxLineLength;
+	int lineNumber;
+};
+
+/**
+ * @brief	Exception thrown by CRecordReader and derived classes.
+ */
+class RecordException : public ExceptionBase {
+public:
+	RecordException(string err);
+};
+
+#endif /* CRECORDREADER_H_ */
@@ -0,0 +1,106 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CSRecordFile.h"
+#include "CMemoryKernels.h"
+#include <algorithm>
+
+using namespace std;
+
+CSRecordFile::CSRecordFile(string path) : CHexFile(path), addressLen(2), records(0) {
+
+}
+
+/*
+ * upper bound of the file size: header, data records, record count and termination record
+ */
+int CSRecordFile::maxLength(int size) {
+	return (4 + 2 * (6 + MAX_HEADER_SIZE)) + (size / RECORD_SIZE + 1) * (4 + 2 * (6 + RECORD_SIZE)) + 2 * (4 + 2 * 6);
+}
+
+/*
+ * choose the address width and write the header record
+ */
+char *CSRecordFile::beginRecords(char *out, int size) {
+	string name = path.substr(path.rfind('/') + 1).substr(0, MAX_HEADER_SIZE);
+
+	if (size <= 0x10000) {
+		addressLen = 2;
+	}
+	else if (size <= 0x1000000) {
+		addressLen = 3;
+	}
+	else {
+		addressLen = 4;
+	}
+	records = 0;
+
+	return record(out, '0', 0, (const uint8_t*)name.data(), name.size());
+}
+
+char *CSRecordFile::dataRecords(char *out, uint32_t address, const uint8_t *data, int len) {
+	for (int i=0; i<len; i+=RECORD_SIZE) {
+		out = record(out, '0' + addressLen - 1, address + i, data + i, min(RECORD_SIZE, len - i));
+		records++;
+	}
+	return out;
+}
+
+char *CSRecordFile::endRecords(char *out) {
+	if (records <= 0xffff) {
+		out = record(out, '5', records, NULL, 0);
+	}
+	return record(out, '0' + 11 - addressLen, 0, NULL, 0);
+}
+
+/*
+ * format one record
+ *
+ * The width of the address depends on the record type, S0, S1, S5 and S9 use 16 bit addresses.
+ */
+char *CSRecordFile::record(char *out, char type, uint32_t address, const uint8_t *data, int len) {
+	int width = (type == '2' || type == '8') ? 3 : (type == '3' || type == '7') ? 4 : 2;
+	uint8_t header[5];
+	uint8_t checksum;
+
+	header[0] = width + len + 1;
+	for (int i=0; i<width; i++) {
+		header[1 + i] = address >> (8 * (width - 1 - i));
+	}
+
+	checksum = CMemoryKernels::checksum(header, 1 + width) + CMemoryKernels::checksum(data, len);
+	checksum = ~checksum;
+
+	*out++ = 'S';
+	*out++ = type;
+	CMemoryKernels::toHex(header, 1 + width, out);
+	out += 2 * (1 + width);
+	CMemoryKernels::toHex(data, len, out);
+	out += 2 * len;
+	CMemoryKernels::toHex(&checksum, 1, out);
+	out += 2;
+	*out++ = '\r';
+	*out++ = '\n';
+
+	return out;
+}
+
+CSRecordFile::~CSRecordFile() {
+
+}
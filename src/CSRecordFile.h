@@ -0,0 +1,63 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSRECORDFILE_H_
+#define CSRECORDFILE_H_
+
+#include "CHexFile.h"
+
+using namespace std;
+
+/**
+ * @brief	Writes a Motorola S-record file.
+ * @throw	FileException on errors.
+ *
+ * The file starts with an S0 header record containing the file name. Data records contain
+ * RECORD_SIZE bytes, the record type (S1, S2 or S3) is the smallest one which can address the
+ * whole buffer. An S5 record with the number of data records (if it fits into 16 bit) and the
+ * matching termination record (S9, S8 or S7) end the file.
+ *
+ * Empty regions are omitted like in CHexFile, see CHexFile::setGaps().
+ */
+class CSRecordFile : public CHexFile {
+public:
+	/**
+	 * @brief	Create a new S-record file.
+	 *
+	 * @param	path	Path to the new file.
+	 */
+	CSRecordFile(string path);
+	virtual ~CSRecordFile();
+
+protected:
+	virtual int maxLength(int size);
+	virtual char *beginRecords(char *out, int size);
+	virtual char *dataRecords(char *out, uint32_t address, const uint8_t *data, int len);
+	virtual char *endRecords(char *out);
+
+private:
+	static const int MAX_HEADER_SIZE = 64;	// maximal length of the file name in the header record
+
+	int addressLen;		// address bytes of the data records
+	int records;		// number of data records
+
+	char *record(char *out, char type, uint32_t address, const uint8_t *data, int len);
+};
+
+#endif /* CSRECORDFILE_H_ */
@@ -0,0 +1,97 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CSRecordReader.h"
+
+using namespace std;
+
+CSRecordReader::CSRecordReader(CInputStream *input) : CRecordReader(input, MAX_LINE_LENGTH) {
+
+}
+
+/*
+ * parse a single record, 'line' is not terminated
+ *
+ * A record consists of 'S', the type digit, the byte count and 'count' bytes of address, data
+ * and checksum. The checksum is the one's complement of the sum of all other bytes.
+ */
+void CSRecordReader::parseLine(const char *line, int len, CMemorySink *sink, int *bytes) {
+	uint8_t record[1 + 255];
+	int addressLen;
+	uint8_t sum;
+	uint32_t address = 0;
+
+	if (line[0] != 'S' && line[0] != 's') {
+		error("Record does not start with 'S'.");
+	}
+	if (len % 2 != 0 || len < 4 + 2 * 3 || len > 2 + 2 * (int)sizeof(record)) {
+		error("Invalid record length.");
+	}
+
+	sum = decode(line + 2, (len - 2) / 2, record);
+	if (record[0] + 1 != (len - 2) / 2) {
+		error("Byte count does not match the record length.");
+	}
+	if (sum != 0xff) {
+		error("Checksum error.");
+	}
+
+	switch (line[1]) {
+	case '0':	// header
+	case '5':	// record count
+	case '6':
+		return;
+	case '1':
+	case '9':
+		addressLen = 2;
+		break;
+	case '2':
+	case '8':
+		addressLen = 3;
+		break;
+	case '3':
+	case '7':
+		addressLen = 4;
+		break;
+	default:
+		error("Unknown record type S" + string(1, line[1]) + ".");
+		return;
+	}
+
+	if (record[0] < addressLen + 1) {
+		error("Record too short for its address.");
+	}
+	for (int i=0; i<addressLen; i++) {
+		address = address << 8 | record[1 + i];
+	}
+
+	if (line[1] >= '7') {
+		// start address, ends the file
+		end = true;
+	}
+	else if (record[0] > addressLen + 1) {
+		int dataLen = record[0] - addressLen - 1;
+		sink->addData(address, record + 1 + addressLen, dataLen);
+		*bytes += dataLen;
+	}
+}
+
+CSRecordReader::~CSRecordReader() {
+
+}
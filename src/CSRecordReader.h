@@ -0,0 +1,55 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSRECORDREADER_H_
+#define CSRECORDREADER_H_
+
+#include <inttypes.h>
+#include "CRecordReader.h"
+
+using namespace std;
+
+/**
+ * @brief	Streaming parser for Motorola S-record files.
+ * @throw	RecordException on syntax and checksum errors.
+ *
+ * Each data record is passed to a CMemorySink as soon as it is decoded (see CRecordReader).
+ *
+ * Supported record types:
+ * - S0 header (ignored)
+ * - S1, S2, S3 data with a 16, 24 or 32 bit address
+ * - S5, S6 record count (ignored)
+ * - S7, S8, S9 start address, terminates the file (all following lines are ignored)
+ */
+class CSRecordReader : public CRecordReader {
+public:
+	/**
+	 * @param	input	Stream with the content of the S-record file. The stream is not owned by this object.
+	 */
+	CSRecordReader(CInputStream *input);
+	virtual ~CSRecordReader();
+
+protected:
+	virtual void parseLine(const char *line, int len, CMemorySink *sink, int *bytes);
+
+private:
+	static const int MAX_LINE_LENGTH = 4 + 2 * 255 + 16;	// type, hex digits of the longest record and some white space
+};
+
+#endif /* CSRECORDREADER_H_ */
@@ -0,0 +1,133 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CSha256.h"
+#include <cstring>
+
+using namespace std;
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t ror(uint32_t x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+CSha256::CSha256() : length(0), blockLen(0) {
+	static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+	memcpy(state, initial, sizeof(state));
+}
+
+void CSha256::update(const void *data, size_t size) {
+	const uint8_t *bytes = (const uint8_t*)data;
+
+	length += size;
+
+	if (blockLen > 0) {
+		size_t n = (size < (size_t)(64 - blockLen)) ? size : 64 - blockLen;
+
+		memcpy(block + blockLen, bytes, n);
+		blockLen += n;
+		bytes += n;
+		size -= n;
+		if (blockLen < 64) {
+			return;
+		}
+		compress(block);
+		blockLen = 0;
+	}
+
+	// whole blocks are compressed in place
+	while (size >= 64) {
+		compress(bytes);
+		bytes += 64;
+		size -= 64;
+	}
+
+	memcpy(block, bytes, size);
+	blockLen = size;
+}
+
+/*
+ * padding: 0x80, zeros up to 56 bytes of the last block, the length in bits (big endian)
+ */
+void CSha256::final(uint8_t *digest) {
+	uint64_t bits = length * 8;
+
+	block[blockLen++] = 0x80;
+	if (blockLen > 56) {
+		memset(block + blockLen, 0, 64 - blockLen);
+		compress(block);
+		blockLen = 0;
+	}
+	memset(block + blockLen, 0, 56 - blockLen);
+	for (int i=0; i<8; i++) {
+		block[56 + i] = bits >> (56 - 8 * i);
+	}
+	compress(block);
+
+	for (int i=0; i<8; i++) {
+		digest[4*i + 0] = state[i] >> 24;
+		digest[4*i + 1] = state[i] >> 16;
+		digest[4*i + 2] = state[i] >> 8;
+		digest[4*i + 3] = state[i];
+	}
+}
+
+void CSha256::compress(const uint8_t *data) {
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h;
+
+	for (int i=0; i<16; i++) {
+		w[i] = (uint32_t)data[4*i] << 24 | (uint32_t)data[4*i + 1] << 16 | (uint32_t)data[4*i + 2] << 8 | data[4*i + 3];
+	}
+	for (int i=16; i<64; i++) {
+		uint32_t s0 = ror(w[i-15], 7) ^ ror(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = ror(w[i-2], 17) ^ ror(w[i-2], 19) ^ (w[i-2] >> 10);
+
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+	for (int i=0; i<64; i++) {
+		uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+		uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+CSha256::~CSha256() {
+
+}
@@ -0,0 +1,63 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSHA256_H_
+#define CSHA256_H_
+
+#include <inttypes.h>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * @brief	SHA-256 digest (FIPS 180-4) of a byte stream.
+ *
+ * Used where a hash has to identify content reliably, e.g. the entries of the image cache.
+ * Call update() for each part of the content and final() once at the end.
+ */
+class CSha256 {
+public:
+	static const int SIZE = 32;		///< length of a digest in bytes
+
+	CSha256();
+	virtual ~CSha256();
+
+	/**
+	 * @brief	Add the next bytes of the content.
+	 * @param	data	Byte array.
+	 * @param	size	Length of \a data.
+	 */
+	void update(const void *data, size_t size);
+
+	/**
+	 * @brief	Finish the digest, no update() may follow.
+	 * @param	digest	Receives SIZE bytes.
+	 */
+	void final(uint8_t *digest);
+
+private:
+	uint32_t state[8];
+	uint64_t length;		// bytes added so far
+	uint8_t block[64];		// incomplete block
+	int blockLen;
+
+	void compress(const uint8_t *data);
+};
+
+#endif /* CSHA256_H_ */
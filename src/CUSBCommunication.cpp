@@ -21,13 +21,15 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <iostream>
 #include <sstream>
 #include <stdio.h>
+#include <cstring>
 #include "CFormat.h"
 #include "COut.h"
 #include "CLArgumentException.h"
 
 using namespace std;
 
-CUSBCommunication::CUSBCommunication(string device) : transfer(NULL), isoReceivedLen(0), error(0) {
+CUSBCommunication::CUSBCommunication(string device, libusb_context *_context) : context(_context), sharedContext(_context != NULL), dev(NULL), transfer(NULL),
+		isoReceivedLen(0), isoCompleted(0), error(0), timedOut(false) {
 	int ret;
 	int numOfDevices;
 	libusb_device **deviceList;
@@ -67,10 +69,21 @@ CUSBCommunication::CUSBCommunication(string device) : transfer(NULL), isoReceive
 	COut::d("\tInterface: " + CFormat::intToHexString(INTERFACE));
 	COut::d("");
 
-	// init libusb
-	ret = libusb_init(&context);
-	if (ret != LIBUSB_SUCCESS) {
-		throw USBCommunicationException("Initializing libusb failed");
+	memset(rtt, 0x00, sizeof(rtt));
+	memset(backedOff, 0x00, sizeof(backedOff));
+	minimum[TIMEOUT_STATUS] = USB_TIMEOUT_STATUS_MIN;
+	minimum[TIMEOUT_TRANSFER] = USB_TIMEOUT_TRANSFER_MIN;
+	minimum[TIMEOUT_ERASE] = USB_TIMEOUT_ERASE_MIN;
+	minimum[TIMEOUT_PAGE_WRITE] = USB_TIMEOUT_ERASE_MIN;	// until the target timing is known (see setTimeoutFloor())
+	minimum[TIMEOUT_EEPROM] = USB_TIMEOUT_ERASE_MIN;
+
+	// init libusb, unless the context is shared with other programmers
+	if (sharedContext == false) {
+		ret = libusb_init(&context);
+		if (ret != LIBUSB_SUCCESS) {
+			context = NULL;
+			throw USBCommunicationException("Initializing libusb failed");
+		}
 	}
 
 	// search programmer device
@@ -147,9 +160,8 @@ CUSBCommunication::CUSBCommunication(string device) : transfer(NULL), isoReceive
 
 void CUSBCommunication::print_device_list() {
 	int ret;
-	int numOfDevices;
-	libusb_device **deviceList;
 	libusb_context *c;
+	vector<string> devices;
 
 	cout << "List of available devices:" << endl;
 
@@ -158,7 +170,29 @@ void CUSBCommunication::print_device_list() {
 		throw USBCommunicationException("Initializing libusb failed");
 	}
 
-	numOfDevices = libusb_get_device_list(c, &deviceList);
+	try {
+		devices = device_list(c);
+	}
+	catch (USBCommunicationException &e) {
+		libusb_exit(c);
+		throw;
+	}
+	libusb_exit(c);
+
+	for (unsigned int i=0; i<devices.size(); i++) {
+		size_t colon = devices[i].find(':');
+
+		cout << "\tBus " << devices[i].substr(0, colon) << " Device " << devices[i].substr(colon+1) << " (" << devices[i] << ")" << endl;
+	}
+}
+
+vector<string> CUSBCommunication::device_list(libusb_context *context) {
+	int ret;
+	int numOfDevices;
+	libusb_device **deviceList;
+	vector<string> devices;
+
+	numOfDevices = libusb_get_device_list(context, &deviceList);
 	if (numOfDevices == LIBUSB_ERROR_NO_MEM) {
 		throw USBCommunicationException("Memory allocation failure during device discovery");
 	}
@@ -170,104 +204,234 @@ void CUSBCommunication::print_device_list() {
 		device = deviceList[i];
 		ret = libusb_get_device_descriptor(device, &descriptor);
 		if (ret != LIBUSB_SUCCESS) {
+			libusb_free_device_list(deviceList, 1);
 			throw USBCommunicationException("Get device descriptor failure");
 		}
 
 		// check if the device is a avrprog2 device
 		if ((descriptor.idVendor == VENDOR_ID) && (descriptor.idProduct == DEVICE_ID))	{
-			cout << "\tBus " << (int)libusb_get_bus_number(device) << " Device " << (int)libusb_get_device_address(device) << " (" << (int)libusb_get_bus_number(device) << ":" << (int)libusb_get_device_address(device) << ")" << endl;
+			devices.push_back(CFormat::intToString(libusb_get_bus_number(device)) + ":" + CFormat::intToString(libusb_get_device_address(device)));
 		}
 	}
 
 	libusb_free_device_list(deviceList, 1);
-	libusb_exit(c);
+	return devices;
 }
 
-void CUSBCommunication::int_read(int endpoint, uint8_t **buffer, int *len) {
+void CUSBCommunication::int_read(int endpoint, uint8_t **buffer, int *len, timeout_class_t timeoutClass) {
 	int err;
 	stringstream str;
 	int urbLen;
+	unsigned int ms;
+	bool retried = false;
 
 	if (*len > BUFFER_LEN) {
 		throw USBCommunicationException("Cannot transfer " + CFormat::intToString(*len) + " bytes in one transfer. (Limit is " + CFormat::intToString(BUFFER_LEN) + " bytes.)");
 	}
 
 	urbLen = *len;
-
-	err = libusb_interrupt_transfer(dev, endpoint | LIBUSB_ENDPOINT_IN, this->buffer, urbLen, len, USB_TIMEOUT);
-	if (err != LIBUSB_SUCCESS) {
+	ms = timeout(timeoutClass);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	err = libusb_interrupt_transfer(dev, endpoint | LIBUSB_ENDPOINT_IN, this->buffer, urbLen, len, ms);
+	if (err == LIBUSB_ERROR_TIMEOUT && backoff(timeoutClass, ms) != 0) {
+		COut::dd("Timeout (" + CFormat::intToString(ms) + "ms) while read (interrupt), retry with " + CFormat::intToString(backoff(timeoutClass, ms)) + "ms");
+		ms = backoff(timeoutClass, ms);
+		backedOff[timeoutClass] = ms;
+		retried = true;
+		err = libusb_interrupt_transfer(dev, endpoint | LIBUSB_ENDPOINT_IN, this->buffer, urbLen, len, ms);
+	}
+	if (err == LIBUSB_ERROR_TIMEOUT) {
+		throw USBCommunicationException("Timeout (" + CFormat::intToString(ms) + "ms) while read (interrupt)");
+	}
+	else if (err != LIBUSB_SUCCESS) {
 		str << err;
 		throw USBCommunicationException("Error (" + str.str() + ") while read (interrupt)");
 	}
+	if (!retried) {
+		measured(timeoutClass, start);
+	}
 	*buffer = this->buffer;
 }
 
-void CUSBCommunication::int_write(int endpoint, uint8_t *buffer, int len) {
+void CUSBCommunication::int_write(int endpoint, uint8_t *buffer, int len, timeout_class_t timeoutClass) {
 	int err;
 	stringstream str;
 	int transfered;
+	unsigned int ms;
 
-	err = libusb_interrupt_transfer(dev, endpoint | LIBUSB_ENDPOINT_OUT, buffer, len, &transfered, USB_TIMEOUT);
-	if (err != LIBUSB_SUCCESS) {
+	ms = timeout(timeoutClass);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	err = libusb_interrupt_transfer(dev, endpoint | LIBUSB_ENDPOINT_OUT, buffer, len, &transfered, ms);
+	if (err == LIBUSB_ERROR_TIMEOUT) {
+		throw USBCommunicationException("Timeout (" + CFormat::intToString(ms) + "ms) while write (interrupt)");
+	}
+	else if (err != LIBUSB_SUCCESS) {
 		str << err;
 		throw USBCommunicationException("Error (" + str.str() + ") while write (interrupt)");
 	}
+	measured(timeoutClass, start);
 }
 
-void CUSBCommunication::iso_read(int endpoint, uint8_t **buffer, int *len) {
+void CUSBCommunication::iso_read(int endpoint, uint8_t **buffer, int *len, timeout_class_t timeoutClass) {
 	if (*len > BUFFER_LEN) {
 		throw USBCommunicationException("Cannot transfer " + CFormat::intToString(*len) + " bytes in one transfer. (Limit is " + CFormat::intToString(BUFFER_LEN) + " bytes.)");
 	}
-	iso_transfer(endpoint | LIBUSB_ENDPOINT_IN, this->buffer, len);
+	iso_transfer(endpoint | LIBUSB_ENDPOINT_IN, this->buffer, len, timeoutClass);
 	*buffer = this->buffer;
 }
 
-void CUSBCommunication::iso_write(int endpoint, uint8_t *buffer, int len) {
-	iso_transfer(endpoint | LIBUSB_ENDPOINT_OUT, buffer, &len);
+void CUSBCommunication::iso_write(int endpoint, uint8_t *buffer, int len, timeout_class_t timeoutClass) {
+	iso_transfer(endpoint | LIBUSB_ENDPOINT_OUT, buffer, &len, timeoutClass);
 }
 
-void CUSBCommunication::iso_transfer(int endpoint, uint8_t *buffer, int *len) {
+void CUSBCommunication::iso_transfer(int endpoint, uint8_t *buffer, int *len, timeout_class_t timeoutClass) {
 	int numOfPackets;
 	int err;
+	unsigned int ms;
+	bool retried = false;
 
 	numOfPackets = *len / libusb_get_max_packet_size(libusb_get_device(dev), endpoint);
 	if (numOfPackets == 0) {
 		numOfPackets = 1;
 	}
 
-	// prepare
-	transfer = libusb_alloc_transfer(numOfPackets+1);
-	if (transfer == NULL) {
-		throw USBCommunicationException("Error while allocating Transfer");
-	}
+	ms = timeout(timeoutClass);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
+	// a timed out read is submitted once more with a longer timeout, a write is not repeated
+	for (int attempt = 0; attempt < 2; attempt++) {
+		// prepare
+		transfer = libusb_alloc_transfer(numOfPackets+1);
+		if (transfer == NULL) {
+			throw USBCommunicationException("Error while allocating Transfer");
+		}
 
-	transfer->flags = LIBUSB_TRANSFER_FREE_TRANSFER;
+		transfer->flags = LIBUSB_TRANSFER_FREE_TRANSFER;
 
-	libusb_fill_iso_transfer(transfer, dev, endpoint, buffer, *len, numOfPackets, callback, this, USB_TIMEOUT);
-	libusb_set_iso_packet_lengths(transfer, libusb_get_max_packet_size(libusb_get_device(dev), endpoint));
+		libusb_fill_iso_transfer(transfer, dev, endpoint, buffer, *len, numOfPackets, callback, this, ms);
+		libusb_set_iso_packet_lengths(transfer, libusb_get_max_packet_size(libusb_get_device(dev), endpoint));
 
-	// start transfer
-	err = libusb_submit_transfer(transfer);
-	if (err != LIBUSB_SUCCESS) {
-		throw USBCommunicationException("Error (" + CFormat::intToString(err) + ") transmitting Transfer");
-	}
+		// start transfer
+		err = libusb_submit_transfer(transfer);
+		if (err != LIBUSB_SUCCESS) {
+			throw USBCommunicationException("Error (" + CFormat::intToString(err) + ") transmitting Transfer");
+		}
 
-	// wait
-	error = false;
-	err = libusb_handle_events(context);
-	if (err != LIBUSB_SUCCESS) {
-		throw USBCommunicationException("Error (" + CFormat::intToString(err) + ") while handling Events)");
+		// wait until the callback was called (either completed or timed out)
+		error = false;
+		timedOut = false;
+		isoCompleted = 0;
+		while (isoCompleted == 0) {
+			err = libusb_handle_events_completed(context, &isoCompleted);
+			if (err != LIBUSB_SUCCESS) {
+				throw USBCommunicationException("Error (" + CFormat::intToString(err) + ") while handling Events)");
+			}
+		}
+
+		if (timedOut == false || (endpoint & LIBUSB_ENDPOINT_IN) == 0 || backoff(timeoutClass, ms) == 0) {
+			break;
+		}
+		COut::dd(errorMsg + " Retry with " + CFormat::intToString(backoff(timeoutClass, ms)) + "ms.");
+		ms = backoff(timeoutClass, ms);
+		backedOff[timeoutClass] = ms;
+		retried = true;
 	}
 
 	if (error == true) {
 		throw USBCommunicationException(errorMsg);
 	}
+	if (!retried) {
+		measured(timeoutClass, start);
+	}
 
 	buffer = this->buffer;
 	*len = this->isoReceivedLen;
 }
 
+/*
+ * Timeout (ms) of a transfer in the given class.
+ *
+ * As long as no round trip time was measured for the class, USB_TIMEOUT is used. Afterwards the timeout
+ * is twice the smoothed round trip time plus four mean deviations (as TCP does it), bounded by USB_TIMEOUT.
+ * The lower limit of the class (see setTimeoutFloor()) is applied last, so a known worst case target
+ * timing always wins.
+ */
+unsigned int CUSBCommunication::timeout(timeout_class_t timeoutClass) {
+#if ADAPTIVE_USB_TIMEOUT
+	rtt_t *r = &rtt[timeoutClass];
+	unsigned int ms;
+
+	if (r->samples == 0) {
+		ms = USB_TIMEOUT;
+	}
+	else {
+		ms = 2 * (r->srtt + 4 * r->rttvar) / 1000;
+		if (ms > USB_TIMEOUT) {
+			ms = USB_TIMEOUT;
+		}
+	}
+	if (ms < minimum[timeoutClass]) {
+		ms = minimum[timeoutClass];
+	}
+	if (ms < backedOff[timeoutClass]) {
+		ms = backedOff[timeoutClass];
+	}
+	return ms;
+#else
+	if (minimum[timeoutClass] > USB_TIMEOUT) {
+		return minimum[timeoutClass];
+	}
+	return USB_TIMEOUT;
+#endif
+}
+
+/*
+ * Timeout (ms) for the single retry of a read which timed out after 'ms', 0 if it is not retried.
+ *
+ * Only reads are retried, they wait for the same response once more. Status responses are not
+ * retried, so a missing programmer or target (e.g. while probing) is reported after the first
+ * timeout. With fixed timeouts there is no retry.
+ */
+unsigned int CUSBCommunication::backoff(timeout_class_t timeoutClass, unsigned int ms) {
+#if ADAPTIVE_USB_TIMEOUT
+	if (timeoutClass == TIMEOUT_STATUS) {
+		return 0;
+	}
+	return 2 * ms;
+#else
+	return 0;
+#endif
+}
+
+void CUSBCommunication::setTimeoutFloor(timeout_class_t timeoutClass, unsigned int ms) {
+	minimum[timeoutClass] = ms;
+}
+
+/*
+ * Update the round trip time estimation of a class with a successful transfer started at 'start'.
+ *
+ * Retried transfers are not sampled (Karn's rule), their duration includes the timed out attempt.
+ * Instead the backed off timeout is kept until a transfer succeeds without retry.
+ */
+void CUSBCommunication::measured(timeout_class_t timeoutClass, chrono::steady_clock::time_point start) {
+	rtt_t *r = &rtt[timeoutClass];
+	int sample = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+	if (r->samples == 0) {
+		r->srtt = sample;
+		r->rttvar = sample / 2;
+	}
+	else {
+		int delta = sample - r->srtt;
+		r->srtt += delta / 8;
+		r->rttvar += ((delta < 0 ? -delta : delta) - r->rttvar) / 4;
+	}
+	r->samples++;
+	backedOff[timeoutClass] = 0;
+}
+
 void CUSBCommunication::callback(struct libusb_transfer *transfer) {
 	// regenerate "this" pointer named self
 	CUSBCommunication *self;
@@ -296,21 +460,36 @@ void CUSBCommunication::callback(struct libusb_transfer *transfer) {
 			}
 		}
 	}
+	else if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
+		self->error = true;
+		self->timedOut = true;
+		self->errorMsg = "Timeout (" + CFormat::intToString(transfer->timeout) + "ms) while waiting for isochronous transfer.";
+	}
 	else {
 		// throwing an exception in the callback leads to crashes
 		self->error = true;
 		self->errorMsg = "Error (" + CFormat::intToString(transfer->status) + ") while waiting for isochronous transfer.";
 	}
+
+	self->isoCompleted = 1;
 }
 
 CUSBCommunication::~CUSBCommunication() {
 	COut::d("Close usb connection...");
 
+	for (int i=0; i<NUM_OF_TIMEOUT_CLASSES; i++) {
+		if (rtt[i].samples != 0) {
+			COut::dd("USB timeout class " + CFormat::intToString(i) + ": " + CFormat::intToString(rtt[i].samples) + " transfers, round trip "
+					+ CFormat::intToString(rtt[i].srtt) + "us (+/- " + CFormat::intToString(rtt[i].rttvar) + "us), timeout "
+					+ CFormat::intToString(timeout((timeout_class_t)i)) + "ms");
+		}
+	}
+
 	if (dev != NULL) {
 		libusb_release_interface(dev, INTERFACE);
 		libusb_close(dev);
 	}
-	if (context != NULL) {
+	if (context != NULL && sharedContext == false) {
 		libusb_exit(context);
 	}
 }
@@ -22,6 +22,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <libusb-1.0/libusb.h>
 #include <string>
+#include <chrono>
+#include <vector>
 #include "avrprog.h"
 #include "ExceptionBase.h"
 
@@ -44,16 +46,43 @@ public:
 	 * @param	device		USB bus and device id of the programmer hardware in the format "bus:device".
 	 * 						If this parameter is the empty string, the bus and device number
 	 * 						are ignored, and the first appropriate hardware in the device list is used.
+	 * @param	context		libusb context shared with other programmers, which is not released by this object.
+	 * 						If this parameter is NULL, an own context is used.
 	 */
-	CUSBCommunication(string device);
+	CUSBCommunication(string device, libusb_context *context = NULL);
 	virtual ~CUSBCommunication();
 	static const int BUFFER_LEN = 256;	///< Size of the internal buffer. This is also the limit of bytes that can be read with one transfer.
 
+	/**
+	 * @brief	Timeout classes of USB transfers.
+	 *
+	 * Each class has its own timeout, which is derived from the round trip times measured
+	 * for this class (see ADAPTIVE_USB_TIMEOUT). Classes which wait for the target additionally
+	 * have a lower limit derived from the worst case target timing. A read which times out is
+	 * retried once with twice the timeout before an error is reported, except for status responses,
+	 * so a missing programmer or target is detected after the first timeout.
+	 */
+	typedef enum {
+		TIMEOUT_STATUS		= 0,	///< Commands and short status responses.
+		TIMEOUT_TRANSFER	= 1,	///< Memory content transfers.
+		TIMEOUT_ERASE		= 2,	///< Chip erase and fuse writes.
+		TIMEOUT_PAGE_WRITE	= 3,	///< Responses which wait until the target has written flash pages.
+		TIMEOUT_EEPROM		= 4,	///< Responses which wait until the target has written an eeprom chunk.
+	} timeout_class_t;
+
 	/**
 	 * @brief	Print a list of available avrprog2 devices
 	 */
 	static void print_device_list();
 
+	/**
+	 * @brief	Find all avrprog2 devices.
+	 *
+	 * @param	context		libusb context which is used for the device discovery.
+	 * @return	USB bus and device id of each device in the format "bus:device".
+	 */
+	static vector<string> device_list(libusb_context *context);
+
 	/**
 	 * @brief	Isochronous read transfer.
 	 *
@@ -65,10 +94,11 @@ public:
 	 * @param	endpoint	USB endpoint number of the transfer.
 	 * @param	buffer		After  the transfer this pointer points to the first element of the read buffer.
 	 * @param	len			Number of bytes to read. After the transfer this parameter includes the number of bytes really read.
+	 * @param	timeoutClass	Timeout class of the transfer.
 	 * @return	Pointer to the read buffer in \a buffer
 	 * @return	Number of read bytes in \a len.
 	 */
-	void iso_read(int endpoint, uint8_t **buffer, int *len);
+	void iso_read(int endpoint, uint8_t **buffer, int *len, timeout_class_t timeoutClass = TIMEOUT_TRANSFER);
 
 	/**
 	 * @brief	Isochronous write transfer.
@@ -78,8 +108,9 @@ public:
 	 * @param	endpoint	USB endpoint number of the transfer.
 	 * @param	data		Byte array which should be transfered.
 	 * @param	len			Size of the \a data array.
+	 * @param	timeoutClass	Timeout class of the transfer.
 	 */
-	void iso_write(int endpoint, uint8_t *data, int len);
+	void iso_write(int endpoint, uint8_t *data, int len, timeout_class_t timeoutClass = TIMEOUT_TRANSFER);
 
 	/**
 	 * @brief	Interrupt read transfer.
@@ -92,10 +123,11 @@ public:
 	 * @param	endpoint	USB endpoint number of the transfer.
 	 * @param	buffer		After  the transfer this pointer points to the first element of the read buffer.
 	 * @param	len			Number of bytes to read. After the transfer this parameter includes the number of bytes really read.
+	 * @param	timeoutClass	Timeout class of the transfer.
 	 * @return	Pointer to the read buffer in \a buffer
 	 * @return	Number of read bytes in \a len.
 	 */
-	void int_read(int endpoint, uint8_t **buffer, int *len);
+	void int_read(int endpoint, uint8_t **buffer, int *len, timeout_class_t timeoutClass = TIMEOUT_STATUS);
 
 	/**
 	 * @brief	Interrupt write transfer.
@@ -105,21 +137,53 @@ public:
 	 * @param	endpoint	USB endpoint number of the transfer.
 	 * @param	data		Byte array which should be transfered.
 	 * @param	len			Size of the \a data array.
+	 * @param	timeoutClass	Timeout class of the transfer.
 	 */
-	void int_write(int endpoint, uint8_t *data, int len);
+	void int_write(int endpoint, uint8_t *data, int len, timeout_class_t timeoutClass = TIMEOUT_STATUS);
+
+protected:
+	/**
+	 * @brief	Set the lower limit of the timeout of a class.
+	 *
+	 * Used for classes which wait for the target, whose worst case timing is known
+	 * in advance but may be far above the measured round trip times.
+	 *
+	 * @param	timeoutClass	Timeout class.
+	 * @param	ms				Lower limit in ms, it is used even if it exceeds USB_TIMEOUT.
+	 */
+	void setTimeoutFloor(timeout_class_t timeoutClass, unsigned int ms);
+
 private:
 	libusb_context *context;
+	bool sharedContext;
 	libusb_device_handle *dev;
 	struct libusb_transfer *transfer;
 	int isoReceivedLen;
+	int isoCompleted;
 	bool error;
+	bool timedOut;
 	string errorMsg;
 
 	uint8_t buffer[BUFFER_LEN];
 
+	// smoothed round trip time and its mean deviation (both in us) of each timeout class
+	static const int NUM_OF_TIMEOUT_CLASSES = 5;
+	typedef struct {
+		int srtt;
+		int rttvar;
+		int samples;
+	} rtt_t;
+	rtt_t rtt[NUM_OF_TIMEOUT_CLASSES];
+	unsigned int minimum[NUM_OF_TIMEOUT_CLASSES];	// lower limit of the timeout (ms) of each class
+	unsigned int backedOff[NUM_OF_TIMEOUT_CLASSES];	// timeout (ms) of the last retry, until a transfer succeeds without retry
+
 	// The following methods are a wrappers from the asynchronous (non blocking) libusb isochrounous transfer function to a synchrounsous (blocking) one.
 	static void callback(struct libusb_transfer *transfer);
-	void iso_transfer(int endpoint, uint8_t *buffer, int *len);
+	void iso_transfer(int endpoint, uint8_t *buffer, int *len, timeout_class_t timeoutClass);
+
+	unsigned int timeout(timeout_class_t timeoutClass);
+	unsigned int backoff(timeout_class_t timeoutClass, unsigned int ms);
+	void measured(timeout_class_t timeoutClass, chrono::steady_clock::time_point start);
 };
 
 /**
@@ -0,0 +1,81 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CZstdInputStream.h"
+
+#if HAVE_LIBZSTD
+
+using namespace std;
+
+CZstdInputStream::CZstdInputStream(CInputStream *_source) : CInputStream(_source->getName()), source(_source), eof(false), frame(false), flush(false) {
+	stream = ZSTD_createDStream();
+	if (stream == NULL) {
+		delete source;
+		throw StreamException("Could not initialize zstd for '" + name + "'.");
+	}
+	ZSTD_initDStream(stream);
+
+	inputSize = ZSTD_DStreamInSize();
+	input = new uint8_t[inputSize];
+	in.src = input;
+	in.size = 0;
+	in.pos = 0;
+}
+
+int CZstdInputStream::read(uint8_t *buffer, int size) {
+	ZSTD_outBuffer out = {buffer, (size_t)size, 0};
+
+	// return as soon as some output is available
+	while (out.pos == 0) {
+		size_t ret;
+
+		if (in.pos == in.size && !flush) {
+			if (eof) {
+				if (frame) {
+					throw StreamException("Unexpected end of compressed data in '" + name + "'.");
+				}
+				break;
+			}
+			in.size = source->read(input, inputSize);
+			in.pos = 0;
+			if (in.size == 0) {
+				eof = true;
+				continue;
+			}
+		}
+
+		// ret is 0 at the end of a frame, another frame may follow
+		ret = ZSTD_decompressStream(stream, &out, &in);
+		if (ZSTD_isError(ret)) {
+			throw StreamException("Error while decompressing '" + name + "' (" + ZSTD_getErrorName(ret) + ").");
+		}
+		frame = (ret != 0);
+		flush = (out.pos == out.size);
+	}
+
+	return out.pos;
+}
+
+CZstdInputStream::~CZstdInputStream() {
+	ZSTD_freeDStream(stream);
+	delete[] input;
+	delete source;
+}
+
+#endif /* HAVE_LIBZSTD */
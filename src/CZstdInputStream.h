@@ -0,0 +1,58 @@
+/*
+avrprog - A Linux tool for the MikroElektronika (www.mikroe.com) AVRprog2 programming hardware.
+Copyright (C) 2011  Andreas Hagmann, Embedded Computing Systems group - TU Wien
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CZSTDINPUTSTREAM_H_
+#define CZSTDINPUTSTREAM_H_
+
+#include "CInputStream.h"
+#include "config.h"
+
+#if HAVE_LIBZSTD
+#include <zstd.h>
+
+/**
+ * @brief	Decompresses a zstd compressed stream on the fly.
+ * @throw	StreamException on errors.
+ *
+ * Only available if configure found libzstd.
+ */
+class CZstdInputStream : public CInputStream {
+public:
+	/**
+	 * @param	source	Stream with the compressed data, it is deleted by this object.
+	 */
+	CZstdInputStream(CInputStream *source);
+	virtual ~CZstdInputStream();
+
+	virtual int read(uint8_t *buffer, int size);
+
+private:
+	CInputStream *source;
+	ZSTD_DStream *stream;
+	ZSTD_inBuffer in;
+	uint8_t *input;
+	size_t inputSize;	// recommended size of the input buffer
+	bool eof;			// end of source reached
+	bool frame;			// inside of a zstd frame
+	bool flush;			// the output buffer was filled, the decoder may hold more output
+};
+
+#endif /* HAVE_LIBZSTD */
+
+#endif /* CZSTDINPUTSTREAM_H_ */
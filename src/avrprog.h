@@ -62,12 +62,36 @@ typedef enum {
 /// Communication timeout after which an error is reported.
 #define USB_TIMEOUT		3000
 
+/// If enabled, the timeout of each USB transfer is derived from the measured round trip times (USB_TIMEOUT is the upper bound).
+#ifndef ADAPTIVE_USB_TIMEOUT
+#define ADAPTIVE_USB_TIMEOUT 1
+#endif
+
+/// Lower bounds of the adaptive timeouts (ms) for status commands, memory transfers and erase/non-volatile writes.
+#define USB_TIMEOUT_STATUS_MIN		50
+#define USB_TIMEOUT_TRANSFER_MIN	100
+#define USB_TIMEOUT_ERASE_MIN		500
+
+/// Worst case write times (us) of the targets: a flash page (tWD_FLASH) and an eeprom byte (tWD_EEPROM).
+#define TARGET_FLASH_WRITE_US	4500
+#define TARGET_EEPROM_WRITE_US	9000
+
 /// Polling interval for the programmer to look if a page read has finished.
 #define READ_PAGE_DELAY 3000
 
 #define EMPTY_FLASH_BYTE	0xff
 #define EMPTY_EEPROM_BYTE	0xff
 
+/// Runs of at least HEX_MIN_GAP empty bytes are omitted when a flash readout is saved (0 saves the whole readout).
+#ifndef HEX_MIN_GAP
+#define HEX_MIN_GAP	64
+#endif
+
+/// Size limit of the image cache in ~/HOME_CONFIG_DIR/cache/ in bytes (see CImageCache), 0 disables the cache.
+#ifndef IMAGE_CACHE_SIZE
+#define IMAGE_CACHE_SIZE	(64 * 1024 * 1024)
+#endif
+
 /// Exit code if an error occurs during a verify operation.
 #define VERIFY_ERROR_NUMBER	-2
 /// Exit code for all other errors.
@@ -35,18 +35,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <stdio.h>
 //#include <signal.h>
 #include "CAVRprog.h"
+#include "CDaemon.h"
 #include "CFormat.h"
+#include "CGang.h"
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <getopt.h>
 #include "avrprog.h"
-#include "CEEPROMOptions.h"
-#include "CFlashOptions.h"
-#include "CFusesOptions.h"
-#include "CHexFile.h"
+#include "CJob.h"
+#include "CJobFile.h"
+#include "CJobLoader.h"
 #include "ExceptionBase.h"
 #include "CLArgumentException.h"
+#include "CLoop.h"
+#include "CMemoryKernels.h"
 #include "COut.h"
 
 using namespace std;
@@ -59,10 +62,16 @@ CAVRprog *prog = NULL;
 void usage(ostream *out = &cout) {
 	*out 																						<< endl;
 	*out << "Usage: " << PACKAGE_NAME << " [(--mcu | -m) (<mcutype> | <file>.xml | list)]"		<< endl;
-	*out << "   [(--usb | -u) (<busid[:devid]> | list)]"										<< endl;
+	*out << "   [(--usb | -u) (<busid[:devid]>[,<busid:devid>...] | all | hotplug | list)]"			<< endl;
 	*out << "   [--help | -h] [--version] [-d] [-d] [-v]"										<< endl;
 	*out << "   [(--frequency | -f) <frequency>]"												<< endl;
 	*out << "   [--erase] | [--no-erase]"														<< endl;
+	*out << "   [--journal <file>]"																<< endl;
+	*out << "   [--job <file>]"																	<< endl;
+	*out << "   [--bundle <file>]"																<< endl;
+	*out << "   [--daemon <socket>]"															<< endl;
+	*out << "   [--loop <ms>]"																	<< endl;
+	*out << "   [--fill <byte>] [--min-gap <bytes>] [--stream] [--no-cache]"								<< endl;
 	*out << "   [--flash (r|w|v):<file>]"														<< endl;
 	*out << "   [--eeprom (r|w|v):<file>]"														<< endl;
 	*out << "   [--fuses (r|w|v):(<file> | <lfuse>[,<hfuse>[,<efuse>]])]"						<< endl;
@@ -74,6 +83,10 @@ void usage(ostream *out = &cout) {
 	*out << "                            If no mcu type is given, autodetection gets enabled." 	<< endl;
 	*out << "  --usb, -u <bus[:device]>  Specify the USB bus and optionally the device id."		<< endl;
 	*out << "            list            Get a list of available devices"						<< endl;
+	*out << "            all             Program the targets of all devices in parallel."		<< endl;
+	*out << "            <bus:dev>,...   Program the targets of the given devices in parallel."	<< endl;
+	*out << "            hotplug         Execute --job with all devices, also with devices"		<< endl;
+	*out << "                            which are plugged in later."							<< endl;
 	*out << "                            If bus and device id are not specified, the first " 	<< endl;
 	*out << "                            discovered device is used."							<< endl;
 	*out << "  --help, -h                Display this usage message." 							<< endl;
@@ -86,10 +99,39 @@ void usage(ostream *out = &cout) {
 	*out << "                            If no frequency is given, autodetection gets enabled." << endl;
 	*out << "  --erase                   Perform a chip erase."									<< endl;
 	*out << "  --no-erase                Skip implicit erase before programming flash memory."	<< endl;
+	*out << "  --journal <file>          Record written flash chunks in <file>. An interrupted"	<< endl;
+	*out << "                            write of the same image to the same target resumes"	<< endl;
+	*out << "                            at the first unconfirmed chunk without a chip erase."	<< endl;
+	*out << "  --job <file>              Program several targets (sockets) in one session."	<< endl;
+	*out << "                            Each line of <file> looks like"						<< endl;
+	*out << "                            <socket> <mcu> flash=w:<file> eeprom=... fuses=..."	<< endl;
+	*out << "  --fill <byte>             Value of empty flash bytes in readouts (default 0xff)."	<< endl;
+	*out << "  --min-gap <bytes>         Omit runs of at least <bytes> empty bytes when saving"	<< endl;
+	*out << "                            a flash readout (default " << HEX_MIN_GAP << ", 0 saves all)."	<< endl;
+	*out << "  --stream                  Write flash while the file is parsed (hex, srec and bin"	<< endl;
+	*out << "                            files ordered by address, no journal)."				<< endl;
+	*out << "  --bundle <file>           Prepare the file of --flash w:<file> for --mcu and"	<< endl;
+	*out << "                            save it to <file> (*.bundle), no programmer is used."	<< endl;
+	*out << "                            Bundles are written without parsing."					<< endl;
+	*out << "  --daemon <socket>         Keep the programmer open and execute job lines (like"	<< endl;
+	*out << "                            in --job files) sent to the Unix socket <socket>."	<< endl;
+	*out << "                            Loaded input files are kept between the jobs."		<< endl;
+	*out << "  --loop <ms>               Keep the programmer open and program one board after"	<< endl;
+	*out << "                            another. The socket is polled every <ms> for an"		<< endl;
+	*out << "                            inserted board, which is programmed and then has to"	<< endl;
+	*out << "                            be removed. Stop it with Ctrl-C."						<< endl;
+	*out << "  --no-cache                Always parse input files. Otherwise parsed images are"	<< endl;
+	*out << "                            kept in ~/" << HOME_CONFIG_DIR << "cache/ and reused."	<< endl;
 	*out << "  --flash (r|w|v):<file>    Perform the given operation on flash memory." 			<< endl;
 	*out << "                            r    Read memory and save it to file."					<< endl;
 	*out << "                            w    Write content from file to memory." 				<< endl;
 	*out << "                            v    Verify the memory content against file."			<< endl;
+	*out << "                            <file> is a *.hex, *.elf, *.srec, *.bin or *.bundle"	<< endl;
+	*out << "                            file. A *.bin file may be followed by @<address>,"	<< endl;
+	*out << "                            other files by @<offset> of their addresses."		<< endl;
+	*out << "                            w:<file>,<file>,... writes several files at once."	<< endl;
+	*out << "                            -:<format> reads from stdin or writes to stdout,"	<< endl;
+	*out << "                            e.g. -:hex, -:srec or -:bin."						<< endl;
 	*out << "  --eeprom (r|w|v):<file>   Perform the given operation on eeprom memory." 		<< endl;
 	*out << "  --fuses (r|w|v):(<file> | <lfuse>[,<hfuse>[,<efuse>]]) "							<< endl;
 	*out <<	"                            Perform the given operation on fuse bytes." 			<< endl;
@@ -113,9 +155,6 @@ void catchSigInt(int num) {
 */
 
 int main(int argc, char** argv) {
-	uint8_t *buffer = NULL;
-	int size;
-	CHexFile *hexFile = NULL;
 	int returnValue = 0;
 	stringstream freqConversion;
 	int frequency = FREQUENCY_AUTODETECT;
@@ -132,9 +171,18 @@ int main(int argc, char** argv) {
 	string fuses = "";
 	string mcu = "";
 	string usbDevice = "";
-	CFlashOptions *flashOptions = NULL;
-	CEEPROMOptions *eepromOptions = NULL;
-	CFusesOptions *fusesOptions = NULL;
+	string journalPath = "";
+	string jobPath = "";
+	int fill = EMPTY_FLASH_BYTE;
+	int minGap = HEX_MIN_GAP;
+	bool stream = false;
+	bool cache = (IMAGE_CACHE_SIZE > 0);
+	string bundlePath = "";
+	string daemonPath = "";
+	int loopInterval = 0;
+	CJob *job = NULL;
+	CJobFile *jobFile = NULL;
+	vector<CJob*> jobs;
 
 	//signal(SIGINT, catchSigInt);
 
@@ -153,6 +201,15 @@ int main(int argc, char** argv) {
 			{"flash",		required_argument,	NULL, 'F'},
 			{"eeprom",		required_argument,	NULL, 'P'},
 			{"fuses",		required_argument,	NULL, 'U'},
+			{"journal",		required_argument,	NULL, 'J'},
+			{"job",			required_argument,	NULL, 'j'},
+			{"fill",		required_argument,	NULL, 'I'},
+			{"min-gap",		required_argument,	NULL, 'G'},
+			{"stream",		no_argument,		NULL, 'S'},
+			{"bundle",		required_argument,	NULL, 'B'},
+			{"no-cache",	no_argument,		NULL, 'C'},
+			{"daemon",		required_argument,	NULL, 'D'},
+			{"loop",		required_argument,	NULL, 'L'},
 			{0, 0, 0, 0}
 	};
 
@@ -208,6 +265,46 @@ int main(int argc, char** argv) {
 				if (optarg[0] == '-') throw CLArgumentException("fuses requires an argument.");
 				fuses = optarg;
 				break;
+			case 'J':
+				if (journalPath.size() != 0) throw CLArgumentException("journal was already specified.");
+				if (optarg[0] == '-') throw CLArgumentException("journal requires an argument.");
+				journalPath = optarg;
+				break;
+			case 'j':
+				if (jobPath.size() != 0) throw CLArgumentException("job was already specified.");
+				if (optarg[0] == '-') throw CLArgumentException("job requires an argument.");
+				jobPath = optarg;
+				break;
+			case 'I':
+				if (optarg[0] == '-') throw CLArgumentException("fill requires an argument.");
+				fill = CFormat::stringToInt(optarg);
+				if (fill < 0 || fill > 0xff) throw CLArgumentException("fill must be a byte value.");
+				break;
+			case 'G':
+				if (optarg[0] == '-') throw CLArgumentException("min-gap requires an argument.");
+				minGap = CFormat::stringToInt(optarg);
+				break;
+			case 'S':
+				stream = true;
+				break;
+			case 'B':
+				if (bundlePath.size() != 0) throw CLArgumentException("bundle was already specified.");
+				if (optarg[0] == '-') throw CLArgumentException("bundle requires an argument.");
+				bundlePath = optarg;
+				break;
+			case 'C':
+				cache = false;
+				break;
+			case 'D':
+				if (daemonPath.size() != 0) throw CLArgumentException("daemon was already specified.");
+				if (optarg[0] == '-') throw CLArgumentException("daemon requires an argument.");
+				daemonPath = optarg;
+				break;
+			case 'L':
+				if (optarg[0] == '-') throw CLArgumentException("loop requires an argument.");
+				loopInterval = CFormat::stringToInt(optarg);
+				if (loopInterval <= 0) throw CLArgumentException("loop requires an interval in ms.");
+				break;
 			case '?':
 				throw CLArgumentException("");
 				break;
@@ -217,12 +314,18 @@ int main(int argc, char** argv) {
 		// check for remaining arguments
 		if (optind != argc)	throw CLArgumentException("Invalid argument '" + (string)argv[optind] + "'.");
 
+		// a readout to standard output must not be mixed with messages
+		if (flash.substr(0, 4).compare("r:-:") == 0 || eeprom.substr(0, 4).compare("r:-:") == 0 || fuses.substr(0, 4).compare("r:-:") == 0) {
+			cout.rdbuf(cerr.rdbuf());
+		}
+
 		// print debuf info
 		COut::setDebugLevel(debug);
 
 		COut::d(PACKAGE_STRING);
 		COut::d("System configuration directory: " + (string)CONFIG_DIR);
 		COut::d("User configuration directory: ~/" + (string)HOME_CONFIG_DIR);
+		COut::d("Memory kernels: " + CMemoryKernels::implementation());
 #if WRITE_FUSES_SUPPORT
 #else
 		COut::d("Writing of fuse bytes is disabled");
@@ -251,196 +354,131 @@ int main(int argc, char** argv) {
 			return returnValue;
 		}
 
-		if (flash.size() != 0) {
-			COut::d("Prepare buffer for flash operations.");
-			flashOptions = new CFlashOptions(flash);
-			if (flashOptions->getOperation() == WRITE) {
-				chipErase = true;
-			}
-			COut::d("");
-		}
-		if (eeprom.size() != 0) {
-			COut::d("Prepare buffer for eeprom operations.");
-			eepromOptions = new CEEPROMOptions(eeprom);
-			//if (eepromOptions->getOperation() == WRITE) {
-			//	chipErase = true;
-			//}
-			COut::d("");
+		bool gang = (usbDevice.compare("all") == 0 || usbDevice.compare("hotplug") == 0 || usbDevice.find(',') != usbDevice.npos);
+
+		if (usbDevice.compare("hotplug") == 0 && jobPath.size() == 0) {
+			throw CLArgumentException("hotplug requires a job file.");
 		}
-		if (fuses.size() != 0) {
-			COut::d("Prepare buffer for fuse bytes operations.");
-			fusesOptions = new CFusesOptions(fuses);
-			COut::d("");
+		if (loopInterval != 0 && (gang == true || jobPath.size() != 0 || daemonPath.size() != 0 || bundlePath.size() != 0)) {
+			throw CLArgumentException("loop cannot be combined with several usb devices, job, daemon or bundle.");
 		}
 
-		prog = new CAVRprog(usbDevice);
-		prog->connect(mcu, frequency);
+		// jobs are received from the socket until a client sends "quit"
+		if (daemonPath.size() != 0) {
+			if (gang == true) {
+				throw CLArgumentException("daemon requires a single usb device.");
+			}
+			if (jobPath.size() != 0 || flash.size() != 0 || eeprom.size() != 0 || fuses.size() != 0 || journalPath.size() != 0 || bundlePath.size() != 0) {
+				throw CLArgumentException("daemon cannot be combined with jobs or memory operations.");
+			}
+			prog = new CAVRprog(usbDevice);
+
+			CDaemon daemon(prog, daemonPath, frequency);
+			daemon.setGaps(fill, minGap);
+			daemon.setCache(cache);
+			daemon.run();
+
+			closeProgrammer();
+			return returnValue;
+		}
 
-		// this is only for output
-		if (fusesOptions == NULL && flashOptions == NULL && eepromOptions == NULL && chipErase == false) {
-			cout << "Reset device..." << endl;
+		if (jobPath.size() != 0) {
+			if (flash.size() != 0 || eeprom.size() != 0 || fuses.size() != 0 || journalPath.size() != 0 || bundlePath.size() != 0) {
+				throw CLArgumentException("job cannot be combined with memory operations.");
+			}
+			jobFile = new CJobFile(jobPath);
+			jobs = jobFile->getJobs();
 		}
-		if (flashOptions != NULL && noChipErase) {
-			cout << "Flash memory will be programmed without a preceding chip erase." << endl;
+		else {
+			job = new CJob(flash, eeprom, fuses);
+			job->setMcu(mcu);
+			job->setVerify(verify);
+			job->setErase(chipErase);
+			job->setNoErase(noChipErase);
+			job->setJournal(journalPath);
+			job->setStream(stream);
+			jobs.push_back(job);
 		}
 
-		// perform chip erase
-		if (chipErase == true && noChipErase == false) {
-			cout << endl << "Chip erase..." << endl;
-			prog->chipErase();
+		for (unsigned int i=0; i<jobs.size(); i++) {
+			jobs[i]->setGaps(fill, minGap);
+			jobs[i]->setCache(cache);
 		}
 
-		// perform fuses actions
-		if (fusesOptions != NULL) {
-			switch (fusesOptions->getOperation()) {
-			case WRITE:
-				cout << endl << "Write fuse bytes..." << endl;
+		// the input files are loaded while the programmer and the target are connected
+		CJobLoader loader(jobs, jobFile == NULL);
 
-				// check weather device was specified
-				if (mcu.size() == 0) {
-					throw ProgramOptionsException("Writing fuses requires a specified mcu type.");
-				}
-#if WRITE_FUSES_SUPPORT
-				prog->writeFuses(fusesOptions->getLfuse(), fusesOptions->getHfuse(), fusesOptions->getEfuse(), fusesOptions->getNumOfFuses());
-				cout << fusesOptions->getNumOfFuses() << " fuse bytes written" << endl;
+		// a bundle is prepared without hardware access
+		if (bundlePath.size() != 0) {
+			loader.wait();
+			job->saveBundle(bundlePath);
+			delete job;
+			return returnValue;
+		}
 
-				if (verify == true) {
-					cout << endl << "Verify fuse bytes..." << endl;
-					if (prog->verifyFuses(fusesOptions->getBuffer(), fusesOptions->getBufferSize()) == false) {
-						throw ExceptionBase("Verify fuse bytes failed.");
-					}
-					else {
-						cout << "OK, " << fusesOptions->getBufferSize() << " fuse bytes verified" << endl;
-					}
-				}
-#else
-				cout << "This version does not support writing of fuse bytes.";
-#endif
-				break;
-			case READ:
-				cout << endl << "Read fuse bytes..." << endl;
-				size = prog->readFuses(&buffer);
-				switch (fusesOptions->getType()) {
-				case HEX:
-					hexFile = new CHexFile(fusesOptions->getPath());
-					hexFile->save(buffer, size);
-					delete hexFile;
-					break;
-				case IMMEDIATE:
-					cout << "\tlfuse: " << "0x" << CFormat::intToHexString(buffer[0]) << endl;
-					if (size > 1)
-						cout << "\thfuse: " << "0x" << CFormat::intToHexString(buffer[1]) << endl;
-					if (size > 2)
-						cout << "\tefuse: " << "0x" << CFormat::intToHexString(buffer[2]) << endl;
-					break;
-				case ELF:
-					throw ProgramOptionsException("Read fuse bytes into *.elf files is not supported.");
-					break;
-				}
-				delete[] buffer;
-				cout << size << " fuse bytes read" << endl;
-				break;
-			case VERIFY:
-				cout << endl << "Verify fuse bytes..." << endl;
-				if (prog->verifyFuses(fusesOptions->getBuffer(), fusesOptions->getBufferSize()) == false) {
-					cout << "failed";
-					returnValue = VERIFY_ERROR_NUMBER;
-				}
-				else {
-					cout << "OK";
-				}
-				cout << ", " << fusesOptions->getBufferSize() << " fuse bytes verified" << endl;
-				break;
+		// several programmers execute the same job, or share the jobs of the job file
+		if (gang == true) {
+			loader.wait();
+
+			CGang programmers(usbDevice);
+			if (jobFile == NULL) {
+				returnValue = programmers.execute(job, frequency);
+				delete job;
 			}
+			else {
+				returnValue = programmers.execute(jobs, frequency);
+				delete jobFile;
+			}
+			return returnValue;
 		}
 
-		// perform flash actions
-		if (flashOptions != NULL) {
-			switch (flashOptions->getOperation()) {
-			case WRITE:
-				cout << endl << "Write to flash memory..." << endl;
-				prog->writeFlash(flashOptions->getBuffer(), flashOptions->getBufferSize());
-				cout << flashOptions->getBufferSize() << " bytes written" << endl;
-
-				if (verify == true) {
-					cout << endl << "Verify flash memory..." << endl;
-					if (prog->fastVerifyFlash(flashOptions->getBuffer(), flashOptions->getBufferSize()) == false) {
-						throw ExceptionBase("Verify flash failed.");
-					}
-					else {
-						cout << "OK, " << flashOptions->getBufferSize() << " bytes verified" << endl;
-					}
-				}
-				break;
-			case READ:
-				if (flashOptions->getType() != HEX) {
-					throw ProgramOptionsException("Only reads into *.hex files are supported.");
-				}
-				cout << endl << "Read from flash memory..." << endl;
-				size = prog->readFlash(&buffer);
-				hexFile = new CHexFile(flashOptions->getPath());
-				hexFile->save(buffer, size);
-				delete hexFile;
-				delete[] buffer;
-				cout << size << " bytes read" << endl;
-				break;
-			case VERIFY:
-				cout << endl << "Verify flash memory..." << endl;
-				if (prog->verifyFlash(flashOptions->getBuffer(), flashOptions->getBufferSize()) == false) {
-					cout << "failed";
-					returnValue = VERIFY_ERROR_NUMBER;
-				}
-				else {
-					cout << "OK";
-				}
-				cout << ", " << flashOptions->getBufferSize() << " bytes verified" << endl;
-				break;
+		try {
+			prog = new CAVRprog(usbDevice);
+			if (jobFile == NULL && loopInterval == 0) {
+				prog->connect(mcu, frequency, AUTO_DETECT);
 			}
 		}
+		catch (ExceptionBase &e) {
+			// errors in the input files are reported first
+			loader.wait();
+			throw;
+		}
+		loader.wait();
 
-		// perform eeprom actions
-		if (eepromOptions != NULL) {
-			switch (eepromOptions->getOperation()) {
-			case WRITE:
-				cout << endl << "Write to eeprom memory..." << endl;
-				prog->writeEEPROM(eepromOptions->getBuffer(), eepromOptions->getBufferSize());
-				cout << eepromOptions->getBufferSize() << " bytes written" << endl;
-
-				if (verify == true) {
-					cout << endl << "Verify eeprom memory..." << endl;
-					if (prog->fastVerifyEEPROM(eepromOptions->getBuffer(), eepromOptions->getBufferSize()) == false) {
-						//cout << "failed" << endl;
-						throw ExceptionBase("Verify eeprom failed.");
-					}
-					else {
-						cout << "OK, " << eepromOptions->getBufferSize() << " bytes verified" << endl;
+		// runs until the program is stopped or the programmer is lost
+		if (loopInterval != 0) {
+			CLoop loop(prog, frequency, loopInterval);
+			loop.run(job);
+		}
+		else if (jobFile == NULL) {
+			returnValue = job->execute(prog);
+		}
+		else {
+			int failed = 0;
+
+			// all targets are programmed within one usb session
+			for (unsigned int i=0; i<jobs.size(); i++) {
+				cout << endl << "Target " << i+1 << " of " << jobs.size() << "..." << endl;
+				try {
+					prog->connect(jobs[i]->getMcu(), frequency, jobs[i]->getSocket());
+					if (jobs[i]->execute(prog) != 0) {
+						failed++;
+						returnValue = VERIFY_ERROR_NUMBER;
 					}
+					prog->disconnect();
 				}
-				break;
-			case READ:
-				if (eepromOptions->getType() != HEX) {
-					throw ProgramOptionsException("Only reads into *.hex files are supported.");
-				}
-				cout << endl << "Read from eeprom memory..." << endl;
-				size = prog->readEEPROM(&buffer);
-				hexFile = new CHexFile(eepromOptions->getPath());
-				hexFile->save(buffer, size);
-				delete hexFile;
-				delete[] buffer;
-				cout << size << " bytes read" << endl;
-				break;
-			case VERIFY:
-				cout << endl << "Verify eeprom memory..." << endl;
-				if (prog->verifyEEPROM(eepromOptions->getBuffer(), eepromOptions->getBufferSize()) == false) {
-					cout << "failed";
-					returnValue = VERIFY_ERROR_NUMBER;
+				catch (USBCommunicationException &e) {
+					throw;
 				}
-				else {
-					cout << "OK";
+				catch (ExceptionBase &e) {
+					cerr << "Target " << i+1 << ": " << e.what() << endl;
+					failed++;
+					returnValue = COMMON_ERROR_NUMBER;
+					prog->disconnect();
 				}
-				cout << ", " << eepromOptions->getBufferSize() << " bytes verified" << endl;
-				break;
 			}
+
+			cout << endl << jobs.size() - failed << " of " << jobs.size() << " targets succeeded." << endl;
 		}
 	}
 	catch (ChecksumException &e) {
@@ -479,14 +517,11 @@ int main(int argc, char** argv) {
 
 	// cleanup
 	closeProgrammer();
-	if (flashOptions != NULL) {
-		delete flashOptions;
-	}
-	if (eepromOptions != NULL) {
-		delete eepromOptions;
+	if (jobFile != NULL) {
+		delete jobFile;
 	}
-	if (fusesOptions != NULL) {
-		delete fusesOptions;
+	else if (job != NULL) {
+		delete job;
 	}
 
 	return returnValue;